@@ -182,6 +182,19 @@ public:
         addnode(new node(key, 0));
         m[key] = head->next;
     }
+
+    // forgets every block of a file, e.g. after it was truncated or deleted
+    void drop_file(slsfs::pack::key_t const& file_key)
+    {
+        std::lock_guard<std::mutex> lock{mtx_};
+        for (auto it = m.lower_bound(cache_entry(file_key, 0, 0));
+             it != m.end() && it->first.file_key_ == file_key;)
+        {
+            deletenode(it->second);
+            it = m.erase(it);
+        }
+        caching_map_ref_.erase(file_key);
+    }
 };
 
 /**
@@ -436,6 +449,10 @@ public:
 
     ///////////////////////////// CACHE IO OPERATIONS ////////////////////////////////
 
+    void drop_file(slsfs::pack::key_t const& file_key) {
+        lru_cache_.drop_file(file_key);
+    }
+
     auto read_from_cache(slsfs::jsre::request_parser<slsfs::base::byte> const& input)
         -> std::optional<slsfs::base::buf>
     {
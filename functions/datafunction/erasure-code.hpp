@@ -0,0 +1,274 @@
+#pragma once
+
+#ifndef ERASURE_CODE_HPP__
+#define ERASURE_CODE_HPP__
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <stdexcept>
+#include <vector>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+namespace slsfsdf::ec
+{
+
+// GF(2^8) over x^8 + x^4 + x^3 + x^2 + 1 (0x11d)
+class gf256
+{
+    std::array<std::uint8_t, 512> exp_ {};
+    std::array<std::uint8_t, 256> log_ {};
+
+public:
+    // nibble tables for the pshufb multiply: c * x == lo[c][x & 0xf] ^ hi[c][x >> 4]
+    std::array<std::array<std::uint8_t, 16>, 256> lo {}, hi {};
+
+    gf256()
+    {
+        unsigned x = 1;
+        for (int i = 0; i < 255; i++)
+        {
+            exp_[i] = exp_[i + 255] = static_cast<std::uint8_t>(x);
+            log_[x] = static_cast<std::uint8_t>(i);
+            x <<= 1;
+            if (x & 0x100)
+                x ^= 0x11d;
+        }
+
+        for (int c = 0; c < 256; c++)
+            for (int n = 0; n < 16; n++)
+            {
+                lo[c][n] = mul(c, n);
+                hi[c][n] = mul(c, n << 4);
+            }
+    }
+
+    static
+    auto instance() -> gf256 const&
+    {
+        static gf256 const g;
+        return g;
+    }
+
+    auto mul(int const a, int const b) const -> std::uint8_t
+    {
+        if (a == 0 or b == 0)
+            return 0;
+        return exp_[log_[a] + log_[b]];
+    }
+
+    auto inv(int const a) const -> std::uint8_t
+    {
+        if (a == 0)
+            throw std::domain_error("gf256: inverse of 0");
+        return exp_[255 - log_[a]];
+    }
+};
+
+namespace detail
+{
+
+inline
+void mul_add_scalar(std::uint8_t c, std::uint8_t const* src, std::uint8_t* dst, std::size_t size)
+{
+    gf256 const& g = gf256::instance();
+    for (std::size_t i = 0; i < size; i++)
+        dst[i] ^= g.lo[c][src[i] & 0xf] ^ g.hi[c][src[i] >> 4];
+}
+
+#if defined(__x86_64__)
+__attribute__((target("ssse3")))
+inline
+void mul_add_ssse3(std::uint8_t c, std::uint8_t const* src, std::uint8_t* dst, std::size_t size)
+{
+    gf256 const& g = gf256::instance();
+    __m128i const lo   = _mm_loadu_si128(reinterpret_cast<__m128i const*>(g.lo[c].data()));
+    __m128i const hi   = _mm_loadu_si128(reinterpret_cast<__m128i const*>(g.hi[c].data()));
+    __m128i const mask = _mm_set1_epi8(0x0f);
+
+    std::size_t i = 0;
+    for (; i + 16 <= size; i += 16)
+    {
+        __m128i const s = _mm_loadu_si128(reinterpret_cast<__m128i const*>(src + i));
+        __m128i const l = _mm_shuffle_epi8(lo, _mm_and_si128(s, mask));
+        __m128i const h = _mm_shuffle_epi8(hi, _mm_and_si128(_mm_srli_epi64(s, 4), mask));
+        __m128i const d = _mm_loadu_si128(reinterpret_cast<__m128i const*>(dst + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_xor_si128(d, _mm_xor_si128(l, h)));
+    }
+    mul_add_scalar(c, src + i, dst + i, size - i);
+}
+
+__attribute__((target("avx2")))
+inline
+void mul_add_avx2(std::uint8_t c, std::uint8_t const* src, std::uint8_t* dst, std::size_t size)
+{
+    gf256 const& g = gf256::instance();
+    __m256i const lo   = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<__m128i const*>(g.lo[c].data())));
+    __m256i const hi   = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<__m128i const*>(g.hi[c].data())));
+    __m256i const mask = _mm256_set1_epi8(0x0f);
+
+    std::size_t i = 0;
+    for (; i + 32 <= size; i += 32)
+    {
+        __m256i const s = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(src + i));
+        __m256i const l = _mm256_shuffle_epi8(lo, _mm256_and_si256(s, mask));
+        __m256i const h = _mm256_shuffle_epi8(hi, _mm256_and_si256(_mm256_srli_epi64(s, 4), mask));
+        __m256i const d = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(dst + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_xor_si256(d, _mm256_xor_si256(l, h)));
+    }
+    mul_add_scalar(c, src + i, dst + i, size - i);
+}
+#endif
+
+using mul_add_fn = void (*)(std::uint8_t, std::uint8_t const*, std::uint8_t*, std::size_t);
+
+// picked once from the running cpu
+inline
+auto select_mul_add() -> mul_add_fn
+{
+#if defined(__x86_64__)
+    if (__builtin_cpu_supports("avx2"))
+        return mul_add_avx2;
+    if (__builtin_cpu_supports("ssse3"))
+        return mul_add_ssse3;
+#endif
+    return mul_add_scalar;
+}
+
+} // namespace detail
+
+// dst[i] ^= c * src[i] for i in [0, size)
+inline
+void mul_add(std::uint8_t const c, std::uint8_t const* src, std::uint8_t* dst, std::size_t const size)
+{
+    static detail::mul_add_fn const fn = detail::select_mul_add();
+    if (c == 0)
+        return;
+    fn(c, src, dst, size);
+}
+
+// Systematic Reed-Solomon code with k data and m parity fragments of equal size.
+// The parity rows form a Cauchy matrix, so any k of the k+m fragments recover the data.
+class reed_solomon
+{
+    int const k_, m_;
+    std::vector<std::vector<std::uint8_t>> parity_rows_; // m x k
+
+    // row r of the (k+m) x k generator: identity for data fragments, cauchy for parity
+    auto generator_row(int const r) const -> std::vector<std::uint8_t>
+    {
+        if (r >= k_)
+            return parity_rows_[r - k_];
+
+        std::vector<std::uint8_t> row(k_, 0);
+        row[r] = 1;
+        return row;
+    }
+
+public:
+    reed_solomon(int const k, int const m): k_{k}, m_{m}
+    {
+        if (k <= 0 or m < 0 or k + m > 256)
+            throw std::invalid_argument("reed_solomon: need 0 < k and k + m <= 256");
+
+        gf256 const& g = gf256::instance();
+        for (int j = 0; j < m; j++)
+        {
+            std::vector<std::uint8_t> row(k);
+            for (int i = 0; i < k; i++)
+                row[i] = g.inv((k + j) ^ i);
+            parity_rows_.push_back(std::move(row));
+        }
+    }
+
+    auto k() const -> int { return k_; }
+    auto m() const -> int { return m_; }
+
+    // data: k fragments of the same size; returns the m parity fragments
+    auto encode(std::vector<std::vector<std::uint8_t>> const& data) const -> std::vector<std::vector<std::uint8_t>>
+    {
+        std::size_t const size = data.empty()? 0 : data.front().size();
+        std::vector<std::vector<std::uint8_t>> parity(m_, std::vector<std::uint8_t>(size, 0));
+        for (int j = 0; j < m_; j++)
+            for (int i = 0; i < k_; i++)
+                mul_add(parity_rows_[j][i], data[i].data(), parity[j].data(), size);
+        return parity;
+    }
+
+    // fragments: k+m slots in fragment order, nullopt for the lost ones.
+    // returns the k data fragments, or nullopt when fewer than k survived
+    auto decode(std::vector<std::optional<std::vector<std::uint8_t>>> const& fragments) const
+        -> std::optional<std::vector<std::vector<std::uint8_t>>>
+    {
+        std::vector<int> rows;
+        for (int r = 0; r < k_ + m_ and static_cast<int>(rows.size()) < k_; r++)
+            if (fragments[r].has_value())
+                rows.push_back(r);
+
+        if (static_cast<int>(rows.size()) < k_)
+            return std::nullopt;
+
+        std::size_t const size = fragments[rows.front()]->size();
+
+        // nothing lost among the data fragments
+        if (rows.back() < k_)
+        {
+            std::vector<std::vector<std::uint8_t>> data;
+            for (int r : rows)
+                data.push_back(*fragments[r]);
+            return data;
+        }
+
+        // invert the k x k submatrix of the surviving rows by gauss-jordan
+        gf256 const& g = gf256::instance();
+        std::vector<std::vector<std::uint8_t>> a, inv;
+        for (int i = 0; i < k_; i++)
+        {
+            a.push_back(generator_row(rows[i]));
+            std::vector<std::uint8_t> unit(k_, 0);
+            unit[i] = 1;
+            inv.push_back(std::move(unit));
+        }
+
+        for (int col = 0; col < k_; col++)
+        {
+            int pivot = col;
+            while (a[pivot][col] == 0)
+                pivot++; // any k rows of the generator are independent
+            std::swap(a[pivot], a[col]);
+            std::swap(inv[pivot], inv[col]);
+
+            std::uint8_t const scale = g.inv(a[col][col]);
+            for (int c = 0; c < k_; c++)
+            {
+                a[col][c]   = g.mul(a[col][c], scale);
+                inv[col][c] = g.mul(inv[col][c], scale);
+            }
+
+            for (int r = 0; r < k_; r++)
+                if (r != col and a[r][col] != 0)
+                {
+                    std::uint8_t const factor = a[r][col];
+                    for (int c = 0; c < k_; c++)
+                    {
+                        a[r][c]   ^= g.mul(factor, a[col][c]);
+                        inv[r][c] ^= g.mul(factor, inv[col][c]);
+                    }
+                }
+        }
+
+        std::vector<std::vector<std::uint8_t>> data(k_, std::vector<std::uint8_t>(size, 0));
+        for (int i = 0; i < k_; i++)
+            for (int j = 0; j < k_; j++)
+                mul_add(inv[i][j], fragments[rows[j]]->data(), data[i].data(), size);
+        return data;
+    }
+};
+
+} // namespace slsfsdf::ec
+
+#endif // ERASURE_CODE_HPP__
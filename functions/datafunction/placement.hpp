@@ -0,0 +1,89 @@
+#pragma once
+
+#ifndef PLACEMENT_HPP__
+#define PLACEMENT_HPP__
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+namespace slsfsdf::placement
+{
+
+// Block to host placement. Pure functions of (uuid, blockid, replica, host count):
+// no shared state, no allocation, and O(log hosts) per call.
+// The unit placed is a range of range_blocks consecutive blocks, not a single block:
+// sequential reads (get_range) and the per-host 2pc batches then cover whole ranges.
+
+// splitmix64 finalizer
+constexpr auto mix (std::uint64_t x) -> std::uint64_t
+{
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+template<typename Key>
+auto hash (Key const& uuid, std::uint32_t const blockid, std::uint32_t const salt) -> std::uint64_t
+{
+    std::uint64_t h = 0x9e3779b97f4a7c15ULL;
+    for (std::size_t i = 0; i < uuid.size(); i += sizeof(std::uint64_t))
+    {
+        std::uint64_t word = 0;
+        std::memcpy(&word, uuid.data() + i, std::min(sizeof(word), uuid.size() - i));
+        h = mix(h ^ word);
+    }
+    return mix(h ^ ((static_cast<std::uint64_t>(blockid) << 32) | salt));
+}
+
+// jump consistent hash (Lamping, Veach 2014): a bucket in [0, buckets).
+// going from n to n+1 buckets moves only 1/(n+1) of the keys, all into the new bucket
+constexpr auto jump (std::uint64_t key, int const buckets) -> int
+{
+    std::int64_t b = -1, j = 0;
+    while (j < buckets)
+    {
+        b = j;
+        key = key * 2862933555777941757ULL + 1;
+        j = static_cast<std::int64_t>((b + 1) * (static_cast<double>(1LL << 31) / static_cast<double>((key >> 33) + 1)));
+    }
+    return static_cast<int>(b);
+}
+
+constexpr int max_replicas = 16;
+constexpr std::uint32_t range_blocks = 64;
+
+// host of replica number replica of a block; replicas of one block land on distinct hosts,
+// and every block of a range goes to the same hosts.
+// hosts are only ever appended, which keeps the reshuffle of jump()
+template<typename Key>
+auto host (Key const& uuid, std::uint32_t const blockid, int const replica, int const hosts) -> int
+{
+    if (hosts <= 0 or replica < 0 or replica >= std::min(hosts, max_replicas))
+        throw std::out_of_range("placement: replica past the host count");
+
+    std::uint32_t const range = blockid / range_blocks;
+    std::array<int, max_replicas> chosen;
+    std::uint32_t salt = 0;
+    for (int r = 0; r <= replica; r++)
+        for (;; salt++)
+        {
+            int const candidate = jump(hash(uuid, range, salt), hosts);
+            if (std::find(chosen.begin(), chosen.begin() + r, candidate) == chosen.begin() + r)
+            {
+                chosen[r] = candidate;
+                salt++;
+                break;
+            }
+        }
+    return chosen[replica];
+}
+
+} // namespace slsfsdf::placement
+
+#endif // PLACEMENT_HPP__
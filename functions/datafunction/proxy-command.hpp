@@ -58,6 +58,7 @@ class proxy_command : public std::enable_shared_from_this<proxy_command>
 
     std::shared_ptr<storage_conf> datastorage_conf_;
     slsfs::socket_writer::socket_writer<slsfs::pack::packet, std::vector<slsfs::pack::unit_t>> writer_;
+    slsfs::framing_reader::framing_reader<slsfs::pack::packet_header, std::vector<slsfs::pack::unit_t>> reader_;
 
     queue_map& queue_map_;
     proxy_set& proxy_set_;
@@ -103,6 +104,17 @@ public:
                   std::string const& cache_policy)
         : io_context_{io_context}, socket_{io_context_}, recv_deadline_{io_context_},
           datastorage_conf_{conf}, writer_{io_context_, socket_},
+          reader_{socket_,
+                  [] (slsfs::pack::packet_header const& header) -> std::size_t { return header.datasize; },
+                  [] (slsfs::pack::packet_header const&, std::size_t const size) {
+                      return std::make_shared<std::vector<slsfs::pack::unit_t>>(size);
+                  },
+                  [this] (slsfs::pack::packet_header const& header, std::shared_ptr<std::vector<slsfs::pack::unit_t>> body) {
+                      on_command(header, std::move(body));
+                  },
+                  [] (boost::system::error_code ec) {
+                      slsfs::log::log<slsfs::log::level::error>("error listen command {}", ec.message());
+                  }},
           queue_map_{qm}, proxy_set_{ps},
           server_port_{server_port},
           tcp_server_{std::make_shared<tcp_server>(io_context_, *this, server_port)},
@@ -181,123 +193,94 @@ public:
         return it->endpoint().address().to_v4().to_bytes();
     }
 
-    void start_listen_commands()
-    {
-        //slsfs::log::log("start_listen_commands called");
-        auto readbuf = std::make_shared<std::array<slsfs::pack::unit_t, slsfs::pack::packet_header::bytesize>>();
-
-
-        boost::asio::async_read(
-            socket_, boost::asio::buffer(readbuf->data(), readbuf->size()),
-            [self=this->shared_from_this(), readbuf] (boost::system::error_code ec, std::size_t /*length*/) {
-                if (ec)
-                {
-                    slsfs::log::log<slsfs::log::level::error>("error listen command {}", ec.message());
-                    return;
-                }
-
-                slsfs::pack::packet_pointer pack = std::make_shared<slsfs::pack::packet>();
-                pack->header.parse(readbuf->data());
-
-                if (pack->header.type != slsfs::pack::msg_t::set_timer)
-                    self->recv_deadline_.cancel();
-
-                self->start_listen_commands_body(pack);
-            });
+    void start_listen_commands() {
+        reader_.start_read(this->shared_from_this());
     }
 
-    void start_listen_commands_body(slsfs::pack::packet_pointer pack)
+    void on_command(slsfs::pack::packet_header const& header, std::shared_ptr<std::vector<slsfs::pack::unit_t>> body)
     {
-        auto read_buf = std::make_shared<std::vector<slsfs::pack::unit_t>>(pack->header.datasize);
-        boost::asio::async_read(
-            socket_,
-            boost::asio::buffer(read_buf->data(), read_buf->size()),
-            [self=this->shared_from_this(), read_buf, pack] (boost::system::error_code ec, std::size_t length) {
-                if (ec)
-                {
-                    slsfs::log::log<slsfs::log::level::error>("start_listen_commands_body: "); // + ec.messag$
-                    return;
-                }
+        slsfs::pack::packet_pointer pack = std::make_shared<slsfs::pack::packet>();
+        pack->header = header;
+        pack->data.buf = std::move(*body);
 
-                pack->data.parse(length, read_buf->data());
+        if (pack->header.type != slsfs::pack::msg_t::set_timer)
+            recv_deadline_.cancel();
 
-                switch (pack->header.type)
-                {
-                case slsfs::pack::msg_t::proxyjoin:
-                {
-                    slsfs::log::log("switch proxy master");
-                    std::uint32_t addr;
-                    std::memcpy(&addr, pack->data.buf.data(), sizeof(addr));
-                    addr = slsfs::pack::ntoh(addr);
-                    boost::asio::ip::address_v4 new_host{addr};
-                    boost::asio::ip::port_type  new_port;
-                    std::memcpy(&new_port, pack->data.buf.data() + 4, sizeof(new_port));
-                    new_port = slsfs::pack::ntoh(new_port);
-
-                    boost::asio::ip::tcp::endpoint ep{new_host, new_port};
-
-                    if (proxy_set::accessor acc;
-                        !self->proxy_set_.find(acc, ep))
-                    {
-                        slsfs::log::log("try connect to {}", boost::lexical_cast<std::string>(ep));
+        switch (pack->header.type)
+        {
+        case slsfs::pack::msg_t::proxyjoin:
+        {
+            slsfs::log::log("switch proxy master");
+            std::uint32_t addr;
+            std::memcpy(&addr, pack->data.buf.data(), sizeof(addr));
+            addr = slsfs::pack::ntoh(addr);
+            boost::asio::ip::address_v4 new_host{addr};
+            boost::asio::ip::port_type  new_port;
+            std::memcpy(&new_port, pack->data.buf.data() + 4, sizeof(new_port));
+            new_port = slsfs::pack::ntoh(new_port);
+
+            boost::asio::ip::tcp::endpoint ep{new_host, new_port};
+
+            if (proxy_set::accessor acc;
+                !proxy_set_.find(acc, ep))
+            {
+                slsfs::log::log("try connect to {}", boost::lexical_cast<std::string>(ep));
 
-                        auto proxy_command_ptr = std::make_shared<slsfsdf::server::proxy_command>(
-                            self->io_context_,
-                            self->datastorage_conf_,
-                            self->queue_map_,
-                            self->proxy_set_,
-                            self->server_port_ + 1,
-                            self->enable_cache_,
-                            self->cache_size_,
-                            self->cache_policy_);
+                auto proxy_command_ptr = std::make_shared<slsfsdf::server::proxy_command>(
+                    io_context_,
+                    datastorage_conf_,
+                    queue_map_,
+                    proxy_set_,
+                    server_port_ + 1,
+                    enable_cache_,
+                    cache_size_,
+                    cache_policy_);
 
-                        proxy_command_ptr->start_connect(ep);
+                proxy_command_ptr->start_connect(ep);
 
-                        self->proxy_set_.emplace(ep, proxy_command_ptr);
-                    }
-                    break;
-                }
+                proxy_set_.emplace(ep, proxy_command_ptr);
+            }
+            break;
+        }
 
-                case slsfs::pack::msg_t::set_timer:
-                {
-                    slsfs::pack::waittime_type duration_in_ms = 0;
-                    std::memcpy(&duration_in_ms, read_buf->data(), sizeof(slsfs::pack::waittime_type));
-                    self->waittime_ = slsfs::pack::ntoh(duration_in_ms) * 1ms;
-                    //slsfs::log::log("set timer wait time to {}ms", slsfs::pack::ntoh(duration_in_ms));
-                    break;
-                }
-                case slsfs::pack::msg_t::cache_transfer:
-                {
-                    slsfs::log::log("received cache_transfer");
-                    if (self->cache_engine_.eviction_policy_ == "LRU" ||
-                        self->cache_engine_.eviction_policy_ == "FIFO")
-                    {
-                        slsfs::log::log("executing cache_transfer");
-                        self->cache_engine_.build_cache(pack->data.buf, self->datastorage_conf_);
-                    }
-                    // for (auto chr : pack->data.buf)
-                    //     slsfs::log::log("received table : '{}'", (int)chr);
-                    // deserialize cache and reconstruct it
-                    break;
-                }
+        case slsfs::pack::msg_t::set_timer:
+        {
+            slsfs::pack::waittime_type duration_in_ms = 0;
+            std::memcpy(&duration_in_ms, pack->data.buf.data(), sizeof(slsfs::pack::waittime_type));
+            waittime_ = slsfs::pack::ntoh(duration_in_ms) * 1ms;
+            //slsfs::log::log("set timer wait time to {}ms", slsfs::pack::ntoh(duration_in_ms));
+            break;
+        }
+        case slsfs::pack::msg_t::cache_transfer:
+        {
+            slsfs::log::log("received cache_transfer");
+            if (cache_engine_.eviction_policy_ == "LRU" ||
+                cache_engine_.eviction_policy_ == "FIFO")
+            {
+                slsfs::log::log("executing cache_transfer");
+                cache_engine_.build_cache(pack->data.buf, datastorage_conf_);
+            }
+            // for (auto chr : pack->data.buf)
+            //     slsfs::log::log("received table : '{}'", (int)chr);
+            // deserialize cache and reconstruct it
+            break;
+        }
 
-                default:
-                    self->start_job(pack);
-                }
+        default:
+            start_job(pack);
+        }
 
-                slsfs::pack::packet_pointer ok = std::make_shared<slsfs::pack::packet>();
-                ok->header = pack->header;
-                ok->header.type = slsfs::pack::msg_t::ack;
+        slsfs::pack::packet_pointer ok = std::make_shared<slsfs::pack::packet>();
+        ok->header = pack->header;
+        ok->header.type = slsfs::pack::msg_t::ack;
 
-                slsfs::log::log<slsfs::log::level::debug>(fmt::format("ACK ok for: {}", pack->header.print()));
+        slsfs::log::log<slsfs::log::level::debug>(fmt::format("ACK ok for: {}", pack->header.print()));
 
-                self->start_write(ok);
-                if (pack->header.type != slsfs::pack::msg_t::set_timer)
-                    self->last_update_ = now();
+        start_write(ok);
+        if (pack->header.type != slsfs::pack::msg_t::set_timer)
+            last_update_ = now();
 
-                self->timer_reset();
-                self->start_listen_commands();
-            });
+        timer_reset();
     }
 
     void start_write(slsfs::pack::packet_pointer pack) {
@@ -455,6 +438,12 @@ public:
             return datastorage_conf_->perform(single_input);
             break;
 
+        case slsfs::jsre::type_t::fileop:
+            if (single_input.file_operation() != slsfs::jsre::file_operation_t::stat)
+                cache_engine_.drop_file(single_input.uuid());
+            return datastorage_conf_->perform_file(single_input);
+            break;
+
         case slsfs::jsre::type_t::wakeup:
         case slsfs::jsre::type_t::storagetest:
             break;
@@ -507,6 +496,13 @@ public:
             datastorage_conf_->start_perform_metadata(single_input, std::move(next));
             break;
 
+        case slsfs::jsre::type_t::fileop:
+            // truncate / delete make cached blocks stale
+            if (single_input.file_operation() != slsfs::jsre::file_operation_t::stat)
+                cache_engine_.drop_file(single_input.uuid());
+            datastorage_conf_->start_perform_file(single_input, std::move(next));
+            break;
+
         case slsfs::jsre::type_t::wakeup:
             break;
 
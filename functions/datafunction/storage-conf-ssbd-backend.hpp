@@ -3,14 +3,24 @@
 #define STORAGE_CONF_SSBD_BACKEND_HPP__
 
 #include "storage-conf.hpp"
+#include "erasure-code.hpp"
+#include "placement.hpp"
 
 #include <slsfs.hpp>
 
-#include <oneapi/tbb/concurrent_vector.h>
+#include <oneapi/tbb/concurrent_hash_map.h>
 #include <boost/coroutine2/all.hpp>
 #include <boost/asio.hpp>
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <limits>
 #include <vector>
+#include <map>
+#include <mutex>
+#include <optional>
 #include <semaphore>
 
 namespace slsfsdf
@@ -43,6 +53,49 @@ public:
     }
 };
 
+// how long a read waits before it is hedged to another replica: a percentile
+// of the recent read latencies, recomputed every recompute_every samples
+class hedge_delay
+{
+    static constexpr std::size_t window = 1024, recompute_every = 64;
+
+    std::mutex mutex_;
+    std::array<std::int64_t, window> samples_ {};
+    std::size_t count_ = 0;
+    double percentile_ = 95;
+    std::atomic<std::int64_t> delay_ns_ = 0;
+
+public:
+    // 0 turns hedging off
+    void set_percentile (double const percentile) { percentile_ = std::clamp(percentile, 0.0, 100.0); }
+
+    void record (std::chrono::nanoseconds const latency)
+    {
+        if (percentile_ == 0)
+            return;
+
+        std::scoped_lock lock {mutex_};
+        samples_[count_++ % window] = latency.count();
+        if (count_ % recompute_every != 0)
+            return;
+
+        std::size_t const n = std::min(count_, window);
+        std::vector<std::int64_t> sorted(samples_.begin(), samples_.begin() + n);
+        auto const nth = sorted.begin() + std::min<std::size_t>(n - 1, percentile_ / 100 * n);
+        std::nth_element(sorted.begin(), nth, sorted.end());
+        delay_ns_ = *nth;
+    }
+
+    // nullopt while off or before the first recompute_every samples
+    auto delay () const -> std::optional<std::chrono::nanoseconds>
+    {
+        std::int64_t const ns = delay_ns_;
+        if (percentile_ == 0 or ns == 0)
+            return std::nullopt;
+        return std::chrono::nanoseconds{ns};
+    }
+};
+
 } // namespace
 
 // Storage backend configuration for SSBD stripe
@@ -51,11 +104,23 @@ class storage_conf_ssbd_backend : public storage_conf
     boost::asio::io_context& io_context_;
     int replication_size_ = 3, replication_start_index_ = 0;
 
-    // first half is normal operation; second half is backup operation
+    // replicas past the first are written by the ssbd chain, not from here
     std::vector<std::shared_ptr<slsfs::backend::ssbd>> backend_list_;
 
+    // set by "erasure_coding": {"k": 4, "m": 2}; replaces replication
+    std::optional<ec::reed_solomon> erasure_code_;
+
     detail::recoder recoder_;
 
+    // set by "read_replicas": true; reads also go to the copies of the replica chain.
+    // every ssbd must then run with --replica-next set to the next entry of "hosts"
+    // (the last one to the first), so the copies of a block on host p sit on
+    // hosts p+1 .. p+replication_size-1
+    bool read_replicas_ = false;
+
+    // "hedge_percentile": 95 by default, 0 turns hedged reads off
+    detail::hedge_delay hedge_;
+
     void connect() override
     {
         for (std::shared_ptr<slsfs::backend::ssbd> host : backend_list_)
@@ -68,24 +133,166 @@ class storage_conf_ssbd_backend : public storage_conf
             host->close();
     }
 
-    static
-    auto static_engine() -> std::mt19937&
+    // replica replication_index of block partition; see placement.hpp
+    int select_replica(slsfs::pack::key_t const& uuid,
+                       std::uint32_t const partition,
+                       int const replication_index)
     {
-        static thread_local std::mt19937 mt;
-        return mt;
+        return placement::host(uuid, partition, replication_index, replication_start_index_);
     }
 
-    int select_replica(slsfs::pack::key_t const& uuid,
-                       int const partition,
-                       int const replication_index)
+    // erasure coding: stripe s holds data blocks [s*k, s*k + k) plus m parity blocks.
+    // parity blocks share the file key with the high bit of the blockid set
+    static constexpr std::uint32_t parity_blockid_flag = 0x80000000;
+
+    auto stripe_of (std::uint32_t const blockid) -> std::uint32_t { return blockid / erasure_code_->k(); }
+
+    auto fragment_blockid (std::uint32_t const stripe, int const fragment) -> std::uint32_t
+    {
+        if (fragment < erasure_code_->k())
+            return stripe * erasure_code_->k() + fragment;
+        return parity_blockid_flag | (stripe * erasure_code_->m() + fragment - erasure_code_->k());
+    }
+
+    // the k+m fragments of a stripe sit on consecutive hosts, starting at the placement of the stripe
+    int select_fragment_host (slsfs::pack::key_t const& uuid, std::uint32_t const stripe, int const fragment)
+    {
+        return (select_replica(uuid, stripe, 0) + fragment) % backend_list_.size();
+    }
+
+    int select_block_host (slsfs::pack::key_t const& uuid, std::uint32_t const blockid)
+    {
+        if (erasure_code_)
+            return select_fragment_host(uuid, stripe_of(blockid), blockid % erasure_code_->k());
+        return select_replica(uuid, blockid, 0);
+    }
+
+    struct read_source
+    {
+        int  host;
+        bool replica; // read the replica space of host
+    };
+
+    // the hosts holding the blocks of primary, least loaded first.
+    // load is the expected wait: (outstanding requests + 1) * latency average.
+    // a backend without a sample yet scores 0 and gets tried
+    auto read_sources (int const primary) -> std::vector<read_source>
+    {
+        std::vector<std::pair<std::int64_t, read_source>> scored;
+        int const hosts = backend_list_.size();
+        int const copies = (read_replicas_ and not erasure_code_) ? std::min(replication_size_, hosts) : 1;
+        for (int r = 0; r < copies; r++)
+        {
+            int const host = (primary + r) % hosts;
+            auto const& backend = backend_list_.at(host);
+            scored.push_back({(backend->outstanding() + 1) * backend->latency_ewma().count(),
+                              read_source {.host = host, .replica = r > 0}});
+        }
+
+        // ties keep the primary first
+        std::stable_sort(scored.begin(), scored.end(),
+                         [] (auto const& a, auto const& b) { return a.first < b.first; });
+
+        std::vector<read_source> sources;
+        for (auto const& [score, source] : scored)
+            sources.push_back(source);
+        return sources;
+    }
+
+    struct hedged_read
+    {
+        slsfs::leveldb_pack::packet_pointer request; // for the primary
+        std::vector<read_source> sources;
+        std::function<void(slsfs::leveldb_pack::packet_pointer)> on_answer;
+        boost::asio::steady_timer hedge_timer;
+        std::atomic<bool> answered = false;
+
+        std::mutex mutex;
+        std::size_t sent = 0;
+        int pending = 0;
+
+        hedged_read(boost::asio::io_context& io): hedge_timer{io} {}
+    };
+
+    // sends request to the first source and, when no answer comes within the hedge
+    // delay, a copy to the next one. the first ack wins and later answers are dropped;
+    // an error fails over to the next source at once. on_answer runs exactly once
+    void start_hedged_read (slsfs::leveldb_pack::packet_pointer request,
+                            std::vector<read_source> sources,
+                            std::function<void(slsfs::leveldb_pack::packet_pointer)> on_answer)
     {
-        std::seed_seq seeds {uuid.begin(), uuid.end()};
-        static_engine().seed(seeds);
+        auto state = std::make_shared<hedged_read>(io_context_);
+        state->request   = request;
+        state->sources   = std::move(sources);
+        state->on_answer = std::move(on_answer);
+
+        std::optional<std::chrono::nanoseconds> const delay = hedge_.delay();
+        if (delay and state->sources.size() > 1)
+        {
+            // never cancelled, as answers arrive on other threads; the handler checks answered
+            state->hedge_timer.expires_after(*delay);
+            state->hedge_timer.async_wait(
+                [state, this] (boost::system::error_code const& ec) {
+                    if (not ec and not state->answered)
+                        send_read_attempt(state);
+                });
+        }
+
+        send_read_attempt(state);
+    }
+
+    // false once every source was tried
+    bool send_read_attempt (std::shared_ptr<hedged_read> state)
+    {
+        read_source source;
+        {
+            std::scoped_lock lock {state->mutex};
+            if (state->sent == state->sources.size())
+                return false;
+            source = state->sources.at(state->sent++);
+            state->pending++;
+        }
 
-        std::uniform_int_distribution<> dist(0, replication_start_index_ - 1);
-        static_engine().discard(partition * (partition * replication_index));
+        slsfs::leveldb_pack::packet_pointer request = state->request;
+        if (source.replica)
+        {
+            request = std::make_shared<slsfs::leveldb_pack::packet>(*state->request);
+            request->header.type =
+                (request->header.type == slsfs::leveldb_pack::msg_t::get) ?
+                slsfs::leveldb_pack::msg_t::get_replica:
+                slsfs::leveldb_pack::msg_t::get_range_replica;
+        }
+
+        auto const sent_at = std::chrono::steady_clock::now();
+        backend_list_.at(source.host)->start_send_request(
+            request,
+            [state, sent_at, this] (slsfs::leveldb_pack::packet_pointer resp) {
+                if (resp->header.type == slsfs::leveldb_pack::msg_t::ack)
+                {
+                    hedge_.record(std::chrono::steady_clock::now() - sent_at);
+                    if (not state->answered.exchange(true))
+                        std::invoke(state->on_answer, resp);
+                    return;
+                }
+
+                {
+                    std::scoped_lock lock {state->mutex};
+                    state->pending--;
+                }
+
+                if (state->answered or send_read_attempt(state))
+                    return;
 
-        return dist(static_engine());
+                // every source failed: hand on the last error
+                bool last = false;
+                {
+                    std::scoped_lock lock {state->mutex};
+                    last = (state->pending == 0);
+                }
+                if (last and not state->answered.exchange(true))
+                    std::invoke(state->on_answer, resp);
+            });
+        return true;
     }
 
     static
@@ -96,6 +303,84 @@ class storage_conf_ssbd_backend : public storage_conf
         return static_cast<std::uint32_t>(v >> 6);
     }
 
+    using batch_requests = std::map<int, slsfs::leveldb_pack::packet_pointer>;
+
+    // appends one block to the *_batch request for backend_index. data is nullptr for commits
+    void add_batch_entry (batch_requests& requests, int const backend_index,
+                          slsfs::pack::key_t const& uuid,
+                          slsfs::leveldb_pack::msg_t const type,
+                          std::uint32_t const selected_version,
+                          std::uint32_t const blockid, std::uint32_t const position,
+                          slsfs::base::byte const* data, std::uint32_t const size)
+    {
+        slsfs::leveldb_pack::packet_pointer& request = requests[backend_index];
+        if (request == nullptr)
+            request = slsfs::leveldb_pack::create_request(uuid, type, selected_version, blockid, 0, 0);
+
+        slsfs::leveldb_pack::batch_entry entry {
+            .blockid  = blockid,
+            .position = static_cast<std::uint16_t>(position),
+            .size     = data? size + headersize() : 0,
+        };
+
+        slsfs::leveldb_pack::buffer_t& body = request->data.buf;
+        std::size_t const start = body.size();
+        body.resize(start + slsfs::leveldb_pack::batch_entry::bytesize + entry.size);
+        slsfs::leveldb_pack::unit_t* pos = entry.dump(body.data() + start);
+        if (data)
+            std::memcpy(pos + headersize(), data, size);
+    }
+
+    // splits the write into blocks and packs the blocks of each ssbd into one *_batch request
+    auto make_batch_requests (slsfs::jsre::request_parser<slsfs::base::byte> const& input,
+                              slsfs::leveldb_pack::msg_t const type,
+                              std::uint32_t const selected_version,
+                              bool const with_data) -> batch_requests
+    {
+        std::uint32_t const realpos = input.position();
+        std::uint32_t const endpos  = realpos + input.size();
+
+        batch_requests requests;
+        for (std::uint32_t currentpos = realpos, buffer_pointer_offset = 0; currentpos < endpos;)
+        {
+            std::uint32_t const blockid = currentpos / blocksize();
+            std::uint32_t const offset  = currentpos % blocksize();
+            std::uint32_t const blockwritesize = std::min<std::uint32_t>(endpos - currentpos,
+                                                                         blocksize() - offset);
+            int const backend_index = select_block_host(input.uuid(), blockid);
+
+            add_batch_entry(requests, backend_index, input.uuid(), type, selected_version,
+                            blockid, offset,
+                            with_data? input.data() + buffer_pointer_offset : nullptr,
+                            blockwritesize);
+
+            currentpos += blockwritesize;
+            buffer_pointer_offset += blockwritesize;
+        }
+        return requests;
+    }
+
+    // the commit for a set of prepares: same blocks on the same ssbds, without data
+    auto make_commit_requests (batch_requests const& prepares,
+                               slsfs::leveldb_pack::msg_t const type) -> batch_requests
+    {
+        batch_requests requests;
+        for (auto& [backend_index, prepare] : prepares)
+        {
+            slsfs::leveldb_pack::buffer_t const& body = prepare->data.buf;
+            for (std::size_t pos = 0; pos + slsfs::leveldb_pack::batch_entry::bytesize <= body.size();)
+            {
+                slsfs::leveldb_pack::batch_entry entry;
+                entry.parse(body.data() + pos);
+                pos += slsfs::leveldb_pack::batch_entry::bytesize + entry.size;
+
+                add_batch_entry(requests, backend_index, prepare->header.uuid, type, prepare->header.version,
+                                entry.blockid, entry.position, nullptr, 0);
+            }
+        }
+        return requests;
+    }
+
     // 2pc stuff
     void start_2pc_prepare (slsfs::jsre::request_parser<slsfs::base::byte> input,
                             slsfs::backend::ssbd::handler_ptr next)
@@ -121,49 +406,47 @@ class storage_conf_ssbd_backend : public storage_conf
                 }
         });
 
-        std::uint32_t const realpos = input.position();
-        std::uint32_t const endpos  = realpos + input.size();
         std::uint32_t const selected_version = version();
 
         slsfs::log::log("start_2pc_prepare: {}", input.print());
 
-        auto outstanding_requests = std::make_shared<std::atomic<int>>(0);
-        auto all_ssbd_agree       = std::make_shared<std::atomic<bool>>(true);
-        for (std::uint32_t currentpos = realpos, buffer_pointer_offset = 0; currentpos < endpos;)
+        if (erasure_code_)
         {
-            std::uint32_t const blockid = currentpos / blocksize();
-            std::uint32_t const offset  = currentpos % blocksize();
-            std::uint32_t const blockwritesize = std::min<std::uint32_t>(endpos - currentpos,
-                                                                         blocksize() - offset);
-            slsfs::log::log("start_2pc_prepare sending: bid={}, @{}, size={}",
-                            blockid, offset, blockwritesize);
-
-            int const backend_index = select_replica(input.uuid(), blockid, 0);
-            auto selected = backend_list_.at(backend_index);
+            start_ec_write(input, selected_version, request_dearline_timer, next);
+            return;
+        }
 
-            slsfs::leveldb_pack::packet_pointer request = slsfs::leveldb_pack::create_request(
-                input.uuid(),
+        start_2pc_prepare_batches(
+            input,
+            make_batch_requests(
+                input,
                 recoder_.is_checked(input.uuid())?
-                    slsfs::leveldb_pack::msg_t::two_pc_prepare_quick:
-                    slsfs::leveldb_pack::msg_t::two_pc_prepare,
+                    slsfs::leveldb_pack::msg_t::two_pc_prepare_quick_batch:
+                    slsfs::leveldb_pack::msg_t::two_pc_prepare_batch,
                 selected_version,
-                blockid,
-                offset,
-                blockwritesize);
-
-            request->data.buf.resize(blockwritesize + headersize());
-
-            std::memcpy(request->data.buf.data() + headersize(),
-                        input.data() + buffer_pointer_offset,
-                        blockwritesize);
+                true),
+            selected_version,
+            request_dearline_timer,
+            next);
+    }
 
-            currentpos += blockwritesize;
-            buffer_pointer_offset += blockwritesize;
+    void start_2pc_prepare_batches (slsfs::jsre::request_parser<slsfs::base::byte> input,
+                                    batch_requests prepares,
+                                    std::uint32_t const selected_version,
+                                    std::shared_ptr<boost::asio::steady_timer> request_dearline_timer,
+                                    slsfs::backend::ssbd::handler_ptr next)
+    {
+        auto requests = std::make_shared<batch_requests const>(std::move(prepares));
+        auto outstanding_requests = std::make_shared<std::atomic<int>>(requests->size());
+        auto all_ssbd_agree       = std::make_shared<std::atomic<bool>>(true);
+        for (auto& [backend_index, request] : *requests)
+        {
+            slsfs::log::log("start_2pc_prepare sending {} bytes to ssbd {}", request->data.buf.size(), backend_index);
+            auto selected = backend_list_.at(backend_index);
 
-            (*outstanding_requests)++;
             selected->start_send_request(
                 request,
-                [outstanding_requests, input, all_ssbd_agree, selected_version, request_dearline_timer, next, this]
+                [outstanding_requests, input, requests, all_ssbd_agree, selected_version, request_dearline_timer, next, this]
                 (slsfs::leveldb_pack::packet_pointer response) {
                     switch (response->header.type)
                     {
@@ -199,6 +482,7 @@ class storage_conf_ssbd_backend : public storage_conf
                         }
 
                         start_2pc_commit (input,
+                                          *requests,
                                           *all_ssbd_agree,
                                           selected_version,
                                           nullptr);
@@ -208,43 +492,31 @@ class storage_conf_ssbd_backend : public storage_conf
     }
 
     void start_2pc_commit (slsfs::jsre::request_parser<slsfs::base::byte> input,
+                           batch_requests const& prepares,
                            bool          const all_ssbd_agree,
                            std::uint32_t const selected_version,
                            slsfs::backend::ssbd::handler_ptr next)
     {
-        std::uint32_t const realpos = input.position();
-        std::uint32_t const endpos  = realpos + input.size();
-
-        auto outstanding_requests = std::make_shared<std::atomic<int>>(0);
-        for (std::uint32_t currentpos = realpos, buffer_pointer_offset = 0; currentpos < endpos;)
+        auto requests = make_commit_requests(
+            prepares,
+            all_ssbd_agree?
+                slsfs::leveldb_pack::msg_t::two_pc_commit_execute_batch:
+                slsfs::leveldb_pack::msg_t::two_pc_commit_rollback_batch);
+
+        auto outstanding_requests = std::make_shared<std::atomic<int>>(requests.size());
+        for (auto& [selected_index, request] : requests)
         {
-            std::uint32_t const blockid = currentpos / blocksize();
-            std::uint32_t const offset  = currentpos % blocksize();
-            std::uint32_t const blockwritesize = std::min<std::uint32_t>(endpos - currentpos,
-                                                                         blocksize() - offset);
-            slsfs::log::log("start_2pc_commit: bid={}, @{}, size={}",
-                            blockid, offset, blockwritesize);
+            // the ssbd forwards a committed write down the replica chain this many hops.
+            // erasure coded fragments are not replicated
+            if (all_ssbd_agree and not erasure_code_)
+                request->header.position = static_cast<std::uint16_t>(replication_size_ - 1);
 
-            int const selected_index = select_replica(input.uuid(), blockid, 0);
+            slsfs::log::log("start_2pc_commit: ssbd {}, {}", selected_index, request->header.print());
             auto selected = backend_list_.at(selected_index);
 
-            slsfs::leveldb_pack::packet_pointer request = slsfs::leveldb_pack::create_request(
-                input.uuid(),
-                all_ssbd_agree?
-                    slsfs::leveldb_pack::msg_t::two_pc_commit_execute:
-                    slsfs::leveldb_pack::msg_t::two_pc_commit_rollback,
-                selected_version,
-                blockid,
-                offset,
-                /*blockwritesize*/ 0);
-
-            currentpos += blockwritesize;
-            buffer_pointer_offset += blockwritesize;
-
-            (*outstanding_requests)++;
             selected->start_send_request(
                 request,
-                [outstanding_requests, input, all_ssbd_agree, selected_version, next, this]
+                [outstanding_requests, input, next, this]
                 (slsfs::leveldb_pack::packet_pointer response) {
                     switch (response->header.type)
                     {
@@ -262,92 +534,281 @@ class storage_conf_ssbd_backend : public storage_conf
                         }
                     }
 
-                    if (--(*outstanding_requests) == 0)
+                    if (--(*outstanding_requests) == 0 and next)
+                        std::invoke(*next, slsfs::base::to_buf("OK"));
+                });
+        }
+    }
+
+    using stripe_t = std::vector<std::vector<std::uint8_t>>; // k data blocks
+    using stripe_handler = std::function<void(std::optional<stripe_t>)>;
+
+    struct fragment_read
+    {
+        std::mutex mutex;
+        std::vector<std::optional<std::vector<std::uint8_t>>> fragments;
+        int pending = 0;
+        bool parity_requested = false;
+        stripe_handler next;
+    };
+
+    void start_read_fragment (slsfs::pack::key_t const& uuid, std::uint32_t const stripe, int const fragment,
+                              std::shared_ptr<fragment_read> state)
+    {
+        std::uint32_t const blockid = fragment_blockid(stripe, fragment);
+        slsfs::leveldb_pack::packet_pointer request = slsfs::leveldb_pack::create_request(
+            uuid, slsfs::leveldb_pack::msg_t::get_range, 0, blockid, 0, 0);
+
+        slsfs::leveldb_pack::range_request range {
+            .length    = blocksize(),
+            .blocksize = blocksize(),
+        };
+        request->data.buf.resize(slsfs::leveldb_pack::range_request::bytesize);
+        range.dump(request->data.buf.data());
+
+        auto selected = backend_list_.at(select_fragment_host(uuid, stripe, fragment));
+        selected->start_send_request(
+            request,
+            [uuid, stripe, fragment, blockid, state, this] (slsfs::leveldb_pack::packet_pointer resp) {
+                std::optional<std::vector<std::uint8_t>> data;
+                if (resp->header.type == slsfs::leveldb_pack::msg_t::ack)
+                {
+                    // a block never written reads as zeros
+                    data.emplace(blocksize(), 0);
+                    slsfs::leveldb_pack::buffer_t const& body = resp->data.buf;
+                    if (body.size() >= slsfs::leveldb_pack::range_frame::bytesize)
                     {
-                        if (next)
-                            std::invoke(*next, slsfs::base::to_buf("OK"));
+                        slsfs::leveldb_pack::range_frame frame;
+                        frame.parse(body.data());
+                        std::size_t const size = std::min<std::size_t>(
+                            {frame.size, data->size(), body.size() - slsfs::leveldb_pack::range_frame::bytesize});
+                        if (frame.blockid == blockid)
+                            std::memcpy(data->data(), body.data() + slsfs::leveldb_pack::range_frame::bytesize, size);
+                    }
+                }
+                else
+                    slsfs::log::log("start_read_fragment: fragment {} of stripe {} lost: {}",
+                                    fragment, stripe, resp->header.print());
 
-                        if (all_ssbd_agree && replication_size_ > 1)
-                            start_replication (input,
-                                               selected_version,
-                                               nullptr);
+                bool request_parity = false, done = false;
+                {
+                    std::scoped_lock lock {state->mutex};
+                    state->fragments[fragment] = std::move(data);
+                    if (--state->pending > 0)
+                        return;
+
+                    bool const data_lost = std::any_of(
+                        state->fragments.begin(), state->fragments.begin() + erasure_code_->k(),
+                        [] (std::optional<std::vector<std::uint8_t>> const& f) { return not f.has_value(); });
+
+                    if (data_lost and not state->parity_requested and erasure_code_->m() > 0)
+                    {
+                        state->parity_requested = true;
+                        state->pending = erasure_code_->m();
+                        request_parity = true;
                     }
-                });
-        }
+                    else
+                        done = true;
+                }
+
+                if (request_parity)
+                    for (int j = 0; j < erasure_code_->m(); j++)
+                        start_read_fragment(uuid, stripe, erasure_code_->k() + j, state);
+                else if (done)
+                    std::invoke(state->next, erasure_code_->decode(state->fragments));
+            });
     }
 
-    void start_replication (slsfs::jsre::request_parser<slsfs::base::byte> input,
-                            std::uint32_t const selected_version,
-                            slsfs::backend::ssbd::handler_ptr next)
+    // reads the k data blocks of a stripe. parity is fetched only when a data
+    // fragment is lost; next gets nullopt when more than m fragments are gone
+    void start_read_stripe (slsfs::pack::key_t const& uuid, std::uint32_t const stripe, stripe_handler next)
+    {
+        auto state = std::make_shared<fragment_read>();
+        state->fragments.resize(erasure_code_->k() + erasure_code_->m());
+        state->pending = erasure_code_->k();
+        state->next = std::move(next);
+
+        for (int i = 0; i < erasure_code_->k(); i++)
+            start_read_fragment(uuid, stripe, i, state);
+    }
+
+    // reads the untouched part of partially covered stripes to encode the parity, then
+    // runs one 2pc over the written ranges of the data blocks and all m parity blocks.
+    // data blocks keep their real length, as without erasure coding, so reads and stat
+    // see the same file size; parity is encoded over zero-padded copies of them
+    void start_ec_write (slsfs::jsre::request_parser<slsfs::base::byte> input,
+                         std::uint32_t const selected_version,
+                         std::shared_ptr<boost::asio::steady_timer> request_dearline_timer,
+                         slsfs::backend::ssbd::handler_ptr next)
     {
-        slsfs::log::log("start_replication with {}", input.print());
         std::uint32_t const realpos = input.position();
         std::uint32_t const endpos  = realpos + input.size();
-
-        auto outstanding_requests = std::make_shared<std::atomic<int>>(0);
-        for (std::uint32_t currentpos = realpos, buffer_pointer_offset = 0; currentpos < endpos;)
+        if (realpos == endpos)
         {
-            std::uint32_t const blockid = currentpos / blocksize();
-            std::uint32_t const offset  = currentpos % blocksize();
-            std::uint32_t const blockwritesize = std::min<std::uint32_t>(endpos - currentpos,
-                                                                         blocksize() - offset);
-            slsfs::log::log("start_replication: bid={}, @{}, size={}",
-                            blockid, offset, blockwritesize);
+            request_dearline_timer->cancel();
+            std::invoke(*next, slsfs::base::to_buf("OK"));
+            return;
+        }
 
-            currentpos += blockwritesize;
-            buffer_pointer_offset += blockwritesize;
-            // we already have one copy at replica_index 0 from the 2pc part, so start at replica 1
-            for (int replica_index = 1; replica_index < replication_size_; replica_index++)
+        std::uint32_t const stripesize   = blocksize() * erasure_code_->k();
+        std::uint32_t const first_stripe = realpos / stripesize;
+        std::uint32_t const last_stripe  = (endpos - 1) / stripesize;
+
+        auto stripes     = std::make_shared<std::vector<stripe_t>>(last_stripe - first_stripe + 1);
+        auto outstanding = std::make_shared<std::atomic<int>>(stripes->size());
+        auto read_failed = std::make_shared<std::atomic<bool>>(false);
+
+        auto on_stripe_ready = [input, selected_version, request_dearline_timer, next,
+                                stripes, outstanding, read_failed, first_stripe, realpos, endpos, this] {
+            if (--(*outstanding) != 0)
+                return;
+
+            if (*read_failed)
             {
-                int const selected_index =
-                    replication_start_index_ + select_replica(input.uuid(), blockid, replica_index);
-                auto selected = backend_list_.at(selected_index);
-
-                slsfs::leveldb_pack::packet_pointer request = slsfs::leveldb_pack::create_request(
-                    input.uuid(),
-                    slsfs::leveldb_pack::msg_t::replication,
-                    selected_version,
-                    blockid,
-                    offset,
-                    blockwritesize);
-
-                (*outstanding_requests)++;
-                selected->start_send_request(
-                    request,
-                    [outstanding_requests, replica_index, input, next, this]
-                    (slsfs::leveldb_pack::packet_pointer response) {
-                        switch (response->header.type)
-                        {
-                        case slsfs::leveldb_pack::msg_t::ack:
-                            break;
-
-                        default:
-                            slsfs::log::log("start_replication unwanted header type {}",
-                                            response->header.print());
-                            if (next)
-                            {
-                                recoder_.erase_checked(input.uuid());
-                                std::invoke(*next, slsfs::base::to_buf("Error: Replication Failed"));
-                            }
-                            return;
-                        }
+                request_dearline_timer->cancel();
+                std::invoke(*next, slsfs::base::to_buf("Error: Stripe Read Failed"));
+                return;
+            }
 
-                        if (--(*outstanding_requests) == 0 and next)
-                        {
-                            slsfs::log::log("replication finished {}", response->header.print());
-                            std::invoke(*next, slsfs::base::to_buf("OK"));
-                        }
-                    });
+            // overlay the write on the stripes; only the written range of a data block goes out
+            batch_requests requests;
+            for (std::uint32_t currentpos = realpos; currentpos < endpos;)
+            {
+                std::uint32_t const blockid = currentpos / blocksize();
+                std::uint32_t const offset  = currentpos % blocksize();
+                std::uint32_t const blockwritesize = std::min<std::uint32_t>(endpos - currentpos,
+                                                                             blocksize() - offset);
+                int const fragment = blockid % erasure_code_->k();
+                std::vector<std::uint8_t>& block = stripes->at(stripe_of(blockid) - first_stripe).at(fragment);
+                std::memcpy(block.data() + offset, input.data() + (currentpos - realpos), blockwritesize);
+
+                add_batch_entry(requests, select_fragment_host(input.uuid(), stripe_of(blockid), fragment), input.uuid(),
+                                slsfs::leveldb_pack::msg_t::two_pc_prepare_batch, selected_version,
+                                blockid, offset, block.data() + offset, blockwritesize);
+                currentpos += blockwritesize;
             }
+
+            for (std::uint32_t i = 0; i < stripes->size(); i++)
+            {
+                std::uint32_t const stripe = first_stripe + i;
+                stripe_t const parity = erasure_code_->encode(stripes->at(i));
+
+                for (int j = 0; j < erasure_code_->m(); j++)
+                {
+                    int const f = erasure_code_->k() + j;
+                    add_batch_entry(requests, select_fragment_host(input.uuid(), stripe, f), input.uuid(),
+                                    slsfs::leveldb_pack::msg_t::two_pc_prepare_batch, selected_version,
+                                    fragment_blockid(stripe, f), 0, parity.at(j).data(), parity.at(j).size());
+                }
+            }
+
+            start_2pc_prepare_batches(input, std::move(requests), selected_version, request_dearline_timer, next);
+        };
+
+        for (std::uint32_t stripe = first_stripe; stripe <= last_stripe; stripe++)
+        {
+            // a fully overwritten stripe needs no read
+            if (realpos <= stripe * stripesize and (stripe + 1) * stripesize <= endpos)
+            {
+                stripes->at(stripe - first_stripe).assign(erasure_code_->k(), std::vector<std::uint8_t>(blocksize(), 0));
+                std::invoke(on_stripe_ready);
+                continue;
+            }
+
+            start_read_stripe(
+                input.uuid(), stripe,
+                [stripes, read_failed, on_stripe_ready, stripe, first_stripe] (std::optional<stripe_t> data) {
+                    if (data)
+                        stripes->at(stripe - first_stripe) = std::move(*data);
+                    else
+                        *read_failed = true;
+                    std::invoke(on_stripe_ready);
+                });
         }
     }
 
-    struct buf_stat_t
+    // destination of one read, allocated once. blocks are copied to their offset as
+    // they arrive; the one finishing the last block hands the buffer on
+    class read_result
     {
-        std::atomic<bool> ready = false;
-        slsfs::base::buf  buf;
+        slsfs::base::buf buf_;
+        std::size_t const realpos_, blocksize_; // size_t: blockid * blocksize passes 4 GiB
+        std::atomic<std::size_t> remaining_;      // blocks not finished
+        std::atomic<std::size_t> filled_end_ = 0; // end of the data of the blocks that exist
+        std::atomic<bool> failed_ = false;        // some block could not be read at all
+        std::function<void(slsfs::base::buf)> on_done_;
+
+    public:
+        read_result(std::uint32_t const realpos, std::uint32_t const size, std::uint32_t const blocksize,
+                    std::function<void(slsfs::base::buf)> on_done):
+            buf_(size, 0), realpos_{realpos}, blocksize_{blocksize},
+            remaining_{(realpos_ + size - 1) / blocksize_ - realpos_ / blocksize_ + 1},
+            on_done_{std::move(on_done)} {}
+
+        // size bytes of block blockid, starting where the read enters the block
+        void fill (std::uint32_t const blockid, std::uint8_t const* data, std::size_t const size)
+        {
+            std::size_t const offset = std::max(realpos_, blockid * blocksize_) - realpos_;
+            if (offset >= buf_.size())
+                return;
+
+            std::size_t const n = std::min(size, buf_.size() - offset);
+            std::memcpy(buf_.data() + offset, data, n);
+
+            std::size_t end = filled_end_;
+            while (offset + n > end and not filled_end_.compare_exchange_weak(end, offset + n));
+        }
+
+        // a block that was neither found nor known to be missing; the read errors
+        // out instead of passing its range off as a hole
+        void fail() { failed_ = true; }
+
+        // blocks are done, found or not. holes read as zeros; blocks past the last
+        // one found do not exist and cut the read short
+        void finish (std::uint32_t const blocks)
+        {
+            if (remaining_.fetch_sub(blocks) != blocks)
+                return;
+
+            if (failed_)
+            {
+                std::invoke(on_done_, slsfs::base::to_buf("Error: Read Failed"));
+                return;
+            }
+
+            buf_.resize(filled_end_);
+            std::invoke(on_done_, std::move(buf_));
+        }
     };
 
+    // rebuilds the part of block blockid inside [realpos, endpos) from the rest of its stripe
+    void start_degraded_read (slsfs::pack::key_t const& uuid, std::uint32_t const blockid,
+                              std::uint32_t const realpos, std::uint32_t const endpos,
+                              std::shared_ptr<read_result> result)
+    {
+        std::size_t const blockstart = std::size_t{blockid} * blocksize();
+        std::size_t const from = std::max<std::size_t>(realpos, blockstart) - blockstart;
+        std::size_t const to   = std::min<std::size_t>(endpos, blockstart + blocksize()) - blockstart;
+
+        slsfs::log::log("start_degraded_read: bid={}, [{}, {})", blockid, from, to);
+        start_read_stripe(
+            uuid, stripe_of(blockid),
+            [result, blockid, from, to, this] (std::optional<stripe_t> data) {
+                if (data)
+                {
+                    std::vector<std::uint8_t> const& block = data->at(blockid % erasure_code_->k());
+                    result->fill(blockid, block.data() + from, to - from);
+                }
+                else
+                {
+                    slsfs::log::log<slsfs::log::level::error>("start_degraded_read: bid={} lost", blockid);
+                    result->fail();
+                }
+
+                result->finish(1);
+            });
+    }
+
     void start_read (slsfs::jsre::request_parser<slsfs::base::byte> const input,
                      slsfs::backend::ssbd::handler_ptr next)
     {
@@ -383,58 +844,91 @@ class storage_conf_ssbd_backend : public storage_conf
             return;
         }
 
-        int result_vector_size = 0;
-        for (std::uint32_t currentpos = realpos; currentpos < endpos; result_vector_size++)
-        {
-            std::uint32_t const offset = currentpos % blocksize();
-            std::uint32_t const blockreadsize = std::min<std::uint32_t>(endpos - currentpos,
-                                                                        blocksize() - offset);
-            currentpos += blockreadsize;
-        }
-
-        auto result_accumulator = std::make_shared<oneapi::tbb::concurrent_vector<buf_stat_t>>(result_vector_size);
+        std::uint32_t const first_blockid = realpos / blocksize();
+        auto result = std::make_shared<read_result>(
+            realpos, readsize, blocksize(),
+            [next, timer] (slsfs::base::buf buf) {
+                timer->cancel();
+                std::invoke(*next, std::move(buf));
+            });
 
-        for (std::uint32_t currentpos = realpos, index = 0; currentpos < endpos; index++)
+        // consecutive blocks on the same host are fetched by one get_range request
+        for (std::uint32_t currentpos = realpos, index = 0; currentpos < endpos;)
         {
             std::uint32_t const blockid = currentpos / blocksize();
             std::uint32_t const offset  = currentpos % blocksize();
-            std::uint32_t const blockreadsize = std::min<std::uint32_t>(endpos - currentpos,
-                                                                        blocksize() - offset);
-            slsfs::log::log("start_read: {}, {}, {}",
-                            blockid, offset, blockreadsize);
+            int const selected_index = select_block_host(input.uuid(), blockid);
+
+            std::uint32_t const run_start_index = index;
+            std::uint32_t runsize = 0;
+            do
+            {
+                std::uint32_t const blockreadsize = std::min<std::uint32_t>(endpos - currentpos,
+                                                                            blocksize() - currentpos % blocksize());
+                runsize    += blockreadsize;
+                currentpos += blockreadsize;
+                index++;
+            } while (currentpos < endpos and
+                     select_block_host(input.uuid(), currentpos / blocksize()) == selected_index);
+
+            std::uint32_t const run_end_index = index;
+            slsfs::log::log("start_read: range bid={}, @{}, size={}, blocks={}",
+                            blockid, offset, runsize, run_end_index - run_start_index);
 
             slsfs::leveldb_pack::packet_pointer request = slsfs::leveldb_pack::create_request(
                 input.uuid(),
-                slsfs::leveldb_pack::msg_t::get,
+                slsfs::leveldb_pack::msg_t::get_range,
                 0 /* version number. not use for read request */,
                 blockid,
                 offset,
-                blockreadsize);
+                0);
 
-            int const selected_index = select_replica(input.uuid(), blockid, 0);
-            auto selected = backend_list_.at(selected_index);
-            selected->start_send_request(
+            slsfs::leveldb_pack::range_request range {
+                .length    = runsize,
+                .blocksize = blocksize(),
+            };
+            request->data.buf.resize(slsfs::leveldb_pack::range_request::bytesize);
+            range.dump(request->data.buf.data());
+
+            start_hedged_read(
                 request,
-                [result_accumulator, input, next, index, timer, this]
+                read_sources(selected_index),
+                [result, first_blockid, run_start_index, run_end_index,
+                 input, realpos, endpos, this]
                 (slsfs::leveldb_pack::packet_pointer resp) {
-                    result_accumulator->at(index).ready = true;
-                    result_accumulator->at(index).buf   = std::move(resp->data.buf);
-
-                    for (buf_stat_t& bufstat : *result_accumulator)
-                        if (not bufstat.ready)
-                            return;
-
-                    timer->cancel();
-                    slsfs::base::buf collect;
-                    collect.reserve((result_accumulator->size() + 2 /* head and tail */) * blocksize());
-                    for (buf_stat_t& bufstat : *result_accumulator)
-                        collect.insert(collect.end(),
-                                       bufstat.buf.begin(),
-                                       bufstat.buf.end());
-
-                    std::invoke(*next, std::move(collect));
+                    if (resp->header.type != slsfs::leveldb_pack::msg_t::ack and erasure_code_)
+                    {
+                        for (std::uint32_t i = run_start_index; i < run_end_index; i++)
+                            start_degraded_read(input.uuid(), first_blockid + i, realpos, endpos, result);
+                        return;
+                    }
+
+                    if (resp->header.type != slsfs::leveldb_pack::msg_t::ack)
+                    {
+                        slsfs::log::log<slsfs::log::level::error>("start_read: range bid={} failed", first_blockid + run_start_index);
+                        result->fail();
+                    }
+                    else
+                    {
+                        slsfs::leveldb_pack::buffer_t const& body = resp->data.buf;
+                        for (std::size_t pos = 0; pos + slsfs::leveldb_pack::range_frame::bytesize <= body.size();)
+                        {
+                            slsfs::leveldb_pack::range_frame frame;
+                            frame.parse(body.data() + pos);
+                            pos += slsfs::leveldb_pack::range_frame::bytesize;
+
+                            std::uint32_t const index = frame.blockid - first_blockid;
+                            if (index < run_start_index or index >= run_end_index or pos + frame.size > body.size())
+                                break;
+
+                            result->fill(frame.blockid, body.data() + pos, frame.size);
+                            pos += frame.size;
+                        }
+                    }
+
+                    // blocks without a frame do not exist
+                    result->finish(run_end_index - run_start_index);
                 });
-            currentpos += blockreadsize;
         }
     }
 
@@ -652,6 +1146,132 @@ class storage_conf_ssbd_backend : public storage_conf
         start_read(read_request_input, readnext);
     }
 
+    using response_list = std::vector<slsfs::leveldb_pack::packet_pointer>;
+
+    // the blocks of a file are spread over every ssbd, so whole-file requests go to all of them
+    void start_file_request_all (slsfs::pack::key_t const& uuid,
+                                 slsfs::leveldb_pack::msg_t const type,
+                                 std::uint32_t const blockid, std::uint16_t const position,
+                                 std::uint32_t const last,
+                                 std::function<void(response_list const&)> on_all)
+    {
+        auto responses   = std::make_shared<response_list>(backend_list_.size());
+        auto outstanding = std::make_shared<std::atomic<int>>(backend_list_.size());
+        for (std::size_t i = 0; i < backend_list_.size(); i++)
+        {
+            slsfs::leveldb_pack::packet_pointer request =
+                slsfs::leveldb_pack::create_request(uuid, type, 0, blockid, position, 0);
+
+            slsfs::leveldb_pack::block_range range {.last = last};
+            request->data.buf.resize(slsfs::leveldb_pack::block_range::bytesize);
+            range.dump(request->data.buf.data());
+
+            backend_list_.at(i)->start_send_request(
+                request,
+                [responses, outstanding, i, on_all] (slsfs::leveldb_pack::packet_pointer resp) {
+                    responses->at(i) = resp;
+                    if (--(*outstanding) == 0)
+                        std::invoke(on_all, *responses);
+                });
+        }
+    }
+
+    static
+    bool all_acked (response_list const& responses)
+    {
+        return std::all_of(responses.begin(), responses.end(),
+                           [] (slsfs::leveldb_pack::packet_pointer const& resp) {
+                               return resp->header.type == slsfs::leveldb_pack::msg_t::ack;
+                           });
+    }
+
+    // last data block of a file; parity blocks of erasure coding sort after it
+    auto last_data_blockid () -> std::uint32_t
+    {
+        if (erasure_code_)
+            return parity_blockid_flag - 1;
+        return std::numeric_limits<std::uint32_t>::max();
+    }
+
+    void start_file_stat (slsfs::jsre::request_parser<slsfs::base::byte> const input,
+                          slsfs::backend::ssbd::handler_ptr next)
+    {
+        slsfs::log::log("start_file_stat {}", input.print());
+        start_file_request_all(
+            input.uuid(), slsfs::leveldb_pack::msg_t::file_stat, 0, 0, last_data_blockid(),
+            [next, this] (response_list const& responses) {
+                slsfs::jsre::meta::filestat stat;
+                std::uint64_t size = 0;
+                for (slsfs::leveldb_pack::packet_pointer const& resp : responses)
+                {
+                    if (resp->header.type != slsfs::leveldb_pack::msg_t::ack or
+                        resp->data.buf.size() < slsfs::leveldb_pack::file_stat::bytesize)
+                    {
+                        slsfs::log::log<slsfs::log::level::error>("start_file_stat failed: {}", resp->header.print());
+                        std::invoke(*next, slsfs::base::to_buf("Error: stat failed on ssbd"));
+                        return;
+                    }
+
+                    slsfs::leveldb_pack::file_stat part;
+                    part.parse(resp->data.buf.data());
+                    if (part.block_count > 0)
+                        size = std::max<std::uint64_t>(size, std::uint64_t{part.last_blockid} * blocksize() + part.last_size);
+                    stat.block_count += part.block_count;
+                    stat.version = std::max(stat.version, part.version);
+                }
+
+                stat.size = static_cast<std::uint32_t>(std::min<std::uint64_t>(size, std::numeric_limits<std::uint32_t>::max()));
+                stat.to_network_format();
+
+                slsfs::base::buf buf(sizeof(stat));
+                std::memcpy(buf.data(), std::addressof(stat), sizeof(stat));
+                std::invoke(*next, buf);
+            });
+    }
+
+    // input.position() is the new size
+    void start_file_truncate (slsfs::jsre::request_parser<slsfs::base::byte> const input,
+                              slsfs::backend::ssbd::handler_ptr next)
+    {
+        slsfs::log::log("start_file_truncate {}", input.print());
+
+        // parity would have to be recomputed for the cut stripe
+        if (erasure_code_)
+        {
+            std::invoke(*next, slsfs::base::to_buf("Error: truncate is not supported with erasure coding"));
+            return;
+        }
+
+        start_file_request_all(
+            input.uuid(), slsfs::leveldb_pack::msg_t::file_truncate,
+            input.position() / blocksize(),
+            static_cast<std::uint16_t>(input.position() % blocksize()),
+            last_data_blockid(),
+            [next] (response_list const& responses) {
+                if (all_acked(responses))
+                    std::invoke(*next, slsfs::base::to_buf("OK"));
+                else
+                    std::invoke(*next, slsfs::base::to_buf("Error: truncate failed on ssbd"));
+            });
+    }
+
+    void start_file_delete (slsfs::jsre::request_parser<slsfs::base::byte> const input,
+                            slsfs::backend::ssbd::handler_ptr next)
+    {
+        slsfs::log::log("start_file_delete {}", input.print());
+        recoder_.erase_checked(input.uuid());
+
+        start_file_request_all(
+            input.uuid(), slsfs::leveldb_pack::msg_t::file_delete, 0, 0,
+            std::numeric_limits<std::uint32_t>::max(),
+            [next] (response_list const& responses) {
+                if (all_acked(responses))
+                    std::invoke(*next, slsfs::base::to_buf("OK"));
+                else
+                    std::invoke(*next, slsfs::base::to_buf("Error: delete failed on ssbd"));
+            });
+    }
+
 public:
     storage_conf_ssbd_backend(boost::asio::io_context& io): io_context_{io} {}
 
@@ -665,6 +1285,11 @@ public:
     {
         replication_size_ = config["replication_size"].get<int>();
 
+        // sockets per ssbd; a large write only holds up the requests on its own connection
+        std::size_t connections = 4;
+        if (config.contains("connections_per_host"))
+            connections = config["connections_per_host"].get<std::size_t>();
+
         // setup normal operating host
         for (auto&& element : config["hosts"])
         {
@@ -672,19 +1297,29 @@ public:
             std::string const port = element["port"].get<std::string>();
             slsfs::log::log("adding {}:{}", host, port);
 
-            backend_list_.push_back(std::make_shared<slsfs::backend::ssbd>(io_context_, host, port));
+            backend_list_.push_back(std::make_shared<slsfs::backend::ssbd>(io_context_, host, port, connections));
         }
 
         replication_start_index_ = backend_list_.size();
-         // setup replication operating host (but as the second half of the vector)
-        for (auto&& element : config["hosts"])
-        {
-            std::string const host = element["host"].get<std::string>();
-            std::string const port = element["port"].get<std::string>();
-            slsfs::log::log("adding replication {}:{}", host, port);
 
-            backend_list_.push_back(std::make_shared<slsfs::backend::ssbd>(io_context_, host, port));
+        if (config.contains("read_replicas"))
+            read_replicas_ = config["read_replicas"].get<bool>();
+
+        if (config.contains("hedge_percentile"))
+            hedge_.set_percentile(config["hedge_percentile"].get<double>());
+
+        if (config.contains("erasure_coding"))
+        {
+            int const k = config["erasure_coding"]["k"].get<int>();
+            int const m = config["erasure_coding"]["m"].get<int>();
+            if (k + m > static_cast<int>(backend_list_.size()))
+                throw std::invalid_argument(fmt::format("erasure coding {}+{} needs {} hosts, got {}",
+                                                        k, m, k + m, backend_list_.size()));
+
+            erasure_code_.emplace(k, m);
+            slsfs::log::log("erasure coding: {} data + {} parity fragments per stripe", k, m);
         }
+
         storage_conf::init(config);
     }
 
@@ -727,6 +1362,26 @@ public:
             break;
         }
     }
+
+    void start_perform_file (slsfs::jsre::request_parser<slsfs::base::byte> const& input,
+                             std::function<void(slsfs::base::buf)> next) override
+    {
+        auto next_ptr = std::make_shared<std::function<void(slsfs::base::buf)>>(std::move(next));
+        switch (input.file_operation())
+        {
+        case slsfs::jsre::file_operation_t::stat:
+            start_file_stat(input, next_ptr);
+            break;
+
+        case slsfs::jsre::file_operation_t::truncate:
+            start_file_truncate(input, next_ptr);
+            break;
+
+        case slsfs::jsre::file_operation_t::remove:
+            start_file_delete(input, next_ptr);
+            break;
+        }
+    }
 };
 
 } // namespace slsfsdf
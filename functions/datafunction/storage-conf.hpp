@@ -56,6 +56,14 @@ public:
         return {};
     }
 
+    virtual
+    auto perform_file(slsfs::jsre::request_parser<slsfs::base::byte> const& input)
+        -> slsfs::base::buf
+    {
+        assert(false && "to use perform_file, please override this function");
+        return {};
+    }
+
     virtual
     void start_perform (slsfs::jsre::request_parser<slsfs::base::byte> const& input,
                         std::function<void(slsfs::base::buf)> next) {
@@ -67,6 +75,12 @@ public:
                                  std::function<void(slsfs::base::buf)> next) {
         assert(false && "to use start_perform_metadata, please override this function");
     }
+
+    virtual
+    void start_perform_file (slsfs::jsre::request_parser<slsfs::base::byte> const& input,
+                             std::function<void(slsfs::base::buf)> next) {
+        assert(false && "to use start_perform_file, please override this function");
+    }
 };
 
 } // namespace slsfsdf
@@ -19,6 +19,7 @@ class direct_client_connection : public std::enable_shared_from_this<direct_clie
     boost::asio::io_context& io_context_;
     tcp::socket socket_;
     slsfs::socket_writer::socket_writer<slsfs::pack::packet, std::vector<slsfs::pack::unit_t>> writer_;
+    slsfs::framing_reader::framing_reader<slsfs::pack::packet_header, std::vector<slsfs::pack::unit_t>> reader_;
     // ref pxy cmd
     ProxyCommand& proxy_command_;
 
@@ -29,93 +30,80 @@ public:
         io_context_{io},
         socket_{std::move(socket)},
         writer_{io, socket_},
+        reader_{socket_,
+                [] (slsfs::pack::packet_header const& header) -> std::size_t { return header.datasize; },
+                [] (slsfs::pack::packet_header const&, std::size_t const size) {
+                    return std::make_shared<std::vector<slsfs::pack::unit_t>>(size);
+                },
+                [this] (slsfs::pack::packet_header const& header, std::shared_ptr<std::vector<slsfs::pack::unit_t>> body) {
+                    dispatch(header, std::move(body));
+                },
+                [] (boost::system::error_code ec) {
+                    if (ec != boost::asio::error::eof)
+                        slsfs::log::log<slsfs::log::level::error>("start read: {}", ec.message());
+                }},
         proxy_command_{pc} {}
 
     auto socket() -> tcp::socket& { return socket_; }
 
-    void start_read_header()
-    {
-        //BOOST_LOG_TRIVIAL(trace) << "start_read_header";
-        auto read_buf = std::make_shared<std::array<slsfs::pack::unit_t, slsfs::pack::packet_header::bytesize>>();
-        boost::asio::async_read(
-            socket_,
-            boost::asio::buffer(read_buf->data(), read_buf->size()),
-            [self=this->shared_from_this(), read_buf] (boost::system::error_code ec, std::size_t /*length*/) {
-                if (ec)
-                {
-                    if (ec != boost::asio::error::eof)
-                        slsfs::log::log<slsfs::log::level::error>("start read header");
-                    return;
-                }
-
-                slsfs::pack::packet_pointer pack = std::make_shared<slsfs::pack::packet>();
-                pack->header.parse(read_buf->data());
+    void start_read() {
+        reader_.start_read(this->shared_from_this());
+    }
 
-                switch (pack->header.type)
-                {
-                case slsfs::pack::msg_t::trigger:
-                    self->start_trigger(pack);
-                    break;
-
-                case slsfs::pack::msg_t::put:
-                case slsfs::pack::msg_t::get:
-                case slsfs::pack::msg_t::ack:
-                case slsfs::pack::msg_t::worker_reg:
-                case slsfs::pack::msg_t::set_timer:
-                case slsfs::pack::msg_t::proxyjoin:
-                case slsfs::pack::msg_t::err:
-                case slsfs::pack::msg_t::cache_transfer:
-                case slsfs::pack::msg_t::worker_dereg:
-                case slsfs::pack::msg_t::worker_push_request:
-                case slsfs::pack::msg_t::worker_response:
-                case slsfs::pack::msg_t::trigger_reject:
-                {
-                    slsfs::log::log<slsfs::log::level::error>("packet error from endpoint {}", boost::lexical_cast<std::string>(self->socket_.remote_endpoint()));
-                    slsfs::pack::packet_pointer resp = std::make_shared<slsfs::pack::packet>();
-                    resp->header = pack->header;
-                    resp->header.type = slsfs::pack::msg_t::err;
-                    self->start_write(resp);
-                    self->start_read_header();
-                    break;
-                }
-                }
-            });
+    void dispatch(slsfs::pack::packet_header const& header, std::shared_ptr<std::vector<slsfs::pack::unit_t>> body)
+    {
+        slsfs::pack::packet_pointer pack = std::make_shared<slsfs::pack::packet>();
+        pack->header = header;
+        pack->data.buf = std::move(*body);
+
+        switch (pack->header.type)
+        {
+        case slsfs::pack::msg_t::trigger:
+            start_trigger(pack);
+            break;
+
+        case slsfs::pack::msg_t::put:
+        case slsfs::pack::msg_t::get:
+        case slsfs::pack::msg_t::ack:
+        case slsfs::pack::msg_t::worker_reg:
+        case slsfs::pack::msg_t::set_timer:
+        case slsfs::pack::msg_t::proxyjoin:
+        case slsfs::pack::msg_t::err:
+        case slsfs::pack::msg_t::cache_transfer:
+        case slsfs::pack::msg_t::worker_dereg:
+        case slsfs::pack::msg_t::worker_push_request:
+        case slsfs::pack::msg_t::worker_response:
+        case slsfs::pack::msg_t::trigger_reject:
+        {
+            slsfs::log::log<slsfs::log::level::error>("packet error from endpoint {}", boost::lexical_cast<std::string>(socket_.remote_endpoint()));
+            slsfs::pack::packet_pointer resp = std::make_shared<slsfs::pack::packet>();
+            resp->header = pack->header;
+            resp->header.type = slsfs::pack::msg_t::err;
+            start_write(resp);
+            break;
+        }
+        }
     }
 
     void start_trigger(slsfs::pack::packet_pointer pack)
     {
         slsfs::log::log("start_trigger ");
-        auto read_buf = std::make_shared<std::vector<slsfs::pack::unit_t>>(pack->header.datasize);
-        boost::asio::async_read(
-            socket_,
-            boost::asio::buffer(read_buf->data(), read_buf->size()),
-            [self=this->shared_from_this(), read_buf, pack] (boost::system::error_code ec, std::size_t length) {
-                if (ec)
-                {
-                    slsfs::log::log<slsfs::log::level::error>("start read body: ");
-                    return;
-                }
-
-                pack->data.parse(length, read_buf->data());
-
-                auto const start = std::chrono::high_resolution_clock::now();
-
-                self->proxy_command_.start_job(
-                    pack,
-                    [start, pack, self=self->shared_from_this()]
-                    (slsfs::base::buf buf) {
-                        slsfs::pack::packet_pointer response = std::make_shared<slsfs::pack::packet>();
-                        response->header = pack->header;
-                        response->header.type = slsfs::pack::msg_t::worker_response;
-                        response->data.buf = std::move(buf);
-
-                        self->start_write(response);
-
-                        auto const end = std::chrono::high_resolution_clock::now();
-                        auto relativetime = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
-                        slsfs::log::log<slsfs::log::level::debug>("req finish in: {}ns", relativetime);
-                    });
-                self->start_read_header();
+        auto const start = std::chrono::high_resolution_clock::now();
+
+        proxy_command_.start_job(
+            pack,
+            [start, pack, self=this->shared_from_this()]
+            (slsfs::base::buf buf) {
+                slsfs::pack::packet_pointer response = std::make_shared<slsfs::pack::packet>();
+                response->header = pack->header;
+                response->header.type = slsfs::pack::msg_t::worker_response;
+                response->data.buf = std::move(buf);
+
+                self->start_write(response);
+
+                auto const end = std::chrono::high_resolution_clock::now();
+                auto relativetime = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+                slsfs::log::log<slsfs::log::level::debug>("req finish in: {}ns", relativetime);
             });
     }
 
@@ -167,7 +155,7 @@ public:
                     std::move(socket),
                     self->proxy_command_);
 
-                accepted->start_read_header();
+                accepted->start_read();
             });
     }
 };
@@ -0,0 +1,90 @@
+#include "erasure-code.hpp"
+
+#include <bit>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <optional>
+#include <random>
+#include <utility>
+#include <vector>
+
+// Round-trip check of erasure-code.hpp.
+//   test-erasure
+// encodes random stripes for several (k, m), drops every pattern of up to m
+// fragments and checks decode() gives the data back; one fragment more must fail.
+// exits non-zero on the first mismatch.
+
+namespace
+{
+
+using fragments_t = std::vector<std::optional<std::vector<std::uint8_t>>>;
+
+auto random_stripe(std::mt19937_64& gen, int const k, std::size_t const size) -> std::vector<std::vector<std::uint8_t>>
+{
+    std::vector<std::vector<std::uint8_t>> data(k, std::vector<std::uint8_t>(size));
+    for (std::vector<std::uint8_t>& fragment : data)
+        for (std::uint8_t& c : fragment)
+            c = static_cast<std::uint8_t>(gen());
+    return data;
+}
+
+// every subset of the k+m fragments with at most m lost, plus the ones with m+1 lost
+bool check_round_trip(int const k, int const m, std::size_t const size, std::mt19937_64& gen)
+{
+    slsfsdf::ec::reed_solomon const rs {k, m};
+    std::vector<std::vector<std::uint8_t>> const data = random_stripe(gen, k, size);
+    std::vector<std::vector<std::uint8_t>> const parity = rs.encode(data);
+
+    int const n = k + m;
+    std::uint64_t patterns = 0;
+    for (std::uint32_t lost = 0; lost < (1u << n); lost++)
+    {
+        int const count = std::popcount(lost);
+        if (count > m + 1)
+            continue;
+
+        fragments_t fragments(n);
+        for (int f = 0; f < n; f++)
+            if (not (lost & (1u << f)))
+                fragments[f] = (f < k)? data[f] : parity[f - k];
+
+        std::optional<std::vector<std::vector<std::uint8_t>>> const decoded = rs.decode(fragments);
+        patterns++;
+
+        if (count > m)
+        {
+            if (decoded)
+            {
+                std::cout << "k=" << k << " m=" << m << ": decoded with " << count << " fragments lost (mask " << lost << ")\n";
+                return false;
+            }
+            continue;
+        }
+
+        if (not decoded or *decoded != data)
+        {
+            std::cout << "k=" << k << " m=" << m << " size=" << size << ": wrong data for lost mask " << lost << "\n";
+            return false;
+        }
+    }
+
+    std::cout << "k=" << k << " m=" << m << " size=" << size << ": " << patterns << " loss patterns ok\n";
+    return true;
+}
+
+} // namespace
+
+int main()
+{
+    std::mt19937_64 gen {42};
+    std::vector<std::pair<int, int>> const configs {{1, 0}, {1, 1}, {2, 1}, {3, 2}, {4, 2}, {6, 3}, {8, 4}, {10, 4}};
+
+    bool ok = true;
+    for (auto const& [k, m] : configs)
+        for (std::size_t const size : {1u, 33u, 4096u + 7u})
+            ok &= check_round_trip(k, m, size, gen);
+
+    std::cout << (ok ? "OK" : "FAILED") << "\n";
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,187 @@
+#include "placement.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Microbenchmark and distribution check of placement.hpp.
+//   test-placement [hosts] [blocks]
+// exits non-zero when the spread, the reshuffle on adding a host, or replica
+// distinctness is off.
+
+using uuid_t = std::array<unsigned char, 32>;
+
+namespace
+{
+
+// the placement it replaces: reseed a mt19937 per call and discard partition^2 * replica steps
+int legacy_select(uuid_t const& uuid, int const partition, int const replication_index, int const hosts)
+{
+    static thread_local std::mt19937 mt;
+    std::seed_seq seeds {uuid.begin(), uuid.end()};
+    mt.seed(seeds);
+
+    std::uniform_int_distribution<> dist(0, hosts - 1);
+    mt.discard(partition * (partition * replication_index));
+    return dist(mt);
+}
+
+auto random_keys(std::size_t const count) -> std::vector<uuid_t>
+{
+    std::mt19937_64 gen {42};
+    std::vector<uuid_t> keys(count);
+    for (uuid_t& k : keys)
+        for (unsigned char& c : k)
+            c = static_cast<unsigned char>(gen());
+    return keys;
+}
+
+template<typename Function>
+auto ns_per_call(std::size_t const calls, Function&& f) -> double
+{
+    auto const start = std::chrono::steady_clock::now();
+    std::uint64_t sink = 0;
+    for (std::size_t i = 0; i < calls; i++)
+        sink += f(i);
+    auto const end = std::chrono::steady_clock::now();
+
+    // keep the calls from being optimized away
+    if (sink == 42)
+        std::cerr << "";
+    return std::chrono::duration<double, std::nano>(end - start).count() / calls;
+}
+
+void benchmark(std::vector<uuid_t> const& keys, int const hosts)
+{
+    std::cout << "# ns per placement, " << hosts << " hosts\n";
+    for (std::uint32_t const blockid : {0u, 10u, 100u, 1000u})
+    {
+        std::size_t const n = keys.size();
+        double const jump = ns_per_call(n, [&](std::size_t i) { return slsfsdf::placement::host(keys[i], blockid, 0, hosts); });
+        double const replica = ns_per_call(n, [&](std::size_t i) { return slsfsdf::placement::host(keys[i], blockid, 2, hosts); });
+
+        // the legacy discard grows with blockid^2; keep the call count bounded
+        std::size_t const legacy_calls = blockid >= 1000 ? 200 : n;
+        double const legacy = ns_per_call(legacy_calls, [&](std::size_t i) { return legacy_select(keys[i % n], blockid, 1, hosts); });
+
+        std::cout << "blockid=" << blockid << " placement=" << jump << " placement(replica 2)=" << replica
+                  << " legacy(replica 1)=" << legacy << "\n";
+    }
+
+    // no shared state: the same calls from every core
+    unsigned const threads = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<std::thread> pool;
+    std::vector<double> result(threads);
+    for (unsigned t = 0; t < threads; t++)
+        pool.emplace_back([&, t] {
+            result[t] = ns_per_call(keys.size(), [&](std::size_t i) { return slsfsdf::placement::host(keys[i], i, 0, hosts); });
+        });
+    for (std::thread& th : pool)
+        th.join();
+    std::cout << threads << " threads: " << *std::max_element(result.begin(), result.end()) << " ns per placement (slowest thread)\n";
+}
+
+// the blocks of one range share a host; sample one block per range so the counts stay independent
+bool check_spread(std::vector<uuid_t> const& keys, int const hosts, std::uint32_t const blocks_per_key)
+{
+    std::vector<std::uint64_t> count(hosts, 0);
+    for (uuid_t const& k : keys)
+        for (std::uint32_t b = 0; b < blocks_per_key; b++)
+            count[slsfsdf::placement::host(k, b * slsfsdf::placement::range_blocks, 0, hosts)]++;
+
+    double const expected = static_cast<double>(keys.size()) * blocks_per_key / hosts;
+    double chi2 = 0;
+    for (std::uint64_t c : count)
+        chi2 += (c - expected) * (c - expected) / expected;
+
+    auto const [min, max] = std::minmax_element(count.begin(), count.end());
+    double const spread = (*max - *min) / expected;
+
+    // chi-square with hosts-1 degrees of freedom: mean hosts-1, sd sqrt(2(hosts-1))
+    double const limit = (hosts - 1) + 5 * std::sqrt(2.0 * (hosts - 1));
+    std::cout << "spread over " << hosts << " hosts: min=" << *min << " max=" << *max << " expected=" << expected
+              << " (max-min)/expected=" << spread << " chi2=" << chi2 << " limit=" << limit << "\n";
+    return chi2 < limit;
+}
+
+bool check_reshuffle(std::vector<uuid_t> const& keys, int const hosts, std::uint32_t const blocks_per_key)
+{
+    std::uint64_t moved = 0, moved_elsewhere = 0, total = 0;
+    for (uuid_t const& k : keys)
+        for (std::uint32_t b = 0; b < blocks_per_key; b++)
+        {
+            std::uint32_t const blockid = b * slsfsdf::placement::range_blocks;
+            int const before = slsfsdf::placement::host(k, blockid, 0, hosts);
+            int const after  = slsfsdf::placement::host(k, blockid, 0, hosts + 1);
+            total++;
+            if (before != after)
+            {
+                moved++;
+                if (after != hosts)
+                    moved_elsewhere++;
+            }
+        }
+
+    double const fraction = static_cast<double>(moved) / total;
+    double const ideal = 1.0 / (hosts + 1);
+    std::cout << "add host " << hosts << " -> " << hosts + 1 << ": moved " << fraction << " of blocks (ideal " << ideal
+              << "), " << moved_elsewhere << " not to the new host\n";
+    return moved_elsewhere == 0 and fraction < ideal * 1.1;
+}
+
+bool check_replicas(std::vector<uuid_t> const& keys, int const hosts, int const replicas)
+{
+    for (uuid_t const& k : keys)
+        for (std::uint32_t b = 0; b < 16; b++)
+        {
+            std::array<int, slsfsdf::placement::max_replicas> seen;
+            for (int r = 0; r < replicas; r++)
+            {
+                seen[r] = slsfsdf::placement::host(k, b, r, hosts);
+                if (std::find(seen.begin(), seen.begin() + r, seen[r]) != seen.begin() + r)
+                {
+                    std::cout << "replica " << r << " of block " << b << " shares a host\n";
+                    return false;
+                }
+            }
+        }
+
+    // a range keeps its blocks together
+    for (uuid_t const& k : keys)
+        for (std::uint32_t b = 1; b < slsfsdf::placement::range_blocks; b++)
+            if (slsfsdf::placement::host(k, b, 0, hosts) != slsfsdf::placement::host(k, 0, 0, hosts))
+            {
+                std::cout << "block " << b << " left the host of its range\n";
+                return false;
+            }
+    std::cout << replicas << " replicas on distinct hosts out of " << hosts << "\n";
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    int const hosts = argc > 1 ? std::stoi(argv[1]) : 10;
+    std::size_t const blocks = argc > 2 ? std::stoul(argv[2]) : 1000000;
+
+    std::uint32_t const blocks_per_key = 64;
+    std::vector<uuid_t> const keys = random_keys(std::max<std::size_t>(1, blocks / blocks_per_key));
+
+    benchmark(random_keys(100000), hosts);
+
+    bool ok = true;
+    ok &= check_spread(keys, hosts, blocks_per_key);
+    ok &= check_reshuffle(keys, hosts, blocks_per_key);
+    ok &= check_replicas(keys, hosts, std::min(3, hosts));
+
+    std::cout << (ok ? "OK" : "FAILED") << "\n";
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
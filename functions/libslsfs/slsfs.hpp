@@ -14,6 +14,7 @@
 #include "slsfs/serializer.hpp"
 #include "slsfs/json-replacement.hpp"
 #include "slsfs/socket-writer.hpp"
+#include "slsfs/framing-reader.hpp"
 
 #include <kafka/KafkaConsumer.h>
 #include <kafka/KafkaProducer.h>
@@ -9,8 +9,7 @@
 #include "leveldb-serializer.hpp"
 #include "debuglog.hpp"
 #include "socket-writer.hpp"
-
-#include <oneapi/tbb/concurrent_hash_map.h>
+#include "framing-reader.hpp"
 
 #include <boost/exception/all.hpp>
 #include <boost/exception/error_info.hpp>
@@ -18,6 +17,14 @@
 #include <boost/asio.hpp>
 #include <boost/lexical_cast.hpp>
 
+#include <array>
+#include <atomic>
+#include <cstring>
+#include <deque>
+#include <limits>
+#include <mutex>
+#include <shared_mutex>
+
 namespace slsfs::backend
 {
 
@@ -29,8 +36,12 @@ class job
     boost::signals2::signal<void(leveldb_pack::packet_pointer)> next_;
     leveldb_pack::packet_pointer original_request_ = nullptr;
     std::chrono::system_clock::time_point registered_ = std::chrono::system_clock::now();
+    std::chrono::system_clock::time_point dispatched_ = registered_; // left the local credit queue
     std::chrono::system_clock::time_point started_;
     std::chrono::system_clock::time_point ended_;
+    std::size_t credit_ = 0; // bytes of the credit window held until the response
+    std::size_t load_ = 0;   // bytes of request and expected response, counted against its connection
+    std::atomic<bool> finished_ = false;
 
 public:
     job () = default;
@@ -44,10 +55,15 @@ public:
         next_.connect(callable);
     }
 
-    void run (leveldb_pack::packet_pointer resp)
+    // runs the handler once; false if the job was already answered or cancelled
+    bool run (leveldb_pack::packet_pointer resp)
     {
+        if (finished_.exchange(true))
+            return false;
+
         ended_ = std::chrono::system_clock::now();
         next_(resp);
+        return true;
     }
 
     void cancel()
@@ -58,156 +74,794 @@ public:
         run(resp);
     }
 
+    auto request() const -> leveldb_pack::packet_pointer { return original_request_; }
+
+    void hold_credit(std::size_t const bytes, std::size_t const load)
+    {
+        credit_ = bytes;
+        load_ = load;
+    }
+    auto credit() const -> std::size_t { return credit_; }
+    auto load() const -> std::size_t { return load_; }
+
     void mark_started() { started_ = std::chrono::system_clock::now(); }
 
+    // from start_send_request to the response, credit queue included
+    auto latency() const -> std::chrono::system_clock::duration { return ended_ - registered_; }
+
+    // time spent waiting for credits before the request went to the socket
+    auto mark_dispatched() -> std::chrono::system_clock::duration
+    {
+        dispatched_ = std::chrono::system_clock::now();
+        return dispatched_ - registered_;
+    }
+
     void print ()
     {
-        log::log("job stat: waittime: {}, execute time: {}",
-                 started_ - registered_, ended_ - started_);
+        log::log("job stat: queue time: {}, waittime: {}, execute time: {}",
+                 dispatched_ - registered_, started_ - dispatched_, ended_ - started_);
     }
 };
 
 using job_ptr = std::shared_ptr<job>;
-} // namespace detail
 
+// a request waiting for credits or for a connection
+struct queued_request
+{
+    leveldb_pack::packet_pointer request;
+    job_ptr job;
+    std::uint32_t id = 0; // slot id, set when admitted
+};
 
-class ssbd
+// bytes a request takes on the wire; get only sends its header
+inline
+auto request_bytes(leveldb_pack::packet_pointer const& request) -> std::size_t
 {
-    boost::asio::io_context& io_context_;
+    if (request->header.type == leveldb_pack::msg_t::get or
+        request->header.type == leveldb_pack::msg_t::get_replica)
+        return leveldb_pack::packet_header::bytesize;
+    return leveldb_pack::packet_header::bytesize + request->data.buf.size();
+}
+
+// request_bytes plus the response the request asks for
+inline
+auto exchange_bytes(leveldb_pack::packet_pointer const& request) -> std::size_t
+{
+    std::size_t bytes = request_bytes(request) + leveldb_pack::packet_header::bytesize;
+    switch (request->header.type)
+    {
+    case leveldb_pack::msg_t::get:
+    case leveldb_pack::msg_t::get_replica:
+        bytes += request->header.datasize;
+        break;
+
+    case leveldb_pack::msg_t::get_range:
+    case leveldb_pack::msg_t::get_range_replica:
+        if (request->data.buf.size() >= leveldb_pack::range_request::bytesize)
+        {
+            leveldb_pack::range_request range;
+            range.parse(request->data.buf.data());
+            bytes += range.length;
+        }
+        break;
+
+    default:
+        break;
+    }
+    return bytes;
+}
+
+// reads are safe to send again after their connection dropped
+inline
+bool repeatable(leveldb_pack::msg_t const type)
+{
+    switch (type)
+    {
+    case leveldb_pack::msg_t::get:
+    case leveldb_pack::msg_t::get_range:
+    case leveldb_pack::msg_t::get_replica:
+    case leveldb_pack::msg_t::get_range_replica:
+    case leveldb_pack::msg_t::file_stat:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// shared by every connection to one ssbd
+struct host_stats
+{
+    // load seen by replica selection: requests sent and not answered, and an
+    // exponentially weighted moving average (1/8 per sample) of their latency
+    std::atomic<int> outstanding = 0;
+    std::atomic<std::int64_t> latency_ewma_ns = 0;
+
+    std::atomic<std::uint64_t> queued_count = 0, queue_time_ns = 0, max_queue_time_ns = 0;
+
+    void record_latency(std::chrono::system_clock::duration const latency)
+    {
+        std::int64_t const sample = std::chrono::duration_cast<std::chrono::nanoseconds>(latency).count();
+        std::int64_t ewma = latency_ewma_ns;
+        std::int64_t updated;
+        do
+            updated = (ewma == 0) ? sample : ewma + (sample - ewma) / 8;
+        while (not latency_ewma_ns.compare_exchange_weak(ewma, updated));
+    }
+
+    void record_queue_time(std::uint64_t const ns)
+    {
+        queue_time_ns += ns;
+        std::uint64_t max = max_queue_time_ns;
+        while (ns > max and not max_queue_time_ns.compare_exchange_weak(max, ns));
+    }
+};
+
+// In-flight requests of one connection, indexed by the request id each request carries
+// in its salt: slot id % capacity. The full id stays in the slot, so a response for an
+// earlier generation of the slot is told apart from its current request.
+// claim() callers serialize among themselves; take() is one compare-exchange.
+class slot_table
+{
+public:
+    static constexpr std::uint32_t capacity = 1024; // power of two, above any credit window
+
+private:
+    enum state_t : std::uint8_t { free_slot, busy_slot, taking_slot };
+
+    struct slot
+    {
+        std::atomic<std::uint8_t> state = free_slot;
+        std::uint32_t id = 0;
+        job_ptr job = nullptr;
+    };
+
+    std::array<slot, capacity> slots_;
+    std::uint32_t next_id_ = 0;
+
+    auto take_slot(slot& s) -> job_ptr
+    {
+        job_ptr job = std::move(s.job);
+        s.state.store(free_slot, std::memory_order_release);
+        return job;
+    }
+
+public:
+    // a free slot for job and its request id. fewer than capacity slots may be busy
+    auto claim(job_ptr job) -> std::uint32_t
+    {
+        for (;;)
+        {
+            std::uint32_t const id = next_id_++;
+            slot& s = slots_[id % capacity];
+            if (s.state.load(std::memory_order_acquire) != free_slot)
+                continue; // still waiting on an old request; the next one is free
+
+            s.id = id;
+            s.job = std::move(job);
+            s.state.store(busy_slot, std::memory_order_release);
+            return id;
+        }
+    }
+
+    // the job of request id, or nullptr for a stale or unknown id
+    auto take(std::uint32_t const id) -> job_ptr
+    {
+        slot& s = slots_[id % capacity];
+        std::uint8_t expected = busy_slot;
+        if (not s.state.compare_exchange_strong(expected, taking_slot, std::memory_order_acq_rel))
+            return nullptr;
+
+        if (s.id != id)
+        {
+            s.state.store(busy_slot, std::memory_order_release);
+            return nullptr;
+        }
+        return take_slot(s);
+    }
+
+    auto take_all() -> std::vector<job_ptr>
+    {
+        std::vector<job_ptr> jobs;
+        for (slot& s : slots_)
+            for (;;)
+            {
+                std::uint8_t expected = busy_slot;
+                if (s.state.compare_exchange_strong(expected, taking_slot, std::memory_order_acq_rel))
+                {
+                    jobs.push_back(take_slot(s));
+                    break;
+                }
+                if (expected == free_slot)
+                    break;
+                // taking_slot: a response is being matched right now; it ends either way
+            }
+        return jobs;
+    }
+
+    static
+    void set_id(leveldb_pack::packet_header& header, std::uint32_t const id)
+    {
+        static_assert(sizeof(header.salt) == sizeof(id));
+        std::memcpy(header.salt.data(), &id, sizeof(id));
+    }
+
+    // the wire bytes of request carrying id. the id goes on a copy of the header: one
+    // packet may be on several connections at once (hedged reads, failover) and is
+    // never written to. get only sends its header, with the read size in datasize
+    static
+    auto serialize(leveldb_pack::packet const& request, std::uint32_t const id) -> std::shared_ptr<leveldb_pack::buffer_t>
+    {
+        leveldb_pack::packet_header header = request.header;
+        set_id(header, id);
+
+        bool const header_only = (header.type == leveldb_pack::msg_t::get or
+                                  header.type == leveldb_pack::msg_t::get_replica);
+        if (not header_only)
+            header.datasize = request.data.buf.size();
+
+        auto r = std::make_shared<leveldb_pack::buffer_t>(leveldb_pack::packet_header::bytesize +
+                                                          (header_only? 0 : request.data.buf.size()));
+        leveldb_pack::unit_t* pos = header.dump(r->data());
+        if (not header_only)
+            std::memcpy(pos, request.data.buf.data(), request.data.buf.size());
+        return r;
+    }
+
+    static
+    auto id_of(leveldb_pack::packet_header const& header) -> std::uint32_t
+    {
+        std::uint32_t id;
+        std::memcpy(&id, header.salt.data(), sizeof(id));
+        return id;
+    }
+};
+
+// One socket to an ssbd with its own writer, reader, job table and credit window.
+// A connection is never reopened; the pool in ssbd replaces it when it closes.
+class connection : public std::enable_shared_from_this<connection>
+{
+public:
+    using closed_handler = std::function<void(std::vector<job_ptr>)>;
+
+private:
+    // the socket runs on its own strand, so the connect timeout and the socket handlers never race
     boost::asio::ip::tcp::socket socket_;
     boost::asio::ip::tcp::endpoint const endpoint_;
-    using jobmap =
-        oneapi::tbb::concurrent_hash_map<
-            leveldb_pack::packet_header,
-            detail::job_ptr,
-            leveldb_pack::packet_header_key_hash_compare>;
-
-    std::once_flag read_started_flag_;
-    jobmap outstanding_jobs_;
-    using jobmap_accessor = decltype(outstanding_jobs_)::accessor;
+    std::shared_ptr<host_stats> stats_;
+    closed_handler on_closed_;
+
+    slot_table inflight_;
     socket_writer::socket_writer<leveldb_pack::packet, std::vector<leveldb_pack::unit_t>> writer_;
+    framing_reader::framing_reader<leveldb_pack::packet_header, leveldb_pack::buffer_t> reader_;
+
+    // credit window: requests past it wait in queued_ instead of piling up in the ssbd.
+    // starts small and takes the window the ssbd grants after connecting. requests
+    // take a slot of inflight_ when admitted, under this lock; closed_ is set under
+    // it too, so no request is admitted after fail() emptied the table
+    std::mutex credit_mutex_;
+    leveldb_pack::credit_grant credits_ {.ops = 32, .bytes = 4 * 1024 * 1024};
+    std::uint32_t inflight_ops_ = 0;
+    std::size_t   inflight_bytes_ = 0;
+    std::deque<queued_request> queued_;
+    bool closed_ = false;
+
+    std::atomic<bool> open_ = false;
+    std::atomic<std::size_t> outstanding_bytes_ = 0;
+
+    // one oversized request still goes out alone, or it would wait forever
+    bool have_credit(std::size_t const bytes) const
+    {
+        if (inflight_ops_ == 0)
+            return true;
+        return inflight_ops_ < credits_.ops and inflight_bytes_ + bytes <= credits_.bytes;
+    }
 
-    void start_read_loop() {
-        std::call_once(read_started_flag_, [this] { start_read_one(); });
+    // counts q against the window and gives it a request id. caller holds credit_mutex_
+    void admit(queued_request& q)
+    {
+        inflight_ops_++;
+        inflight_bytes_ += q.job->credit();
+        q.id = inflight_.claim(q.job);
     }
 
-    void start_read_one()
+    // pops the queued requests that fit in the window. caller holds credit_mutex_
+    auto take_admitted() -> std::vector<queued_request>
     {
-        leveldb_pack::packet_pointer resp = std::make_shared<leveldb_pack::packet>();
-        auto headerbuf = std::make_shared<std::vector<leveldb_pack::unit_t>> (leveldb_pack::packet_header::bytesize);
-        log::log("backend ssbd start_read_one called headersize: {}", leveldb_pack::packet_header::bytesize);
-        boost::asio::async_read(
-            socket_,
-            boost::asio::buffer(headerbuf->data(), headerbuf->size()),
-            [this, resp, headerbuf]
-            (boost::system::error_code const& ec, std::size_t transferred_size) {
+        std::vector<queued_request> admitted;
+        while (not closed_ and not queued_.empty() and have_credit(queued_.front().job->credit()))
+        {
+            admit(queued_.front());
+            admitted.push_back(std::move(queued_.front()));
+            queued_.pop_front();
+        }
+        return admitted;
+    }
+
+    void release_credit(std::size_t const bytes)
+    {
+        std::vector<queued_request> admitted;
+        {
+            std::scoped_lock lock {credit_mutex_};
+            inflight_ops_--;
+            inflight_bytes_ -= bytes;
+            admitted = take_admitted();
+        }
+
+        for (queued_request& q : admitted)
+            dispatch(q);
+    }
+
+    void dispatch(queued_request const& q)
+    {
+        auto const queue_time = std::chrono::duration_cast<std::chrono::nanoseconds>(q.job->mark_dispatched()).count();
+        if (queue_time > 0)
+            stats_->record_queue_time(queue_time);
+        write_request(q.request, q.job, q.id);
+    }
+
+    // a failed write closes the connection; fail() hands its job to the pool with the rest
+    void write_request(leveldb_pack::packet_pointer request, job_ptr newjob, std::uint32_t const id)
+    {
+        auto next = std::make_shared<socket_writer::boost_callback>(
+            [self=shared_from_this(), request, newjob]
+            (boost::system::error_code const& ec, std::size_t) {
+                newjob->mark_started();
                 if (ec)
                 {
-                    log::log<log::level::error>("ssbd backend: {} have boost error: {} on start_read_one() header {}",
-                             boost::lexical_cast<std::string>(endpoint_), ec.message(), resp->header.print());
+                    log::log<log::level::error>("error {} on {}; start_send_request: {}",
+                             ec.message(), boost::lexical_cast<std::string>(self->endpoint_), request->header.print());
+                    self->fail(ec);
+                }
+            });
+
+        writer_.start_write_socket(request, next, slot_table::serialize(*request, id));
+    }
+
+    // asks the ssbd for its window. outside of the credits itself
+    void start_credit_request()
+    {
+        leveldb_pack::packet_pointer request = std::make_shared<leveldb_pack::packet>();
+        request->header.type = leveldb_pack::msg_t::credit;
+        request->header.uuid.fill(0);
+        request->header.blockid = 0;
+        request->header.position = 0;
+        request->header.version = 0;
+
+        job_ptr newjob = std::make_shared<job>(
+            request,
+            [this] (leveldb_pack::packet_pointer resp) {
+                if (resp->header.type != leveldb_pack::msg_t::credit or
+                    resp->data.buf.size() < leveldb_pack::credit_grant::bytesize)
+                {
+                    log::log<log::level::error>("ssbd backend: {} gave no credit; keep the default window",
+                                                boost::lexical_cast<std::string>(endpoint_));
                     return;
                 }
 
-                assert(headerbuf->size() == transferred_size);
-                resp->header.parse(headerbuf->data());
-                start_read_one_body(resp);
+                leveldb_pack::credit_grant grant;
+                grant.parse(resp->data.buf.data());
+                log::log("ssbd backend: {} grants {} ops, {} bytes",
+                         boost::lexical_cast<std::string>(endpoint_), grant.ops, grant.bytes);
+
+                std::vector<queued_request> admitted;
+                {
+                    std::scoped_lock lock {credit_mutex_};
+                    // 0 is no limit on the ssbd side; ops still stop at the slots of the table
+                    credits_.ops = (grant.ops == 0)? slot_table::capacity - 1 :
+                                   std::min(grant.ops, slot_table::capacity - 1);
+                    credits_.bytes = (grant.bytes == 0)? std::numeric_limits<std::uint32_t>::max() : grant.bytes;
+                    admitted = take_admitted();
+                }
+
+                for (queued_request& q : admitted)
+                    dispatch(q);
             });
+
+        std::uint32_t id = 0;
+        {
+            std::scoped_lock lock {credit_mutex_};
+            if (closed_)
+                return;
+            id = inflight_.claim(newjob);
+        }
+        write_request(request, newjob, id);
     }
 
-    void start_read_one_body(leveldb_pack::packet_pointer resp)
+    void on_response(leveldb_pack::packet_header const& header, std::shared_ptr<leveldb_pack::buffer_t> body)
     {
-        auto bodybuf = std::make_shared<base::buf>(resp->header.datasize, 0);
+        leveldb_pack::packet_pointer resp = std::make_shared<leveldb_pack::packet>();
+        resp->header = header;
+        resp->data.buf = std::move(*body);
 
-        log::log("async_read read body called readsize={}", bodybuf->size());
-        boost::asio::async_read(
-            socket_,
-            boost::asio::buffer(bodybuf->data(), bodybuf->size()),
-            [this, resp, bodybuf] (boost::system::error_code const& ec, std::size_t transferred_size) {
-                assert(bodybuf->size() == transferred_size);
+        // nullptr when a close raced with this response; the pool owns the job now
+        job_ptr done = inflight_.take(slot_table::id_of(resp->header));
+        if (not done)
+        {
+            log::log<log::level::error>("ssbd backend: {} answered unknown request {}",
+                                        boost::lexical_cast<std::string>(endpoint_), resp->header.print());
+            return;
+        }
 
-                if (ec)
+        log::log("async read body executing with header {}", resp->header.print());
+        done->run(resp);
+        //done->print();
+
+        if (done->credit() > 0)
+        {
+            outstanding_bytes_ -= done->load();
+            stats_->record_latency(done->latency());
+            release_credit(done->credit());
+        }
+    }
+
+public:
+    connection(boost::asio::io_context& io, boost::asio::ip::tcp::endpoint const& endpoint,
+               std::shared_ptr<host_stats> stats, closed_handler on_closed):
+        socket_{boost::asio::make_strand(io)}, endpoint_{endpoint},
+        stats_{std::move(stats)}, on_closed_{std::move(on_closed)},
+        writer_{io, socket_},
+        reader_{socket_,
+                [] (leveldb_pack::packet_header const& header) -> std::size_t { return header.datasize; },
+                [] (leveldb_pack::packet_header const&, std::size_t const size) {
+                    return std::make_shared<leveldb_pack::buffer_t>(size);
+                },
+                [this] (leveldb_pack::packet_header const& header, std::shared_ptr<leveldb_pack::buffer_t> body) {
+                    on_response(header, std::move(body));
+                },
+                [this] (boost::system::error_code const& ec) {
+                    log::log<log::level::error>("ssbd backend: {} have boost error: {} while reading",
+                                                boost::lexical_cast<std::string>(endpoint_), ec.message());
+                    fail(ec);
+                }} {}
+
+    // next gets timed_out when the ssbd does not accept within timeout
+    void start_connect(std::chrono::milliseconds const timeout,
+                       std::function<void(boost::system::error_code)> next)
+    {
+        auto timer = std::make_shared<boost::asio::steady_timer>(socket_.get_executor(), timeout);
+        timer->async_wait(
+            [self=shared_from_this()] (boost::system::error_code const& ec) {
+                boost::system::error_code ignored;
+                if (not ec)
+                    self->socket_.close(ignored);
+            });
+
+        socket_.async_connect(
+            endpoint_,
+            [self=shared_from_this(), timer, next] (boost::system::error_code ec) {
+                timer->cancel();
+                if (ec == boost::asio::error::operation_aborted)
+                    ec = boost::asio::error::timed_out;
+
+                if (not ec)
                 {
-                    log::log<log::level::error>("ssbd backend: {} have boost error: {} on start_read_one() -> body header {}", boost::lexical_cast<std::string>(endpoint_), ec.message(), resp->header.print());
+                    self->open_ = true;
+                    self->reader_.start_read(self);
+                    self->start_credit_request();
+                }
+                std::invoke(next, ec);
+            });
+    }
+
+    bool is_open() const { return open_; }
+    auto outstanding_bytes() const -> std::size_t { return outstanding_bytes_; }
+
+    // closes the socket once and hands every job not answered to on_closed
+    void fail(boost::system::error_code const& ec)
+    {
+        std::vector<job_ptr> jobs;
+        {
+            std::scoped_lock lock {credit_mutex_};
+            if (closed_)
+                return;
+
+            closed_ = true;
+            open_ = false;
+            jobs = inflight_.take_all();
+            for (queued_request& q : queued_)
+                jobs.push_back(q.job);
+            queued_.clear();
+        }
+
+        log::log("ssbd backend: connection to {} closed ({}); {} jobs outstanding",
+                 boost::lexical_cast<std::string>(endpoint_), ec.message(), jobs.size());
+
+        boost::asio::post(socket_.get_executor(),
+                          [self=shared_from_this()] {
+                              boost::system::error_code ignored;
+                              self->socket_.close(ignored);
+                          });
+        std::invoke(on_closed_, std::move(jobs));
+    }
+
+    void close() { fail(boost::asio::error::operation_aborted); }
+
+    // false once the connection closed; the job was not taken
+    bool start_send_request(leveldb_pack::packet_pointer request, job_ptr newjob)
+    {
+        std::size_t const bytes = request_bytes(request);
+        newjob->hold_credit(bytes, exchange_bytes(request));
+
+        queued_request q {request, newjob};
+        {
+            std::scoped_lock lock {credit_mutex_};
+            if (closed_)
+                return false;
+
+            outstanding_bytes_ += newjob->load();
+
+            // keep the order: nothing passes requests already waiting
+            if (not queued_.empty() or not have_credit(bytes))
+            {
+                queued_.push_back(q);
+                stats_->queued_count++;
+                log::log("ssbd backend: out of credit ({} ops, {} bytes in flight); queue {}",
+                         inflight_ops_, inflight_bytes_, request->header.print());
+                return true;
+            }
+
+            admit(q);
+        }
+
+        write_request(request, newjob, q.id);
+        return true;
+    }
+};
+
+} // namespace detail
+
+
+// A pool of connections to one ssbd. Each request goes to the open connection with
+// the fewest bytes outstanding, so a large write does not hold up the reads behind it.
+// Connections open asynchronously and reopen with exponential backoff when they drop;
+// the reads they were serving move to the other connections and everything else fails.
+class ssbd : public std::enable_shared_from_this<ssbd>
+{
+    boost::asio::io_context& io_context_;
+    boost::asio::ip::tcp::endpoint const endpoint_;
+    std::size_t const pool_size_;
+    std::shared_ptr<detail::host_stats> stats_ = std::make_shared<detail::host_stats>();
+
+    static constexpr std::chrono::milliseconds connect_timeout {3000};
+    static constexpr std::chrono::milliseconds min_backoff {100};
+    static constexpr std::chrono::milliseconds max_backoff {10000};
+
+    std::shared_mutex pool_mutex_;
+    std::vector<std::shared_ptr<detail::connection>> connections_; // nullptr until the slot first connects
+    std::deque<detail::queued_request> waiting_; // sent while no connection was open
+    bool closing_ = false;
+
+    // caller holds pool_mutex_
+    auto least_loaded() -> std::shared_ptr<detail::connection>
+    {
+        std::shared_ptr<detail::connection> selected = nullptr;
+        for (std::shared_ptr<detail::connection> const& c : connections_)
+            if (c and c->is_open() and (not selected or c->outstanding_bytes() < selected->outstanding_bytes()))
+                selected = c;
+        return selected;
+    }
+
+    bool any_open()
+    {
+        return std::any_of(connections_.begin(), connections_.end(),
+                           [] (std::shared_ptr<detail::connection> const& c) { return c and c->is_open(); });
+    }
+
+    void start_send_job(detail::queued_request q)
+    {
+        for (;;)
+        {
+            std::shared_ptr<detail::connection> selected;
+            {
+                std::shared_lock lock {pool_mutex_};
+                selected = least_loaded();
+            }
+
+            if (not selected)
+            {
+                std::unique_lock lock {pool_mutex_};
+                if (closing_)
+                {
+                    lock.unlock();
+                    q.job->cancel();
                     return;
                 }
 
-                resp->data.parse(transferred_size, bodybuf->data());
-                jobmap_accessor it;
-                [[maybe_unused]]
-                bool found = outstanding_jobs_.find(it, resp->header);
-                assert(found);
+                selected = least_loaded();
+                if (not selected)
+                {
+                    waiting_.push_back(std::move(q));
+                    return;
+                }
+            }
 
-                log::log("async read body executing with header {}", resp->header.print());
-                it->second->run(resp);
-                //it->second->print();
+            // false when it closed after least_loaded(); try another one
+            if (selected->start_send_request(q.request, q.job))
+                return;
+        }
+    }
 
-                outstanding_jobs_.erase(it);
-                start_read_one();
+    // backoff is the wait before the next attempt should this one fail
+    void start_connect(std::size_t const slot, std::chrono::milliseconds const backoff)
+    {
+        std::weak_ptr<ssbd> weak = weak_from_this();
+        auto conn = std::make_shared<detail::connection>(
+            io_context_, endpoint_, stats_,
+            [weak, slot] (std::vector<detail::job_ptr> jobs) {
+                if (std::shared_ptr<ssbd> self = weak.lock())
+                    self->on_closed(slot, std::move(jobs));
+                else
+                    for (detail::job_ptr const& j : jobs)
+                        j->cancel();
             });
+
+        conn->start_connect(
+            connect_timeout,
+            [weak, slot, conn, backoff] (boost::system::error_code const& ec) {
+                std::shared_ptr<ssbd> self = weak.lock();
+                if (not self)
+                {
+                    conn->close();
+                    return;
+                }
+
+                if (not ec)
+                {
+                    self->on_connected(slot, conn);
+                    return;
+                }
+
+                log::log<log::level::error>("ssbd backend: connect to {} failed: {}; retry in {}",
+                                            boost::lexical_cast<std::string>(self->endpoint_), ec.message(), backoff);
+
+                // nothing open to send to: fail what waits rather than hold it through the backoff
+                std::deque<detail::queued_request> failed;
+                {
+                    std::unique_lock lock {self->pool_mutex_};
+                    if (self->closing_)
+                        return;
+                    if (not self->any_open())
+                        failed.swap(self->waiting_);
+                }
+
+                for (detail::queued_request& q : failed)
+                    q.job->cancel();
+
+                self->start_reconnect(slot, backoff);
+            });
+    }
+
+    void start_reconnect(std::size_t const slot, std::chrono::milliseconds const backoff)
+    {
+        auto timer = std::make_shared<boost::asio::steady_timer>(io_context_, backoff);
+        timer->async_wait(
+            [weak=weak_from_this(), timer, slot, backoff] (boost::system::error_code const& ec) {
+                std::shared_ptr<ssbd> self = weak.lock();
+                if (ec or not self)
+                    return;
+
+                {
+                    std::shared_lock lock {self->pool_mutex_};
+                    if (self->closing_)
+                        return;
+                }
+                self->start_connect(slot, std::min(backoff * 2, max_backoff));
+            });
+    }
+
+    void on_connected(std::size_t const slot, std::shared_ptr<detail::connection> conn)
+    {
+        log::log("ssbd backend: connection {} to {} open", slot, boost::lexical_cast<std::string>(endpoint_));
+
+        std::deque<detail::queued_request> waiting;
+        {
+            std::unique_lock lock {pool_mutex_};
+            if (closing_)
+            {
+                lock.unlock();
+                conn->close();
+                return;
+            }
+
+            connections_.at(slot) = conn;
+            waiting.swap(waiting_);
+        }
+
+        for (detail::queued_request& q : waiting)
+            start_send_job(std::move(q));
+    }
+
+    void on_closed(std::size_t const slot, std::vector<detail::job_ptr> jobs)
+    {
+        bool closing = false;
+        {
+            std::shared_lock lock {pool_mutex_};
+            closing = closing_;
+        }
+
+        for (detail::job_ptr const& j : jobs)
+            if (not closing and detail::repeatable(j->request()->header.type))
+                start_send_job({j->request(), j});
+            else
+                j->cancel();
+
+        if (not closing)
+            start_reconnect(slot, min_backoff);
     }
 
 public:
-    ssbd(boost::asio::io_context& io, std::string const& host, std::string const& port):
-        io_context_{io}, socket_(io),
+    ssbd(boost::asio::io_context& io, std::string const& host, std::string const& port,
+         std::size_t const connections = 4):
+        io_context_{io},
         endpoint_{boost::asio::ip::make_address_v4(host), static_cast<std::uint16_t>(std::stoi(port))},
-        writer_{io, socket_} {}
+        pool_size_{std::max<std::size_t>(connections, 1)} {}
 
     using handler     = std::function<void(base::buf)>;
     using handler_ptr = std::shared_ptr<handler>;
 
+    // returns at once; requests sent before a connection opens wait for it
     void connect()
     {
-        log::log("connect to {}", boost::lexical_cast<std::string>(endpoint_));
-
-        try {
-            socket_.connect(endpoint_);
-        } catch (boost::exception & e) {
-            using host_endpoint = boost::error_info<struct ssbd_connect_host, boost::asio::ip::tcp::endpoint>;
-            e << host_endpoint{endpoint_};
-            throw;
+        log::log("connect to {} with {} connections", boost::lexical_cast<std::string>(endpoint_), pool_size_);
+        {
+            std::unique_lock lock {pool_mutex_};
+            closing_ = false;
+            connections_.assign(pool_size_, nullptr);
         }
+
+        for (std::size_t slot = 0; slot < pool_size_; slot++)
+            start_connect(slot, min_backoff);
     }
 
     void close()
     {
-        socket_.close();
-        for (auto &job : outstanding_jobs_)
-            job.second->cancel();
+        std::vector<std::shared_ptr<detail::connection>> connections;
+        std::deque<detail::queued_request> waiting;
+        {
+            std::unique_lock lock {pool_mutex_};
+            closing_ = true;
+            connections.swap(connections_);
+            waiting.swap(waiting_);
+        }
+
+        for (std::shared_ptr<detail::connection>& c : connections)
+            if (c)
+                c->close();
+        for (detail::queued_request& q : waiting)
+            q.job->cancel();
+    }
+
+    struct queue_stat
+    {
+        std::uint64_t queued;     // requests that waited for credits
+        std::uint64_t total_ns;
+        std::uint64_t max_ns;
+    };
+
+    auto queue_stats() const -> queue_stat {
+        return {stats_->queued_count.load(), stats_->queue_time_ns.load(), stats_->max_queue_time_ns.load()};
+    }
+
+    auto outstanding() const -> int { return stats_->outstanding.load(); }
+
+    // zero until the first response
+    auto latency_ewma() const -> std::chrono::nanoseconds {
+        return std::chrono::nanoseconds{stats_->latency_ewma_ns.load()};
     }
 
     void start_send_request (leveldb_pack::packet_pointer request,
                              std::function<void(leveldb_pack::packet_pointer)> on_response)
     {
         log::log("ssbd backend start_send_request: {}", request->header.print());
-        detail::job_ptr newjob = std::make_shared<detail::job>(request, on_response);
-
-        [[maybe_unused]]
-        bool ok = outstanding_jobs_.emplace(request->header, newjob);
-        assert(ok);
-
-        auto next = std::make_shared<socket_writer::boost_callback>(
-            [this, request, newjob]
-            (boost::system::error_code const& ec, std::size_t) {
-                newjob->mark_started();
-                if (ec)
-                {
-                    log::log<log::level::error>("error {} on {}; start_send_request: {}",
-                             ec.message(), boost::lexical_cast<std::string>(endpoint_), request->header.print());
-                    newjob->cancel();
-                    return;
-                }
-                start_read_loop();
+        stats_->outstanding++;
+        detail::job_ptr newjob = std::make_shared<detail::job>(
+            request,
+            [stats=stats_, on_response] (leveldb_pack::packet_pointer resp) {
+                stats->outstanding--;
+                on_response(resp);
             });
 
-        switch (request->header.type)
-        {
-        case leveldb_pack::msg_t::get:
-            // read request use header size as data size to read
-            writer_.start_write_socket(request, next, request->serialize_header());
-            break;
-        default:
-            writer_.start_write_socket(request, next);
-        }
+        start_send_job({request, newjob});
     }
 };
 
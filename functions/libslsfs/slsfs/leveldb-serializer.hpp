@@ -48,6 +48,9 @@ enum class msg_t: std::uint16_t
     err = 0b00000000,
     ack = 0b00000001,
     get = 0b00000010,
+    get_range = 0b00000011,
+    get_replica       = 0b00000100, // get / get_range on the replica chain copy
+    get_range_replica = 0b00000101,
     two_pc_prepare         = 0b00001000,
     two_pc_prepare_quick   = 0b00001001,
     two_pc_prepare_agree   = 0b00001010,
@@ -56,6 +59,15 @@ enum class msg_t: std::uint16_t
     two_pc_commit_rollback = 0b00001101,
     two_pc_commit_ack      = 0b00001110,
     replication            = 0b00001111,
+    two_pc_prepare_batch         = 0b00011000,
+    two_pc_prepare_quick_batch   = 0b00011001,
+    two_pc_commit_execute_batch  = 0b00011100,
+    two_pc_commit_rollback_batch = 0b00011101,
+    replication_batch            = 0b00011111,
+    file_stat     = 0b00100000,
+    file_truncate = 0b00100001,
+    file_delete   = 0b00100010,
+    credit        = 0b01000000,
 };
 
 auto operator << (std::ostream &os, msg_t const& msg) -> std::ostream&
@@ -71,6 +83,15 @@ auto operator << (std::ostream &os, msg_t const& msg) -> std::ostream&
     case msg_t::get:
         os << "GET";
         break;
+    case msg_t::get_range:
+        os << "GETRG";
+        break;
+    case msg_t::get_replica:
+        os << "GETRP";
+        break;
+    case msg_t::get_range_replica:
+        os << "GETRR";
+        break;
     case msg_t::two_pc_prepare:
         os << "2PPPR";
         break;
@@ -95,6 +116,33 @@ auto operator << (std::ostream &os, msg_t const& msg) -> std::ostream&
     case msg_t::replication:
         os << "REPLI";
         break;
+    case msg_t::two_pc_prepare_batch:
+        os << "2PPRB";
+        break;
+    case msg_t::two_pc_prepare_quick_batch:
+        os << "2PPQB";
+        break;
+    case msg_t::two_pc_commit_execute_batch:
+        os << "2CEXB";
+        break;
+    case msg_t::two_pc_commit_rollback_batch:
+        os << "2CROB";
+        break;
+    case msg_t::replication_batch:
+        os << "REPLB";
+        break;
+    case msg_t::file_stat:
+        os << "FSTAT";
+        break;
+    case msg_t::file_truncate:
+        os << "FTRUN";
+        break;
+    case msg_t::file_delete:
+        os << "FDELE";
+        break;
+    case msg_t::credit:
+        os << "CREDT";
+        break;
     }
 
     //using under_t = std::underlying_type<msg_t>::type;
@@ -161,11 +209,15 @@ struct packet_header
         sizeof(version) +
         sizeof(salt);
 
-    auto as_string() -> std::string
+    static constexpr int key_size = std::tuple_size<decltype(uuid)>::value + sizeof(blockid);
+
+    // |uuid|blockid (big endian)|: fixed width, and the blocks of a file sort by blockid
+    auto as_string() const -> std::string
     {
-        std::string key;
-        std::copy(uuid.begin(), uuid.end(), std::back_inserter(key));
-        key += std::to_string(blockid);
+        std::string key(key_size, '\0');
+        std::memcpy(key.data(), uuid.data(), uuid.size());
+        decltype(blockid) const blockid_copy = hton(blockid);
+        std::memcpy(key.data() + uuid.size(), std::addressof(blockid_copy), sizeof(blockid_copy));
         return key;
     }
 
@@ -314,6 +366,225 @@ auto operator << (std::ostream &os, packet_header const& pd) -> std::ostream&
     return os;
 }
 
+// body of a get_range request. header.blockid is the first block,
+// header.position the offset inside it
+struct range_request
+{
+    std::uint32_t length;
+    std::uint32_t blocksize;
+
+    static constexpr int bytesize = sizeof(length) + sizeof(blocksize);
+
+    void parse(unit_t const *pos)
+    {
+        std::memcpy(std::addressof(length), pos, sizeof(length));
+        pos += sizeof(length);
+        length = ntoh(length);
+
+        std::memcpy(std::addressof(blocksize), pos, sizeof(blocksize));
+        pos += sizeof(blocksize);
+        blocksize = ntoh(blocksize);
+    }
+
+    auto dump(unit_t *pos) -> unit_t*
+    {
+        decltype(length) length_copy = hton(length);
+        std::memcpy(pos, std::addressof(length_copy), sizeof(length_copy));
+        pos += sizeof(length_copy);
+
+        decltype(blocksize) blocksize_copy = hton(blocksize);
+        std::memcpy(pos, std::addressof(blocksize_copy), sizeof(blocksize_copy));
+        pos += sizeof(blocksize_copy);
+        return pos;
+    }
+};
+
+// a get_range response body is a list of |blockid|size|data (size bytes)|,
+// one for each block that exists
+struct range_frame
+{
+    std::uint32_t blockid;
+    std::uint32_t size;
+
+    static constexpr int bytesize = sizeof(blockid) + sizeof(size);
+
+    void parse(unit_t const *pos)
+    {
+        std::memcpy(std::addressof(blockid), pos, sizeof(blockid));
+        pos += sizeof(blockid);
+        blockid = ntoh(blockid);
+
+        std::memcpy(std::addressof(size), pos, sizeof(size));
+        pos += sizeof(size);
+        size = ntoh(size);
+    }
+
+    auto dump(unit_t *pos) -> unit_t*
+    {
+        decltype(blockid) blockid_copy = hton(blockid);
+        std::memcpy(pos, std::addressof(blockid_copy), sizeof(blockid_copy));
+        pos += sizeof(blockid_copy);
+
+        decltype(size) size_copy = hton(size);
+        std::memcpy(pos, std::addressof(size_copy), sizeof(size_copy));
+        pos += sizeof(size_copy);
+        return pos;
+    }
+};
+
+// one block of a *_batch request: |blockid|position|size|data (size bytes)|
+// commit / rollback batches carry no data. in two_pc_commit_execute_batch and
+// replication_batch the packet header's position is the number of replicas
+// down the chain that still have to apply the write
+struct batch_entry
+{
+    std::uint32_t blockid;
+    std::uint16_t position;
+    std::uint32_t size;
+
+    static constexpr int bytesize = sizeof(blockid) + sizeof(position) + sizeof(size);
+
+    void parse(unit_t const *pos)
+    {
+        std::memcpy(std::addressof(blockid), pos, sizeof(blockid));
+        pos += sizeof(blockid);
+        blockid = ntoh(blockid);
+
+        std::memcpy(std::addressof(position), pos, sizeof(position));
+        pos += sizeof(position);
+        position = ntoh(position);
+
+        std::memcpy(std::addressof(size), pos, sizeof(size));
+        pos += sizeof(size);
+        size = ntoh(size);
+    }
+
+    auto dump(unit_t *pos) -> unit_t*
+    {
+        decltype(blockid) blockid_copy = hton(blockid);
+        std::memcpy(pos, std::addressof(blockid_copy), sizeof(blockid_copy));
+        pos += sizeof(blockid_copy);
+
+        decltype(position) position_copy = hton(position);
+        std::memcpy(pos, std::addressof(position_copy), sizeof(position_copy));
+        pos += sizeof(position_copy);
+
+        decltype(size) size_copy = hton(size);
+        std::memcpy(pos, std::addressof(size_copy), sizeof(size_copy));
+        pos += sizeof(size_copy);
+        return pos;
+    }
+};
+
+// body of file_stat / file_truncate / file_delete: they cover blocks [header.blockid, last]
+// of the file. file_truncate keeps the first header.position bytes of header.blockid
+// and removes the blocks after it; file_delete also drops the 2pc records
+struct block_range
+{
+    std::uint32_t last;
+
+    static constexpr int bytesize = sizeof(last);
+
+    void parse(unit_t const *pos)
+    {
+        std::memcpy(std::addressof(last), pos, sizeof(last));
+        pos += sizeof(last);
+        last = ntoh(last);
+    }
+
+    auto dump(unit_t *pos) -> unit_t*
+    {
+        decltype(last) last_copy = hton(last);
+        std::memcpy(pos, std::addressof(last_copy), sizeof(last_copy));
+        pos += sizeof(last_copy);
+        return pos;
+    }
+};
+
+// file_stat response body, over the blocks this ssbd holds in the range
+struct file_stat
+{
+    std::uint32_t block_count;
+    std::uint32_t last_blockid;
+    std::uint32_t last_size; // bytes in last_blockid
+    versionint_t  version;   // newest committed version
+
+    static constexpr int bytesize = sizeof(block_count) + sizeof(last_blockid) + sizeof(last_size) + sizeof(version);
+
+    void parse(unit_t const *pos)
+    {
+        std::memcpy(std::addressof(block_count), pos, sizeof(block_count));
+        pos += sizeof(block_count);
+        block_count = ntoh(block_count);
+
+        std::memcpy(std::addressof(last_blockid), pos, sizeof(last_blockid));
+        pos += sizeof(last_blockid);
+        last_blockid = ntoh(last_blockid);
+
+        std::memcpy(std::addressof(last_size), pos, sizeof(last_size));
+        pos += sizeof(last_size);
+        last_size = ntoh(last_size);
+
+        std::memcpy(std::addressof(version), pos, sizeof(version));
+        pos += sizeof(version);
+        version = ntoh(version);
+    }
+
+    auto dump(unit_t *pos) -> unit_t*
+    {
+        decltype(block_count) block_count_copy = hton(block_count);
+        std::memcpy(pos, std::addressof(block_count_copy), sizeof(block_count_copy));
+        pos += sizeof(block_count_copy);
+
+        decltype(last_blockid) last_blockid_copy = hton(last_blockid);
+        std::memcpy(pos, std::addressof(last_blockid_copy), sizeof(last_blockid_copy));
+        pos += sizeof(last_blockid_copy);
+
+        decltype(last_size) last_size_copy = hton(last_size);
+        std::memcpy(pos, std::addressof(last_size_copy), sizeof(last_size_copy));
+        pos += sizeof(last_size_copy);
+
+        decltype(version) version_copy = hton(version);
+        std::memcpy(pos, std::addressof(version_copy), sizeof(version_copy));
+        pos += sizeof(version_copy);
+        return pos;
+    }
+};
+
+// credit response body: the in-flight window the ssbd grants one connection.
+// a client keeps at most ops requests and bytes request bytes outstanding, and
+// queues the rest on its side; the ssbd stops reading a connection past ops
+struct credit_grant
+{
+    std::uint32_t ops;
+    std::uint32_t bytes;
+
+    static constexpr int bytesize = sizeof(ops) + sizeof(bytes);
+
+    void parse(unit_t const *pos)
+    {
+        std::memcpy(std::addressof(ops), pos, sizeof(ops));
+        pos += sizeof(ops);
+        ops = ntoh(ops);
+
+        std::memcpy(std::addressof(bytes), pos, sizeof(bytes));
+        pos += sizeof(bytes);
+        bytes = ntoh(bytes);
+    }
+
+    auto dump(unit_t *pos) -> unit_t*
+    {
+        decltype(ops) ops_copy = hton(ops);
+        std::memcpy(pos, std::addressof(ops_copy), sizeof(ops_copy));
+        pos += sizeof(ops_copy);
+
+        decltype(bytes) bytes_copy = hton(bytes);
+        std::memcpy(pos, std::addressof(bytes_copy), sizeof(bytes_copy));
+        pos += sizeof(bytes_copy);
+        return pos;
+    }
+};
+
 struct packet_data
 {
     buffer_t buf;
@@ -358,7 +629,8 @@ struct packet
            std::size_t         const  location,
            std::size_t         const  size)
     {
-        header.gen();
+        // the connection sending it puts its request id here; no random salt per packet
+        header.salt.fill(0);
 
         header.type     = type;
         header.version  = version;
@@ -170,6 +170,46 @@ auto read (std::string const filename, std::uint32_t const size)
     return read(uuid::get_uuid(filename), size);
 }
 
+// stat, truncate (to size) or remove a whole file
+auto fileop (pack::key_t const& filename, jsre::file_operation_t const op, std::uint32_t const size = 0)
+    -> pack::packet_pointer
+{
+    pack::packet_pointer ptr = std::make_shared<pack::packet>();
+
+    ptr->header.type = pack::msg_t::trigger;
+    ptr->header.key = filename;
+
+    jsre::request r {
+        .type = jsre::type_t::fileop,
+        .operation = static_cast<jsre::operation_t>(op),
+        .position = size,
+        .size = 0,
+    };
+    r.to_network_format();
+
+    ptr->data.buf.resize(sizeof (r));
+    std::memcpy(ptr->data.buf.data(), &r, sizeof (r));
+
+    ptr->header.gen();
+    BOOST_LOG_TRIVIAL(debug) << "creating fileop request " << ptr->header;
+    return ptr;
+}
+
+auto stat (std::string const filename)
+    -> pack::packet_pointer {
+    return fileop(uuid::get_uuid(filename), jsre::file_operation_t::stat);
+}
+
+auto truncate (std::string const filename, std::uint32_t const size)
+    -> pack::packet_pointer {
+    return fileop(uuid::get_uuid(filename), jsre::file_operation_t::truncate, size);
+}
+
+auto remove (std::string const filename)
+    -> pack::packet_pointer {
+    return fileop(uuid::get_uuid(filename), jsre::file_operation_t::remove);
+}
+
 } // namespace client::packat_create
 
 #endif // CLIENT_CLIENTLIB_PACKET_CREATE_HPP__
@@ -47,6 +47,28 @@ struct filemeta
     }
 };
 
+// response of a fileop stat
+struct filestat
+{
+    std::uint32_t size = 0; // byte
+    std::uint32_t block_count = 0;
+    std::uint32_t version = 0; // newest committed version of any block
+
+    void to_network_format()
+    {
+        size        = slsfs::pack::hton(size);
+        block_count = slsfs::pack::hton(block_count);
+        version     = slsfs::pack::hton(version);
+    }
+
+    void to_host_format()
+    {
+        size        = slsfs::pack::ntoh(size);
+        block_count = slsfs::pack::ntoh(block_count);
+        version     = slsfs::pack::ntoh(version);
+    }
+};
+
 } // namespace meta
 
 enum class type_t : std::int8_t
@@ -55,6 +77,7 @@ enum class type_t : std::int8_t
     metadata,
     wakeup,
     storagetest,
+    fileop,
 };
 
 enum class operation_t : std::int8_t
@@ -70,6 +93,14 @@ enum class meta_operation_t : std::int8_t
     mkdir,
 };
 
+// type_t::fileop. truncate takes the new size in position
+enum class file_operation_t : std::int8_t
+{
+    stat,
+    truncate,
+    remove,
+};
+
 using key_t = pack::key_t;
 
 struct request
@@ -146,6 +177,10 @@ struct request_parser
         return static_cast<meta_operation_t>(operation());
     }
 
+    auto file_operation() const -> file_operation_t {
+        return static_cast<file_operation_t>(operation());
+    }
+
     auto position() const -> std::uint32_t
     {
         std::uint32_t pos;
@@ -7,6 +7,9 @@
 
 #include <oneapi/tbb/concurrent_queue.h>
 
+#include <algorithm>
+#include <vector>
+
 namespace slsfs::socket_writer
 {
 
@@ -26,55 +29,82 @@ namespace v1
 template<typename Packet, typename BufType>
 class socket_writer
 {
+    using job_type = write_job<Packet, BufType>;
+
     boost::asio::io_context & io_context_;
     boost::asio::io_context::strand write_io_strand_;
-    oneapi::tbb::concurrent_queue<write_job<Packet, BufType>> write_queue_;
+    oneapi::tbb::concurrent_queue<job_type> write_queue_;
     boost::asio::ip::tcp::socket& socket_;
     std::atomic<bool> is_writing_ = false;
 
-    void start_write_one_packet()
+    // one gathered write takes at most this many queued packets / bytes
+    std::size_t const max_gather_jobs_;
+    std::size_t const max_gather_bytes_;
+
+    void start_write_packets()
     {
-        write_job<Packet, BufType> job;
-        if (not write_queue_.try_pop(job))
-            is_writing_.store(false);
-        else
+        auto jobs = std::make_shared<std::vector<job_type>>();
+        std::vector<boost::asio::const_buffer> buffers;
+        std::size_t bytes = 0;
+
+        job_type job;
+        while (jobs->size() < max_gather_jobs_ and bytes < max_gather_bytes_ and write_queue_.try_pop(job))
         {
             if (job.bufptr == nullptr)
                 job.bufptr = job.pack->serialize();
 
-            boost::asio::async_write(
-                socket_,
-                boost::asio::buffer(job.bufptr->data(), job.bufptr->size()),
-                boost::asio::bind_executor(
-                    write_io_strand_,
-                    [this, job] (boost::system::error_code ec, std::size_t transferred_size) {
-                        std::invoke(*job.next, ec, transferred_size);
-                        if (ec)
-                        {
-                            is_writing_.store(false);
-                            BOOST_LOG_TRIVIAL(error) << "socket writer error: " << ec.message();
-                            return;
-                        }
-
-                        start_write_one_packet();
-                    }));
+            buffers.emplace_back(job.bufptr->data(), job.bufptr->size());
+            bytes += job.bufptr->size();
+            jobs->push_back(std::move(job));
+        }
+
+        if (jobs->empty())
+        {
+            is_writing_.store(false);
+
+            // a writer on another thread may have pushed after try_pop() but
+            // seen is_writing_ still true; pick its packet up here
+            if (not write_queue_.empty() and not is_writing_.exchange(true))
+                start_write_packets();
+            return;
         }
+
+        // one scatter-gather write for every packet taken; all callbacks run when it completes
+        boost::asio::async_write(
+            socket_,
+            buffers,
+            boost::asio::bind_executor(
+                write_io_strand_,
+                [this, jobs] (boost::system::error_code ec, std::size_t /*transferred_size*/) {
+                    for (job_type const& done : *jobs)
+                        std::invoke(*done.next, ec, ec? 0 : done.bufptr->size());
+
+                    if (ec)
+                    {
+                        is_writing_.store(false);
+                        BOOST_LOG_TRIVIAL(error) << "socket writer error: " << ec.message();
+                        return;
+                    }
+
+                    start_write_packets();
+                }));
     }
 
 public:
-    socket_writer(boost::asio::io_context &io, boost::asio::ip::tcp::socket &s):
-        io_context_{io}, write_io_strand_{io}, socket_{s} {}
+    socket_writer(boost::asio::io_context &io, boost::asio::ip::tcp::socket &s,
+                  std::size_t const max_gather_jobs = 64,
+                  std::size_t const max_gather_bytes = 1024 * 1024):
+        io_context_{io}, write_io_strand_{io}, socket_{s},
+        max_gather_jobs_{std::max<std::size_t>(max_gather_jobs, 1)},
+        max_gather_bytes_{max_gather_bytes} {}
 
     void start_write_socket(std::shared_ptr<Packet> pack,
                             std::shared_ptr<boost_callback> next,
                             std::shared_ptr<BufType> bufptr = nullptr)
     {
         write_queue_.push(write_job(pack, bufptr, next));
-        if (not is_writing_)
-        {
-            is_writing_.store(true);
-            start_write_one_packet();
-        }
+        if (not is_writing_.exchange(true))
+            start_write_packets();
     }
 };
 
@@ -0,0 +1,629 @@
+#include "basic.hpp"
+#include "leveldb-serializer.hpp"
+#include "socket-writer.hpp"
+#include "framing-reader.hpp"
+#include "hdr-histogram.hpp"
+
+#include <boost/program_options.hpp>
+#include <boost/log/trivial.hpp>
+#include <boost/asio.hpp>
+#include <boost/json.hpp>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Open-loop load generator for one ssbd. Every connection draws Poisson arrivals at
+// rate / connections and keeps at most depth operations in flight; arrivals past the
+// depth wait in a local backlog. Latency runs from the intended arrival time, not
+// from the send, so a stalled server is charged for the requests it held back
+// (no coordinated omission). Prints a JSON report on stdout.
+//
+//   bench --host 127.0.0.1 --port 12000 --connections 64 --depth 16 --rate 200000
+//         --mix get=70,commit=20,prepare=5,replication=5 --dist zipf --duration 30
+
+namespace
+{
+
+using clock_type = std::chrono::steady_clock;
+using ssbd::tcp;
+namespace net  = ssbd::net;
+namespace pack = slsfs::leveldb_pack;
+
+enum class op_t : int { get = 0, prepare, commit, replication };
+constexpr int op_count = 4;
+constexpr std::array<char const*, op_count> op_names = {"get", "prepare", "commit", "replication"};
+
+struct config
+{
+    std::string host;
+    std::string port;
+    int connections;
+    int depth;
+    double rate;           // ops per second over all connections
+    std::chrono::nanoseconds duration;
+    std::chrono::nanoseconds warmup;
+    std::array<double, op_count> mix;
+    std::uint64_t keys;
+    double zipf_theta;     // 0 is uniform
+    std::size_t value_size;
+};
+
+// zipf over [0, n) by inverse cdf; the table is shared by all connections
+class key_chooser
+{
+    std::vector<double> cdf_;
+    std::uint64_t n_;
+
+public:
+    key_chooser(std::uint64_t const n, double const theta): n_{n}
+    {
+        if (theta <= 0)
+            return;
+
+        cdf_.resize(n);
+        double sum = 0;
+        for (std::uint64_t i = 0; i < n; i++)
+            cdf_[i] = (sum += 1.0 / std::pow(i + 1, theta));
+        for (double& c : cdf_)
+            c /= sum;
+    }
+
+    template<typename Gen>
+    auto operator() (Gen& gen) const -> std::uint64_t
+    {
+        if (cdf_.empty())
+            return std::uniform_int_distribution<std::uint64_t>(0, n_ - 1)(gen);
+
+        double const u = std::uniform_real_distribution<double>(0, 1)(gen);
+        return std::min<std::uint64_t>(std::lower_bound(cdf_.begin(), cdf_.end(), u) - cdf_.begin(), n_ - 1);
+    }
+};
+
+struct op_stat
+{
+    ssbd::hdr_histogram latency;  // ns, from the intended arrival
+    ssbd::hdr_histogram service;  // ns, from the first send
+    std::uint64_t errors = 0;
+    std::uint64_t aborts = 0;     // prepare answered with abort
+
+    void merge(op_stat const& other)
+    {
+        latency.merge(other.latency);
+        service.merge(other.service);
+        errors += other.errors;
+        aborts += other.aborts;
+    }
+};
+
+class connection : public std::enable_shared_from_this<connection>
+{
+    struct operation
+    {
+        op_t type;
+        clock_type::time_point intended;
+        clock_type::time_point sent;
+        pack::packet_header header;
+        bool recorded;
+    };
+    using operation_ptr = std::shared_ptr<operation>;
+    using callback = std::function<void(pack::packet_pointer)>;
+
+    config const& conf_;
+    key_chooser const& keys_;
+    clock_type::time_point const start_, end_;
+
+    tcp::socket socket_;
+    slsfs::socket_writer::socket_writer<pack::packet, std::vector<pack::unit_t>> writer_;
+    slsfs::framing_reader::framing_reader<pack::packet_header, pack::buffer_t> reader_;
+    net::steady_timer timer_;
+    std::mt19937_64 gen_;
+    std::exponential_distribution<double> interarrival_;
+    std::discrete_distribution<int> mix_;
+
+    std::mutex mutex_;
+    std::uint32_t next_id_ = 0;
+    std::unordered_map<std::uint32_t, callback> waiting_; // by request id in the salt
+    std::deque<operation_ptr> backlog_;
+    int inflight_ = 0;
+    clock_type::time_point next_arrival_;
+    bool generating_ = true;
+
+    std::array<op_stat, op_count> stats_;
+    std::size_t max_backlog_ = 0;
+    std::uint64_t dropped_ = 0;
+
+    auto make_request(operation const& op, pack::msg_t const type) -> pack::packet_pointer
+    {
+        pack::packet_pointer request = std::make_shared<pack::packet>();
+        request->header = op.header;
+        request->header.type = type;
+
+        std::uint32_t id;
+        {
+            std::scoped_lock lock {mutex_};
+            id = next_id_++;
+        }
+        std::memcpy(request->header.salt.data(), &id, sizeof(id));
+        return request;
+    }
+
+    void send(pack::packet_pointer request, callback next)
+    {
+        std::uint32_t id;
+        std::memcpy(&id, request->header.salt.data(), sizeof(id));
+        {
+            std::scoped_lock lock {mutex_};
+            waiting_.emplace(id, std::move(next));
+        }
+
+        auto written = std::make_shared<slsfs::socket_writer::boost_callback>(
+            [self=shared_from_this(), id] (boost::system::error_code ec, std::size_t) {
+                if (not ec)
+                    return;
+                BOOST_LOG_TRIVIAL(error) << "bench write error: " << ec.message();
+                self->fail(id);
+            });
+
+        if (request->header.type == pack::msg_t::get)
+            writer_.start_write_socket(request, written, request->serialize_header());
+        else
+            writer_.start_write_socket(request, written);
+    }
+
+    void fail(std::uint32_t const id)
+    {
+        callback next;
+        {
+            std::scoped_lock lock {mutex_};
+            auto it = waiting_.find(id);
+            if (it == waiting_.end())
+                return;
+            next = std::move(it->second);
+            waiting_.erase(it);
+        }
+
+        pack::packet_pointer resp = std::make_shared<pack::packet>();
+        resp->header.type = pack::msg_t::err;
+        next(resp);
+    }
+
+    void on_response(pack::packet_header const& header, std::shared_ptr<pack::buffer_t> body)
+    {
+        std::uint32_t id;
+        std::memcpy(&id, header.salt.data(), sizeof(id));
+
+        callback next;
+        {
+            std::scoped_lock lock {mutex_};
+            auto it = waiting_.find(id);
+            if (it == waiting_.end())
+            {
+                BOOST_LOG_TRIVIAL(error) << "bench: response to unknown request " << header;
+                return;
+            }
+            next = std::move(it->second);
+            waiting_.erase(it);
+        }
+
+        pack::packet_pointer resp = std::make_shared<pack::packet>();
+        resp->header = header;
+        resp->data.buf = std::move(*body);
+        next(resp);
+    }
+
+    // runs the steps of one operation; finish() is called exactly once at its end
+    void start(operation_ptr op)
+    {
+        op->sent = clock_type::now();
+        switch (op->type)
+        {
+        case op_t::get:
+        {
+            pack::packet_pointer request = make_request(*op, pack::msg_t::get);
+            request->header.datasize = conf_.value_size;
+            send(request,
+                 [self=shared_from_this(), op] (pack::packet_pointer resp) {
+                     self->finish(op, resp->header.type != pack::msg_t::err, false);
+                 });
+            break;
+        }
+
+        case op_t::prepare:
+        case op_t::commit:
+        {
+            // prepare, then commit it or roll it back; prepare alone measures the abort-free vote
+            pack::packet_pointer request = make_request(*op, pack::msg_t::two_pc_prepare);
+            request->data.buf.assign(conf_.value_size, 0x5a);
+            send(request,
+                 [self=shared_from_this(), op] (pack::packet_pointer resp) {
+                     if (resp->header.type == pack::msg_t::two_pc_prepare_abort)
+                     {
+                         self->finish(op, true, true);
+                         return;
+                     }
+                     if (resp->header.type != pack::msg_t::two_pc_prepare_agree)
+                     {
+                         self->finish(op, false, false);
+                         return;
+                     }
+
+                     pack::msg_t const second = (op->type == op_t::commit)?
+                         pack::msg_t::two_pc_commit_execute : pack::msg_t::two_pc_commit_rollback;
+                     self->send(self->make_request(*op, second),
+                                [self, op] (pack::packet_pointer resp) {
+                                    self->finish(op, resp->header.type == pack::msg_t::two_pc_commit_ack, false);
+                                });
+                 });
+            break;
+        }
+
+        case op_t::replication:
+        {
+            pack::packet_pointer request = make_request(*op, pack::msg_t::replication);
+            request->data.buf.assign(conf_.value_size, 0x5a);
+            send(request,
+                 [self=shared_from_this(), op] (pack::packet_pointer resp) {
+                     self->finish(op, resp->header.type == pack::msg_t::ack, false);
+                 });
+            break;
+        }
+        }
+    }
+
+    void finish(operation_ptr op, bool const ok, bool const aborted)
+    {
+        clock_type::time_point const now = clock_type::now();
+        operation_ptr next = nullptr;
+        {
+            std::scoped_lock lock {mutex_};
+            if (op->recorded)
+            {
+                op_stat& stat = stats_.at(static_cast<int>(op->type));
+                if (not ok)
+                    stat.errors++;
+                else if (aborted)
+                    stat.aborts++;
+                else
+                {
+                    stat.latency.record(std::chrono::duration_cast<std::chrono::nanoseconds>(now - op->intended).count());
+                    stat.service.record(std::chrono::duration_cast<std::chrono::nanoseconds>(now - op->sent).count());
+                }
+            }
+
+            if (backlog_.empty())
+                inflight_--;
+            else
+            {
+                next = backlog_.front();
+                backlog_.pop_front();
+            }
+        }
+
+        if (next)
+            start(next);
+    }
+
+    auto new_operation(clock_type::time_point const intended) -> operation_ptr
+    {
+        auto op = std::make_shared<operation>();
+        op->type = static_cast<op_t>(mix_(gen_));
+        op->intended = intended;
+        op->recorded = intended >= start_ + conf_.warmup;
+
+        std::uint64_t const key = keys_(gen_);
+        op->header.uuid.fill(0);
+        std::memcpy(op->header.uuid.data(), &key, sizeof(key));
+        op->header.blockid = 0;
+        op->header.position = 0;
+        op->header.version = static_cast<pack::versionint_t>(intended.time_since_epoch().count() >> 10);
+        return op;
+    }
+
+    // issues every arrival that is due, then sleeps until the next one
+    void start_arrivals()
+    {
+        clock_type::time_point const now = clock_type::now();
+        std::vector<operation_ptr> ready;
+        {
+            std::scoped_lock lock {mutex_};
+            while (next_arrival_ <= now and next_arrival_ < end_)
+            {
+                operation_ptr op = new_operation(next_arrival_);
+                if (inflight_ < conf_.depth)
+                {
+                    inflight_++;
+                    ready.push_back(op);
+                }
+                else
+                {
+                    backlog_.push_back(op);
+                    max_backlog_ = std::max(max_backlog_, backlog_.size());
+                }
+
+                next_arrival_ += std::chrono::nanoseconds(static_cast<std::int64_t>(interarrival_(gen_)));
+            }
+
+            if (next_arrival_ >= end_)
+                generating_ = false;
+        }
+
+        for (operation_ptr& op : ready)
+            start(op);
+
+        if (not generating_)
+            return;
+
+        timer_.expires_at(next_arrival_);
+        timer_.async_wait(
+            [self=shared_from_this()] (boost::system::error_code const& ec) {
+                if (not ec)
+                    self->start_arrivals();
+            });
+    }
+
+public:
+    connection(net::io_context& io, config const& conf, key_chooser const& keys,
+               clock_type::time_point const start, std::uint64_t const seed):
+        conf_{conf}, keys_{keys}, start_{start}, end_{start + conf.duration},
+        socket_{io},
+        writer_{io, socket_},
+        reader_{socket_,
+                [] (pack::packet_header const& header) -> std::size_t { return header.datasize; },
+                [] (pack::packet_header const&, std::size_t const size) {
+                    return std::make_shared<pack::buffer_t>(size);
+                },
+                [this] (pack::packet_header const& header, std::shared_ptr<pack::buffer_t> body) {
+                    on_response(header, std::move(body));
+                },
+                [] (boost::system::error_code const& ec) {
+                    if (ec != net::error::eof and ec != net::error::operation_aborted)
+                        BOOST_LOG_TRIVIAL(error) << "bench read error: " << ec.message();
+                }},
+        timer_{io},
+        gen_{seed},
+        interarrival_{conf.rate / conf.connections / 1e9},
+        mix_{conf.mix.begin(), conf.mix.end()},
+        next_arrival_{start} {}
+
+    void connect(tcp::resolver::results_type const& endpoints)
+    {
+        net::connect(socket_, endpoints);
+        socket_.set_option(tcp::no_delay(true));
+    }
+
+    void run()
+    {
+        reader_.start_read(shared_from_this());
+        start_arrivals();
+    }
+
+    bool done()
+    {
+        std::scoped_lock lock {mutex_};
+        return not generating_ and inflight_ == 0;
+    }
+
+    // requests never answered; counted as errors of their operation
+    auto give_up() -> std::uint64_t
+    {
+        std::scoped_lock lock {mutex_};
+        dropped_ = waiting_.size() + backlog_.size();
+        return dropped_;
+    }
+
+    void close()
+    {
+        boost::system::error_code ec;
+        timer_.cancel();
+        socket_.shutdown(tcp::socket::shutdown_both, ec);
+        socket_.close(ec);
+    }
+
+    void collect(std::array<op_stat, op_count>& stats, std::size_t& max_backlog)
+    {
+        std::scoped_lock lock {mutex_};
+        for (int i = 0; i < op_count; i++)
+            stats[i].merge(stats_[i]);
+        max_backlog = std::max(max_backlog, max_backlog_);
+    }
+};
+
+auto parse_mix(std::string const& spec) -> std::array<double, op_count>
+{
+    std::array<double, op_count> mix {};
+    std::stringstream ss {spec};
+    std::string item;
+    while (std::getline(ss, item, ','))
+    {
+        std::size_t const eq = item.find('=');
+        if (eq == std::string::npos)
+            throw std::runtime_error("mix entry needs name=weight, got " + item);
+
+        std::string const name = item.substr(0, eq);
+        auto it = std::find(op_names.begin(), op_names.end(), name);
+        if (it == op_names.end())
+            throw std::runtime_error("unknown operation in mix: " + name);
+        mix.at(it - op_names.begin()) = std::stod(item.substr(eq + 1));
+    }
+
+    if (std::all_of(mix.begin(), mix.end(), [](double w) { return w <= 0; }))
+        throw std::runtime_error("mix has no operation");
+    return mix;
+}
+
+auto to_json(ssbd::hdr_histogram const& h) -> boost::json::object
+{
+    auto us = [] (double ns) { return ns / 1000.0; };
+    return {
+        {"count", h.count()},
+        {"min",   us(h.min())},
+        {"mean",  us(h.mean())},
+        {"p50",   us(h.value_at_percentile(50))},
+        {"p90",   us(h.value_at_percentile(90))},
+        {"p99",   us(h.value_at_percentile(99))},
+        {"p999",  us(h.value_at_percentile(99.9))},
+        {"p9999", us(h.value_at_percentile(99.99))},
+        {"max",   us(h.max())},
+    };
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    ssbd::basic::init_log();
+
+    namespace po = boost::program_options;
+    po::options_description desc{"Options"};
+    desc.add_options()
+        ("help,h", "Print this help messages")
+        ("host",        po::value<std::string>()->default_value("127.0.0.1"),       "ssbd host")
+        ("port,p",      po::value<std::string>()->default_value("12000"),           "ssbd port")
+        ("connections", po::value<int>()->default_value(16),                        "connections to the ssbd")
+        ("depth",       po::value<int>()->default_value(16),                        "operations in flight per connection (pipelining depth)")
+        ("rate",        po::value<double>()->default_value(10000),                  "offered operations per second, over all connections")
+        ("duration",    po::value<double>()->default_value(10),                     "seconds to generate load")
+        ("warmup",      po::value<double>()->default_value(1),                      "seconds at the start left out of the report")
+        ("mix",         po::value<std::string>()->default_value("get=50,commit=40,replication=10"), "operation weights: get, prepare (prepare + rollback), commit (prepare + commit), replication")
+        ("keys",        po::value<std::uint64_t>()->default_value(100000),          "distinct blocks")
+        ("dist",        po::value<std::string>()->default_value("uniform"),         "key distribution: uniform | zipf")
+        ("zipf-theta",  po::value<double>()->default_value(0.99),                   "skew of the zipf distribution")
+        ("value-size",  po::value<std::size_t>()->default_value(4096),              "bytes read or written per operation")
+        ("threads",     po::value<int>()->default_value(std::thread::hardware_concurrency()), "io threads")
+        ("drain",       po::value<double>()->default_value(10),                     "seconds to wait for outstanding operations after the run")
+        ("seed",        po::value<std::uint64_t>()->default_value(std::random_device{}()), "random seed");
+    po::variables_map vm;
+    po::store(po::command_line_parser(argc, argv).options(desc).run(), vm);
+    po::notify(vm);
+
+    if (vm.count("help"))
+    {
+        BOOST_LOG_TRIVIAL(info) << desc;
+        return EXIT_SUCCESS;
+    }
+
+    auto seconds = [] (double s) { return std::chrono::nanoseconds(static_cast<std::int64_t>(s * 1e9)); };
+
+    config conf;
+    conf.host        = vm["host"].as<std::string>();
+    conf.port        = vm["port"].as<std::string>();
+    conf.connections = std::max(1, vm["connections"].as<int>());
+    conf.depth       = std::max(1, vm["depth"].as<int>());
+    conf.rate        = std::max(1.0, vm["rate"].as<double>());
+    conf.duration    = seconds(vm["duration"].as<double>());
+    conf.warmup      = seconds(vm["warmup"].as<double>());
+    conf.mix         = parse_mix(vm["mix"].as<std::string>());
+    conf.keys        = std::max<std::uint64_t>(1, vm["keys"].as<std::uint64_t>());
+    conf.zipf_theta  = vm["dist"].as<std::string>() == "zipf" ? vm["zipf-theta"].as<double>() : 0;
+    conf.value_size  = vm["value-size"].as<std::size_t>();
+    int const threads = std::max(1, vm["threads"].as<int>());
+    std::uint64_t const seed = vm["seed"].as<std::uint64_t>();
+
+    key_chooser const keys {conf.keys, conf.zipf_theta};
+
+    ssbd::net::io_context ioc {threads};
+    auto work = ssbd::net::make_work_guard(ioc);
+    ssbd::tcp::resolver resolver {ioc};
+    auto const endpoints = resolver.resolve(conf.host, conf.port);
+
+    clock_type::time_point const start = clock_type::now() + std::chrono::milliseconds{100};
+    std::vector<std::shared_ptr<connection>> connections;
+    for (int i = 0; i < conf.connections; i++)
+    {
+        connections.push_back(std::make_shared<connection>(ioc, conf, keys, start, seed + i));
+        connections.back()->connect(endpoints);
+    }
+
+    std::vector<std::thread> pool;
+    for (int i = 0; i < threads; i++)
+        pool.emplace_back([&ioc] { ioc.run(); });
+
+    for (std::shared_ptr<connection>& c : connections)
+        c->run();
+
+    std::this_thread::sleep_until(start + conf.duration);
+    clock_type::time_point const drain_end = clock_type::now() + seconds(vm["drain"].as<double>());
+    while (clock_type::now() < drain_end and
+           not std::all_of(connections.begin(), connections.end(), [](auto& c) { return c->done(); }))
+        std::this_thread::sleep_for(std::chrono::milliseconds{10});
+
+    std::uint64_t unanswered = 0;
+    std::array<op_stat, op_count> stats;
+    std::size_t max_backlog = 0;
+    for (std::shared_ptr<connection>& c : connections)
+    {
+        unanswered += c->give_up();
+        c->close();
+        c->collect(stats, max_backlog);
+    }
+
+    work.reset();
+    ioc.stop();
+    for (std::thread& th : pool)
+        th.join();
+
+    double const measured_seconds = std::chrono::duration<double>(conf.duration - conf.warmup).count();
+    boost::json::object ops, all;
+    ssbd::hdr_histogram total;
+    std::uint64_t total_errors = 0, total_aborts = 0;
+    for (int i = 0; i < op_count; i++)
+    {
+        if (conf.mix[i] <= 0)
+            continue;
+
+        op_stat const& s = stats[i];
+        ops[op_names[i]] = {
+            {"count",          s.latency.count()},
+            {"errors",         s.errors},
+            {"aborts",         s.aborts},
+            {"throughput",     s.latency.count() / measured_seconds},
+            {"latency_us",     to_json(s.latency)},
+            {"service_us",     to_json(s.service)},
+        };
+        total.merge(s.latency);
+        total_errors += s.errors;
+        total_aborts += s.aborts;
+    }
+
+    boost::json::object report {
+        {"config", {
+            {"host",        conf.host},
+            {"port",        conf.port},
+            {"connections", conf.connections},
+            {"depth",       conf.depth},
+            {"rate",        conf.rate},
+            {"duration_s",  std::chrono::duration<double>(conf.duration).count()},
+            {"warmup_s",    std::chrono::duration<double>(conf.warmup).count()},
+            {"mix",         vm["mix"].as<std::string>()},
+            {"keys",        conf.keys},
+            {"dist",        vm["dist"].as<std::string>()},
+            {"zipf_theta",  conf.zipf_theta},
+            {"value_size",  conf.value_size},
+            {"seed",        seed},
+        }},
+        {"total", {
+            {"count",       total.count()},
+            {"errors",      total_errors},
+            {"aborts",      total_aborts},
+            {"unanswered",  unanswered},
+            {"throughput",  total.count() / measured_seconds},
+            {"max_backlog", max_backlog},
+            {"latency_us",  to_json(total)},
+        }},
+        {"ops", ops},
+    };
+
+    std::cout << boost::json::serialize(report) << "\n";
+    return unanswered == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,232 @@
+#pragma once
+
+#ifndef BLOCK_CACHE_HPP__
+#define BLOCK_CACHE_HPP__
+
+#include "block-engine.hpp"
+
+#include <boost/log/trivial.hpp>
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace ssbd
+{
+
+// Cache of whole logical blocks (engine values), sharded by key hash.
+// Each shard evicts with CLOCK under its own slice of the byte budget.
+class block_cache
+{
+public:
+    using value_ptr = std::shared_ptr<std::string const>;
+
+private:
+    struct slot
+    {
+        std::string key;
+        value_ptr value = nullptr;
+        bool referenced = false;
+    };
+
+    struct shard
+    {
+        std::mutex mutex;
+        std::unordered_map<std::string, std::size_t> index; // key -> slots position
+        std::vector<slot> slots;
+        std::vector<std::size_t> free;
+        std::size_t hand = 0;
+        std::size_t bytes = 0;
+        std::uint64_t generation = 0; // bumped by every invalidation
+    };
+
+    std::vector<std::unique_ptr<shard>> shards_;
+    std::size_t const shard_budget_;
+
+    std::atomic<std::uint64_t> hits_ = 0, misses_ = 0;
+
+    static
+    auto charge (std::string const& key, std::string const& value) -> std::size_t {
+        return key.size() + value.size() + sizeof(slot);
+    }
+
+    auto shard_of (std::string const& key) -> shard& {
+        return *shards_[std::hash<std::string>{}(key) % shards_.size()];
+    }
+
+    // must hold s.mutex
+    void erase (shard& s, std::size_t const pos)
+    {
+        slot& victim = s.slots[pos];
+        s.bytes -= charge(victim.key, *victim.value);
+        s.index.erase(victim.key);
+        victim = slot{};
+        s.free.push_back(pos);
+    }
+
+    // must hold s.mutex. second chance: a referenced slot is skipped once
+    void evict_one (shard& s)
+    {
+        for (std::size_t step = 0; step < 2 * s.slots.size(); step++)
+        {
+            std::size_t const pos = s.hand;
+            s.hand = (s.hand + 1) % s.slots.size();
+
+            slot& candidate = s.slots[pos];
+            if (candidate.value == nullptr)
+                continue;
+
+            if (candidate.referenced)
+                candidate.referenced = false;
+            else
+            {
+                erase(s, pos);
+                return;
+            }
+        }
+    }
+
+public:
+    block_cache(std::size_t const budget, int const shard_count = 16):
+        shard_budget_{budget / std::max(shard_count, 1)}
+    {
+        for (int i = 0; i < std::max(shard_count, 1); i++)
+            shards_.push_back(std::make_unique<shard>());
+    }
+
+    auto lookup (std::string const& key) -> value_ptr
+    {
+        shard& s = shard_of(key);
+        std::scoped_lock lock {s.mutex};
+        auto it = s.index.find(key);
+        if (it == s.index.end())
+        {
+            misses_++;
+            return nullptr;
+        }
+
+        hits_++;
+        slot& found = s.slots[it->second];
+        found.referenced = true;
+        return found.value;
+    }
+
+    // read generation() before loading the value from the engine; the insert is
+    // dropped if the key was invalidated in between, so a stale value never lands
+    auto generation (std::string const& key) -> std::uint64_t
+    {
+        shard& s = shard_of(key);
+        std::scoped_lock lock {s.mutex};
+        return s.generation;
+    }
+
+    void insert (std::string const& key, std::string const& value, std::uint64_t const generation)
+    {
+        std::size_t const size = charge(key, value);
+        if (size > shard_budget_)
+            return;
+
+        auto v = std::make_shared<std::string const>(value);
+        shard& s = shard_of(key);
+        std::scoped_lock lock {s.mutex};
+        if (s.generation != generation || s.index.contains(key))
+            return;
+
+        while (s.bytes + size > shard_budget_ && not s.index.empty())
+            evict_one(s);
+
+        std::size_t pos = 0;
+        if (not s.free.empty())
+        {
+            pos = s.free.back();
+            s.free.pop_back();
+        }
+        else
+        {
+            pos = s.slots.size();
+            s.slots.emplace_back();
+        }
+
+        s.slots[pos] = slot{key, std::move(v), false};
+        s.index.emplace(key, pos);
+        s.bytes += size;
+    }
+
+    void invalidate (std::string const& key)
+    {
+        shard& s = shard_of(key);
+        std::scoped_lock lock {s.mutex};
+        s.generation++;
+        if (auto it = s.index.find(key); it != s.index.end())
+            erase(s, it->second);
+    }
+
+    auto hits()   const -> std::uint64_t { return hits_.load(); }
+    auto misses() const -> std::uint64_t { return misses_.load(); }
+};
+
+namespace engine
+{
+
+// block_engine decorator: gets are served from the block_cache, and every write
+// (commit_pending_prepare, replication, gc) invalidates the keys it touches after
+// the inner engine has applied it.
+class cached_engine : public block_engine
+{
+    std::unique_ptr<block_engine> inner_;
+    block_cache cache_;
+
+public:
+    cached_engine(std::unique_ptr<block_engine> inner, std::size_t const budget):
+        inner_{std::move(inner)}, cache_{budget} {}
+
+    auto cache() -> block_cache& { return cache_; }
+
+    bool get (std::string const& key, std::string& value) override
+    {
+        if (block_cache::value_ptr cached = cache_.lookup(key))
+        {
+            value = *cached;
+            return true;
+        }
+
+        std::uint64_t const generation = cache_.generation(key);
+        if (not inner_->get(key, value))
+            return false;
+
+        cache_.insert(key, value, generation);
+        return true;
+    }
+
+    void put (std::string const& key, std::string const& value) override
+    {
+        inner_->put(key, value);
+        cache_.invalidate(key);
+    }
+
+    void remove (std::string const& key) override
+    {
+        inner_->remove(key);
+        cache_.invalidate(key);
+    }
+
+    void write (write_batch const& batch) override
+    {
+        inner_->write(batch);
+        for (write_batch::op const& op : batch.ops())
+            cache_.invalidate(op.key);
+    }
+
+    auto new_iterator () -> std::unique_ptr<iterator> override { return inner_->new_iterator(); }
+    auto new_snapshot () -> std::unique_ptr<snapshot> override { return inner_->new_snapshot(); }
+};
+
+} // namespace engine
+
+} // namespace ssbd
+
+#endif // BLOCK_CACHE_HPP__
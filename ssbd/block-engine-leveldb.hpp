@@ -0,0 +1,152 @@
+#pragma once
+
+#ifndef BLOCK_ENGINE_LEVELDB_HPP__
+#define BLOCK_ENGINE_LEVELDB_HPP__
+
+#include "block-engine.hpp"
+
+#include <leveldb/cache.h>
+#include <leveldb/db.h>
+#include <leveldb/write_batch.h>
+
+#include <boost/log/trivial.hpp>
+
+namespace ssbd::engine
+{
+
+class leveldb_engine : public block_engine
+{
+    std::unique_ptr<leveldb::Cache> cache_ = nullptr;
+    std::unique_ptr<leveldb::DB> db_ = nullptr;
+    leveldb::WriteOptions write_options_;
+
+    // releases the leveldb snapshot once the snapshot and all its iterators are gone
+    struct snapshot_holder
+    {
+        leveldb::DB& db;
+        leveldb::Snapshot const* snapshot;
+        ~snapshot_holder() { db.ReleaseSnapshot(snapshot); }
+    };
+
+    class leveldb_iterator : public iterator
+    {
+        std::shared_ptr<snapshot_holder> holder_;
+        std::unique_ptr<leveldb::Iterator> it_;
+
+    public:
+        leveldb_iterator(leveldb::DB& db, std::shared_ptr<snapshot_holder> holder):
+            holder_{std::move(holder)}
+        {
+            leveldb::ReadOptions options;
+            if (holder_)
+                options.snapshot = holder_->snapshot;
+            it_.reset(db.NewIterator(options));
+        }
+
+        void seek (std::string const& key) override { it_->Seek(key); }
+        void next () override { it_->Next(); }
+        bool valid () const override { return it_->Valid(); }
+        auto key () const -> std::string_view override { return {it_->key().data(), it_->key().size()}; }
+        auto value () const -> std::string_view override { return {it_->value().data(), it_->value().size()}; }
+        bool ok () const override { return it_->status().ok(); }
+    };
+
+    class leveldb_snapshot : public snapshot
+    {
+        leveldb::DB& db_;
+        std::shared_ptr<snapshot_holder> holder_;
+
+    public:
+        leveldb_snapshot(leveldb::DB& db):
+            db_{db}, holder_{std::make_shared<snapshot_holder>(db, db.GetSnapshot())} {}
+
+        bool get (std::string const& key, std::string& value) override
+        {
+            leveldb::ReadOptions options;
+            options.snapshot = holder_->snapshot;
+            return db_.Get(options, key, &value).ok();
+        }
+
+        auto new_iterator () -> std::unique_ptr<iterator> override {
+            return std::make_unique<leveldb_iterator>(db_, holder_);
+        }
+    };
+
+    void check (leveldb::Status const& status, char const* what)
+    {
+        if (not status.ok())
+        {
+            BOOST_LOG_TRIVIAL(error) << "leveldb engine " << what << " error: " << status.ToString();
+            throw std::runtime_error(status.ToString());
+        }
+    }
+
+public:
+    leveldb_engine (std::string const& dbname, std::size_t const cache_size, bool const sync)
+    {
+        leveldb::DB* db = nullptr;
+        leveldb::Options options;
+
+        cache_.reset(leveldb::NewLRUCache(cache_size));
+
+        options.create_if_missing = true;
+        options.write_buffer_size = 32 * 1024 * 1024;
+        options.block_cache = cache_.get();
+
+        leveldb::Status status = leveldb::DB::Open(options, dbname, &db);
+        if (not status.ok())
+        {
+            BOOST_LOG_TRIVIAL(error) << status.ToString() << "\n";
+            throw std::runtime_error("cannot open db");
+        }
+
+        BOOST_LOG_TRIVIAL(debug) << "open db ptr: " << db << "\n";
+        db_.reset(db);
+        write_options_.sync = sync;
+    }
+
+    bool get (std::string const& key, std::string& value) override
+    {
+        leveldb::Status const status = db_->Get(leveldb::ReadOptions(), key, &value);
+        if (status.IsNotFound())
+            return false;
+        check(status, "get");
+        return true;
+    }
+
+    void put (std::string const& key, std::string const& value) override {
+        check(db_->Put(write_options_, key, value), "put");
+    }
+
+    void remove (std::string const& key) override {
+        check(db_->Delete(write_options_, key), "remove");
+    }
+
+    void write (write_batch const& batch) override
+    {
+        leveldb::WriteBatch b;
+        for (write_batch::op const& op : batch.ops())
+            switch (op.type)
+            {
+            case write_batch::op::type_t::put:
+                b.Put(op.key, op.value);
+                break;
+            case write_batch::op::type_t::remove:
+                b.Delete(op.key);
+                break;
+            }
+        check(db_->Write(write_options_, &b), "write");
+    }
+
+    auto new_iterator () -> std::unique_ptr<iterator> override {
+        return std::make_unique<leveldb_iterator>(*db_, nullptr);
+    }
+
+    auto new_snapshot () -> std::unique_ptr<snapshot> override {
+        return std::make_unique<leveldb_snapshot>(*db_);
+    }
+};
+
+} // namespace ssbd::engine
+
+#endif // BLOCK_ENGINE_LEVELDB_HPP__
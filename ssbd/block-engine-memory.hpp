@@ -0,0 +1,210 @@
+#pragma once
+
+#ifndef BLOCK_ENGINE_MEMORY_HPP__
+#define BLOCK_ENGINE_MEMORY_HPP__
+
+#include "block-engine.hpp"
+
+#include <algorithm>
+#include <array>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <shared_mutex>
+
+namespace ssbd::engine
+{
+
+// Volatile engine for scratch tiers and benchmarks. Keys are spread over
+// lock stripes; values are immutable shared strings so a snapshot only
+// copies pointers.
+class memory_engine : public block_engine
+{
+    using value_ptr = std::shared_ptr<std::string const>;
+    using table     = std::map<std::string, value_ptr, std::less<>>;
+
+    static constexpr std::size_t stripe_count = 64;
+
+    struct stripe
+    {
+        std::shared_mutex mutex;
+        table data;
+    };
+    std::array<stripe, stripe_count> stripes_;
+
+    auto stripe_of (std::string_view const key) -> std::size_t {
+        return std::hash<std::string_view>{}(key) % stripe_count;
+    }
+
+    class memory_iterator : public iterator
+    {
+        std::shared_ptr<table const> table_;
+        table::const_iterator it_;
+
+    public:
+        memory_iterator(std::shared_ptr<table const> t):
+            table_{std::move(t)}, it_{table_->begin()} {}
+
+        void seek (std::string const& key) override { it_ = table_->lower_bound(key); }
+        void next () override { ++it_; }
+        bool valid () const override { return it_ != table_->end(); }
+        auto key () const -> std::string_view override { return it_->first; }
+        auto value () const -> std::string_view override { return *it_->second; }
+    };
+
+    // walks the live stripes: seek/next pick the smallest candidate key over all stripes.
+    // not isolated from concurrent writes, but needs no copy of the table
+    class live_iterator : public iterator
+    {
+        memory_engine& engine_;
+        bool valid_ = false;
+        std::string key_;
+        value_ptr value_;
+
+        template<typename Bound>
+        void find (Bound bound)
+        {
+            valid_ = false;
+            std::string best_key;
+            value_ptr best_value;
+            for (stripe& s : engine_.stripes_)
+            {
+                std::shared_lock lock {s.mutex};
+                auto it = bound(s.data);
+                if (it != s.data.end() && (not valid_ || it->first < best_key))
+                {
+                    valid_ = true;
+                    best_key = it->first;
+                    best_value = it->second;
+                }
+            }
+            key_ = std::move(best_key);
+            value_ = std::move(best_value);
+        }
+
+    public:
+        live_iterator(memory_engine& engine): engine_{engine} {}
+
+        void seek (std::string const& key) override {
+            find([&key] (table const& t) { return t.lower_bound(key); });
+        }
+
+        void next () override
+        {
+            std::string const current = key_;
+            find([&current] (table const& t) { return t.upper_bound(current); });
+        }
+
+        bool valid () const override { return valid_; }
+        auto key () const -> std::string_view override { return key_; }
+        auto value () const -> std::string_view override { return *value_; }
+    };
+
+    class memory_snapshot : public snapshot
+    {
+        std::shared_ptr<table const> table_;
+
+    public:
+        memory_snapshot(std::shared_ptr<table const> t): table_{std::move(t)} {}
+
+        bool get (std::string const& key, std::string& value) override
+        {
+            auto it = table_->find(key);
+            if (it == table_->end())
+                return false;
+            value = *it->second;
+            return true;
+        }
+
+        auto new_iterator () -> std::unique_ptr<iterator> override {
+            return std::make_unique<memory_iterator>(table_);
+        }
+    };
+
+    // merges all stripes into one ordered table while holding every stripe lock
+    auto freeze () -> std::shared_ptr<table const>
+    {
+        std::vector<std::shared_lock<std::shared_mutex>> locks;
+        locks.reserve(stripe_count);
+        for (stripe& s : stripes_)
+            locks.emplace_back(s.mutex);
+
+        auto merged = std::make_shared<table>();
+        for (stripe& s : stripes_)
+            merged->insert(s.data.begin(), s.data.end());
+        return merged;
+    }
+
+public:
+    bool get (std::string const& key, std::string& value) override
+    {
+        stripe& s = stripes_[stripe_of(key)];
+        value_ptr v;
+        {
+            std::shared_lock lock {s.mutex};
+            auto it = s.data.find(key);
+            if (it == s.data.end())
+                return false;
+            v = it->second;
+        }
+        value = *v;
+        return true;
+    }
+
+    void put (std::string const& key, std::string const& value) override
+    {
+        auto v = std::make_shared<std::string const>(value);
+        stripe& s = stripes_[stripe_of(key)];
+        std::unique_lock lock {s.mutex};
+        s.data.insert_or_assign(key, std::move(v));
+    }
+
+    void remove (std::string const& key) override
+    {
+        stripe& s = stripes_[stripe_of(key)];
+        std::unique_lock lock {s.mutex};
+        s.data.erase(key);
+    }
+
+    void write (write_batch const& batch) override
+    {
+        // lock every touched stripe in index order so batches never deadlock
+        std::vector<std::size_t> touched;
+        for (write_batch::op const& op : batch.ops())
+            touched.push_back(stripe_of(op.key));
+        std::sort(touched.begin(), touched.end());
+        touched.erase(std::unique(touched.begin(), touched.end()), touched.end());
+
+        std::vector<std::unique_lock<std::shared_mutex>> locks;
+        locks.reserve(touched.size());
+        for (std::size_t i : touched)
+            locks.emplace_back(stripes_[i].mutex);
+
+        for (write_batch::op const& op : batch.ops())
+        {
+            table& data = stripes_[stripe_of(op.key)].data;
+            switch (op.type)
+            {
+            case write_batch::op::type_t::put:
+                data.insert_or_assign(op.key, std::make_shared<std::string const>(op.value));
+                break;
+            case write_batch::op::type_t::remove:
+                data.erase(op.key);
+                break;
+            }
+        }
+    }
+
+    // starts unpositioned; call seek() first. use new_snapshot() for an isolated view
+    auto new_iterator () -> std::unique_ptr<iterator> override {
+        return std::make_unique<live_iterator>(*this);
+    }
+
+    auto new_snapshot () -> std::unique_ptr<snapshot> override {
+        return std::make_unique<memory_snapshot>(freeze());
+    }
+};
+
+} // namespace ssbd::engine
+
+#endif // BLOCK_ENGINE_MEMORY_HPP__
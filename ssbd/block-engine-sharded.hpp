@@ -0,0 +1,142 @@
+#pragma once
+
+#ifndef BLOCK_ENGINE_SHARDED_HPP__
+#define BLOCK_ENGINE_SHARDED_HPP__
+
+#include "block-engine.hpp"
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace ssbd::engine
+{
+
+// One engine per storage shard. route maps a key to the shard owning it, so with
+// the same routing as the storage executor every engine is only touched by its
+// own core. Iterators merge the shards in key order.
+class sharded_engine : public block_engine
+{
+public:
+    using route_type = std::function<std::size_t(std::string_view)>;
+
+private:
+    std::vector<std::unique_ptr<block_engine>> shards_;
+    route_type route_;
+
+    // walks the smallest current key over all shard iterators
+    class merge_iterator : public iterator
+    {
+        std::vector<std::unique_ptr<iterator>> its_;
+        iterator* current_ = nullptr;
+
+        void pick()
+        {
+            current_ = nullptr;
+            for (std::unique_ptr<iterator>& it : its_)
+                if (it->valid() && (current_ == nullptr || it->key() < current_->key()))
+                    current_ = it.get();
+        }
+
+    public:
+        merge_iterator(std::vector<std::unique_ptr<iterator>> its): its_{std::move(its)} {}
+
+        void seek (std::string const& key) override
+        {
+            for (std::unique_ptr<iterator>& it : its_)
+                it->seek(key);
+            pick();
+        }
+
+        void next () override
+        {
+            current_->next();
+            pick();
+        }
+
+        bool valid () const override { return current_ != nullptr; }
+        auto key () const -> std::string_view override { return current_->key(); }
+        auto value () const -> std::string_view override { return current_->value(); }
+
+        bool ok () const override
+        {
+            for (std::unique_ptr<iterator> const& it : its_)
+                if (not it->ok())
+                    return false;
+            return true;
+        }
+    };
+
+    // one snapshot per shard; they are not taken at the same instant
+    class sharded_snapshot : public snapshot
+    {
+        std::vector<std::unique_ptr<snapshot>> snapshots_;
+        route_type const route_;
+
+    public:
+        sharded_snapshot(std::vector<std::unique_ptr<snapshot>> snapshots, route_type route):
+            snapshots_{std::move(snapshots)}, route_{std::move(route)} {}
+
+        bool get (std::string const& key, std::string& value) override {
+            return snapshots_.at(route_(key))->get(key, value);
+        }
+
+        auto new_iterator () -> std::unique_ptr<iterator> override
+        {
+            std::vector<std::unique_ptr<iterator>> its;
+            for (std::unique_ptr<snapshot>& s : snapshots_)
+                its.push_back(s->new_iterator());
+            return std::make_unique<merge_iterator>(std::move(its));
+        }
+    };
+
+    auto shard (std::string_view const key) -> block_engine& { return *shards_.at(route_(key)); }
+
+public:
+    sharded_engine(std::vector<std::unique_ptr<block_engine>> shards, route_type route):
+        shards_{std::move(shards)}, route_{std::move(route)} {}
+
+    bool get (std::string const& key, std::string& value) override { return shard(key).get(key, value); }
+    void put (std::string const& key, std::string const& value) override { shard(key).put(key, value); }
+    void remove (std::string const& key) override { shard(key).remove(key); }
+
+    // all or nothing per shard. the ssbd only batches keys of one file, which live on one shard
+    void write (write_batch const& batch) override
+    {
+        std::vector<write_batch> split(shards_.size());
+        for (write_batch::op const& op : batch.ops())
+        {
+            write_batch& b = split.at(route_(op.key));
+            if (op.type == write_batch::op::type_t::put)
+                b.put(op.key, op.value);
+            else
+                b.remove(op.key);
+        }
+
+        for (std::size_t i = 0; i < shards_.size(); i++)
+            if (not split[i].empty())
+                shards_[i]->write(split[i]);
+    }
+
+    auto new_iterator () -> std::unique_ptr<iterator> override
+    {
+        std::vector<std::unique_ptr<iterator>> its;
+        for (std::unique_ptr<block_engine>& e : shards_)
+            its.push_back(e->new_iterator());
+        return std::make_unique<merge_iterator>(std::move(its));
+    }
+
+    auto new_snapshot () -> std::unique_ptr<snapshot> override
+    {
+        std::vector<std::unique_ptr<snapshot>> snapshots;
+        for (std::unique_ptr<block_engine>& e : shards_)
+            snapshots.push_back(e->new_snapshot());
+        return std::make_unique<sharded_snapshot>(std::move(snapshots), route_);
+    }
+};
+
+} // namespace ssbd::engine
+
+#endif // BLOCK_ENGINE_SHARDED_HPP__
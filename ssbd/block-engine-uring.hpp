@@ -0,0 +1,796 @@
+#pragma once
+
+#ifndef BLOCK_ENGINE_URING_HPP__
+#define BLOCK_ENGINE_URING_HPP__
+
+#include "block-engine.hpp"
+
+#include <liburing.h>
+
+#include <boost/log/trivial.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/crc.hpp>
+
+#include <fmt/core.h>
+
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <shared_mutex>
+#include <thread>
+
+namespace ssbd::engine
+{
+
+namespace uring
+{
+
+constexpr std::uint32_t index_magic   = 0x58444e49; // "INDX"
+constexpr std::size_t   page          = 4096;       // O_DIRECT alignment
+constexpr std::size_t   max_key       = 64;
+constexpr std::size_t   max_inline    = 40;
+constexpr std::size_t   journal_slots = 4096;
+
+enum class entry_state : std::uint8_t
+{
+    empty     = 0,
+    used      = 1,
+    tombstone = 2,
+};
+
+// one bucket of the on-disk hash index. small values (committed versions) are kept inline
+struct index_entry
+{
+    std::uint64_t hash;
+    std::uint32_t slot;
+    std::uint32_t size;
+    entry_state   state;
+    std::uint8_t  keysize;
+    std::uint8_t  inlined;
+    std::uint8_t  reserved[5];
+    std::array<char, max_key>    key;
+    std::array<char, max_inline> inline_value;
+
+    auto key_view() const -> std::string_view { return {key.data(), keysize}; }
+};
+static_assert(sizeof(index_entry) == 128);
+
+// |magic|bucket_count|slot_count|slot_size|journal_count|journal_checksum|
+// journal_count entries in the journal are a batch that must be (re)applied to the buckets
+struct index_header
+{
+    std::uint32_t magic;
+    std::uint32_t slot_size;
+    std::uint64_t bucket_count;
+    std::uint64_t slot_count;
+    std::uint32_t journal_count;
+    std::uint32_t journal_checksum;
+};
+static_assert(sizeof(index_header) <= page);
+
+// FNV-1a; stable across builds since it decides the on-disk bucket
+inline
+auto hash (std::string_view const key) -> std::uint64_t
+{
+    std::uint64_t h = 0xcbf29ce484222325ULL;
+    for (unsigned char c : key)
+    {
+        h ^= c;
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+inline
+auto align (std::size_t const size) -> std::size_t {
+    return (size + page - 1) / page * page;
+}
+
+struct aligned_free { void operator() (void* p) const { std::free(p); } };
+using aligned_buffer = std::unique_ptr<char, aligned_free>;
+
+inline
+auto make_aligned (std::size_t const size) -> aligned_buffer
+{
+    void* p = std::aligned_alloc(page, align(size));
+    if (p == nullptr)
+        throw std::bad_alloc();
+    return aligned_buffer {static_cast<char*>(p)};
+}
+
+// one io_uring instance. submissions of a batch go out in a single io_uring_submit()
+class ring
+{
+    io_uring ring_;
+    unsigned const depth_;
+
+public:
+    struct io
+    {
+        bool write;
+        char* buf;
+        std::uint32_t length;
+        std::uint64_t offset;
+    };
+
+    ring(unsigned const depth): depth_{depth}
+    {
+        if (int const rc = io_uring_queue_init(depth_, &ring_, 0); rc < 0)
+            throw std::runtime_error(fmt::format("io_uring_queue_init: {}", std::strerror(-rc)));
+    }
+
+    ~ring() { io_uring_queue_exit(&ring_); }
+
+    ring(ring const&) = delete;
+    ring& operator= (ring const&) = delete;
+
+    // runs all ios (and a trailing fdatasync when asked); throws on the first failed one
+    void run (int const fd, std::vector<io> const& ios, bool const datasync)
+    {
+        std::size_t next = 0;
+        bool fsync_pending = datasync;
+        while (next < ios.size() or fsync_pending)
+        {
+            unsigned submitted = 0;
+            for (; next < ios.size() and submitted < depth_; next++, submitted++)
+            {
+                io_uring_sqe* sqe = io_uring_get_sqe(&ring_);
+                io const& i = ios[next];
+                if (i.write)
+                    io_uring_prep_write(sqe, fd, i.buf, i.length, i.offset);
+                else
+                    io_uring_prep_read(sqe, fd, i.buf, i.length, i.offset);
+                io_uring_sqe_set_data64(sqe, next);
+            }
+
+            // the fsync goes out after every write of the batch has completed
+            bool const send_fsync = fsync_pending and next == ios.size() and submitted == 0;
+            if (send_fsync)
+            {
+                io_uring_sqe* sqe = io_uring_get_sqe(&ring_);
+                io_uring_prep_fsync(sqe, fd, IORING_FSYNC_DATASYNC);
+                io_uring_sqe_set_data64(sqe, ios.size());
+                submitted++;
+                fsync_pending = false;
+            }
+
+            io_uring_submit(&ring_);
+
+            int error = 0;
+            for (unsigned i = 0; i < submitted; i++)
+            {
+                io_uring_cqe* cqe = nullptr;
+                if (int const rc = io_uring_wait_cqe(&ring_, &cqe); rc < 0)
+                    throw std::runtime_error(fmt::format("io_uring_wait_cqe: {}", std::strerror(-rc)));
+
+                if (cqe->res < 0)
+                    error = cqe->res;
+                else if (std::uint64_t const id = io_uring_cqe_get_data64(cqe);
+                         id < ios.size() and static_cast<std::uint32_t>(cqe->res) != ios[id].length)
+                    error = -EIO;
+                io_uring_cqe_seen(&ring_, cqe);
+            }
+
+            if (error != 0)
+                throw std::runtime_error(fmt::format("uring engine io error: {}", std::strerror(-error)));
+        }
+    }
+};
+
+} // namespace uring
+
+// Stores every value in a fixed-size slot of one preallocated data file, read and
+// written with O_DIRECT through io_uring. An open-addressing hash index (mmap'ed
+// file) maps keys to slots. Writes go to a fresh slot first; the index is switched
+// over under a journal, so a batch becomes visible (and survives a crash) all at once.
+class uring_engine : public block_engine
+{
+    boost::filesystem::path const dir_;
+    bool const sync_;
+
+    int data_fd_ = -1;
+    int index_fd_ = -1;
+    char* index_map_ = nullptr;
+    std::size_t index_size_ = 0;
+    std::uint32_t slot_size_ = 0;
+    std::uint64_t slot_count_ = 0;
+    std::uint64_t bucket_count_ = 0;
+    std::uint64_t used_buckets_ = 0;
+    std::uint64_t tombstones_ = 0;
+
+    // readers hold it shared across their slot read, so a slot is never reused under them
+    std::shared_mutex index_mutex_;
+    std::set<std::string, std::less<>> keys_; // ordered view of the index for iterators
+
+    std::mutex slot_mutex_;
+    std::vector<std::uint32_t> free_slots_;
+    std::vector<std::uint32_t> deferred_free_; // freed while a snapshot was open
+    int open_snapshots_ = 0;
+
+    std::vector<std::unique_ptr<uring::ring>> rings_;
+    std::vector<std::unique_ptr<std::mutex>> ring_mutexes_;
+
+    auto header() -> uring::index_header* { return reinterpret_cast<uring::index_header*>(index_map_); }
+    auto journal() -> uring::index_entry* { return reinterpret_cast<uring::index_entry*>(index_map_ + uring::page); }
+    auto buckets() -> uring::index_entry* {
+        return reinterpret_cast<uring::index_entry*>(index_map_ + uring::page + uring::journal_slots * sizeof(uring::index_entry));
+    }
+
+    template<typename Function>
+    void with_ring (Function&& f)
+    {
+        std::size_t const i = std::hash<std::thread::id>{}(std::this_thread::get_id()) % rings_.size();
+        std::scoped_lock lock {*ring_mutexes_[i]};
+        std::invoke(std::forward<Function>(f), *rings_[i]);
+    }
+
+    void sync_index (std::size_t const offset, std::size_t const length)
+    {
+        if (not sync_)
+            return;
+        std::size_t const start = offset / uring::page * uring::page;
+        ::msync(index_map_ + start, offset + length - start, MS_SYNC);
+    }
+
+    // must hold index_mutex_. bucket holding key, or nullptr
+    auto find (std::string_view const key, std::uint64_t const h) -> uring::index_entry*
+    {
+        for (std::uint64_t i = 0; i < bucket_count_; i++)
+        {
+            uring::index_entry& e = buckets()[(h + i) % bucket_count_];
+            if (e.state == uring::entry_state::empty)
+                return nullptr;
+            if (e.state == uring::entry_state::used and e.hash == h and e.key_view() == key)
+                return &e;
+        }
+        return nullptr;
+    }
+
+    // must hold index_mutex_ (unique). bucket to write key into
+    auto find_or_insert (std::string_view const key, std::uint64_t const h) -> uring::index_entry&
+    {
+        if (uring::index_entry* e = find(key, h))
+            return *e;
+
+        for (std::uint64_t i = 0; i < bucket_count_; i++)
+        {
+            uring::index_entry& e = buckets()[(h + i) % bucket_count_];
+            if (e.state != uring::entry_state::used)
+                return e;
+        }
+        throw std::runtime_error("uring engine index full");
+    }
+
+    // must hold index_mutex_ (unique). returns the slot the key used before, if any
+    auto apply (uring::index_entry const& record) -> std::optional<std::uint32_t>
+    {
+        std::optional<std::uint32_t> old_slot;
+        std::string_view const key = record.key_view();
+        uring::index_entry* touched = nullptr;
+        if (record.state == uring::entry_state::used)
+        {
+            touched = &find_or_insert(key, record.hash);
+            if (touched->state == uring::entry_state::used and not touched->inlined and
+                (record.inlined or touched->slot != record.slot))
+                old_slot = touched->slot;
+            if (touched->state == uring::entry_state::tombstone)
+                tombstones_--;
+            if (touched->state != uring::entry_state::used)
+                used_buckets_++;
+            *touched = record;
+            keys_.emplace(key);
+        }
+        else if ((touched = find(key, record.hash)))
+        {
+            if (not touched->inlined)
+                old_slot = touched->slot;
+            touched->state = uring::entry_state::tombstone;
+            used_buckets_--;
+            tombstones_++;
+            keys_.erase(std::string(key));
+        }
+
+        if (touched)
+            sync_index(reinterpret_cast<char*>(touched) - index_map_, sizeof(uring::index_entry));
+        return old_slot;
+    }
+
+    auto journal_checksum (std::uint32_t const count) -> std::uint32_t
+    {
+        boost::crc_32_type crc;
+        crc.process_bytes(journal(), count * sizeof(uring::index_entry));
+        return crc.checksum();
+    }
+
+    auto allocate_slot () -> std::uint32_t
+    {
+        std::scoped_lock lock {slot_mutex_};
+        if (free_slots_.empty())
+            throw std::runtime_error("uring engine out of slots");
+        std::uint32_t const slot = free_slots_.back();
+        free_slots_.pop_back();
+        return slot;
+    }
+
+    void release_slots (std::vector<std::uint32_t> const& slots)
+    {
+        std::scoped_lock lock {slot_mutex_};
+        auto& dest = (open_snapshots_ > 0)? deferred_free_ : free_slots_;
+        dest.insert(dest.end(), slots.begin(), slots.end());
+    }
+
+    // must hold index_mutex_ (shared at least)
+    void read_value (uring::index_entry const& e, std::string& value)
+    {
+        if (e.inlined)
+        {
+            value.assign(e.inline_value.data(), e.size);
+            return;
+        }
+
+        uring::aligned_buffer buf = uring::make_aligned(slot_size_);
+        std::vector<uring::ring::io> const ios {
+            {.write = false, .buf = buf.get(), .length = slot_size_, .offset = std::uint64_t{e.slot} * slot_size_}};
+        with_ring([&] (uring::ring& r) { r.run(data_fd_, ios, false); });
+        value.assign(buf.get(), e.size);
+    }
+
+    // rewrites the used buckets into a fresh index of bucket_count buckets, dropping every
+    // tombstone. the new file replaces the old one by rename, so a crash leaves either
+    // index whole. must hold index_mutex_ (unique) with the journal empty
+    void rebuild_index (std::uint64_t const bucket_count)
+    {
+        boost::filesystem::path const index_path = dir_ / "index.dat";
+        boost::filesystem::path const tmp_path   = dir_ / "index.dat.tmp";
+        std::size_t const size = uring::page + (uring::journal_slots + bucket_count) * sizeof(uring::index_entry);
+
+        int const fd = ::open(tmp_path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0)
+            throw std::runtime_error(fmt::format("cannot open {}", tmp_path.string()));
+        if (::posix_fallocate(fd, 0, size) != 0)
+        {
+            ::close(fd);
+            throw std::runtime_error(fmt::format("cannot preallocate {}", tmp_path.string()));
+        }
+
+        void* addr = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (addr == MAP_FAILED)
+        {
+            ::close(fd);
+            throw std::runtime_error(fmt::format("cannot mmap {}", tmp_path.string()));
+        }
+        char* const map = static_cast<char*>(addr);
+
+        *reinterpret_cast<uring::index_header*>(map) = uring::index_header {
+            .magic            = uring::index_magic,
+            .slot_size        = slot_size_,
+            .bucket_count     = bucket_count,
+            .slot_count       = slot_count_,
+            .journal_count    = 0,
+            .journal_checksum = 0,
+        };
+
+        auto* const dest = reinterpret_cast<uring::index_entry*>(map + uring::page + uring::journal_slots * sizeof(uring::index_entry));
+        for (std::uint64_t i = 0; i < bucket_count_; i++)
+        {
+            uring::index_entry const& e = buckets()[i];
+            if (e.state != uring::entry_state::used)
+                continue;
+
+            std::uint64_t b = e.hash % bucket_count;
+            while (dest[b].state != uring::entry_state::empty)
+                b = (b + 1) % bucket_count;
+            dest[b] = e;
+        }
+
+        // always durable before the rename, whatever sync_ says: the old index is gone after it
+        ::msync(map, size, MS_SYNC);
+        if (::rename(tmp_path.c_str(), index_path.c_str()) != 0)
+        {
+            ::munmap(map, size);
+            ::close(fd);
+            throw std::runtime_error(fmt::format("cannot replace {}", index_path.string()));
+        }
+
+        ::munmap(index_map_, index_size_);
+        ::close(index_fd_);
+        BOOST_LOG_TRIVIAL(info) << "uring engine index rebuilt: " << bucket_count_ << " -> " << bucket_count << " buckets, "
+                                << used_buckets_ << " used, " << tombstones_ << " tombstones dropped";
+
+        index_fd_ = fd;
+        index_map_ = map;
+        index_size_ = size;
+        bucket_count_ = bucket_count;
+        tombstones_ = 0;
+    }
+
+    // keeps linear probing short: used plus tombstone buckets stay under 3/4 of the table
+    // after incoming more inserts, and used ones under 1/2 after a rebuild.
+    // must hold index_mutex_ (unique) with the journal empty
+    void reserve_buckets (std::uint64_t const incoming)
+    {
+        if ((used_buckets_ + tombstones_ + incoming) * 4 <= bucket_count_ * 3)
+            return;
+
+        std::uint64_t bucket_count = bucket_count_;
+        while ((used_buckets_ + incoming) * 2 > bucket_count)
+            bucket_count *= 2;
+        rebuild_index(bucket_count);
+    }
+
+    // switch a group of records into the index: journal, apply, clear journal
+    void commit_records (std::vector<uring::index_entry> const& records)
+    {
+        std::vector<std::uint32_t> freed;
+        {
+            std::unique_lock lock {index_mutex_};
+            for (std::size_t start = 0; start < records.size(); start += uring::journal_slots)
+            {
+                std::uint32_t const count = std::min(records.size() - start, uring::journal_slots);
+                if (start != 0)
+                    BOOST_LOG_TRIVIAL(warning) << "uring engine batch of " << records.size() << " records is larger than the journal; not atomic";
+
+                reserve_buckets(count);
+
+                std::memcpy(journal(), records.data() + start, count * sizeof(uring::index_entry));
+                sync_index(uring::page, count * sizeof(uring::index_entry));
+                header()->journal_checksum = journal_checksum(count);
+                header()->journal_count = count;
+                sync_index(0, sizeof(uring::index_header));
+
+                for (std::uint32_t i = 0; i < count; i++)
+                    if (std::optional<std::uint32_t> const old = apply(records[start + i]))
+                        freed.push_back(*old);
+
+                header()->journal_count = 0;
+                sync_index(0, sizeof(uring::index_header));
+            }
+        }
+        release_slots(freed);
+    }
+
+    void open_files (std::uint64_t const slot_count, std::uint32_t const block_size)
+    {
+        boost::filesystem::create_directories(dir_);
+        boost::filesystem::path const data_path  = dir_ / "blocks.dat";
+        boost::filesystem::path const index_path = dir_ / "index.dat";
+
+        data_fd_ = ::open(data_path.c_str(), O_RDWR | O_CREAT | O_DIRECT, 0644);
+        if (data_fd_ < 0 and errno == EINVAL)
+        {
+            BOOST_LOG_TRIVIAL(warning) << "O_DIRECT not supported on " << data_path << "; using buffered io";
+            data_fd_ = ::open(data_path.c_str(), O_RDWR | O_CREAT, 0644);
+        }
+        if (data_fd_ < 0)
+            throw std::runtime_error(fmt::format("cannot open {}", data_path.string()));
+
+        index_fd_ = ::open(index_path.c_str(), O_RDWR | O_CREAT, 0644);
+        if (index_fd_ < 0)
+            throw std::runtime_error(fmt::format("cannot open {}", index_path.string()));
+
+        uring::index_header existing {};
+        bool const fresh = ::pread(index_fd_, &existing, sizeof(existing), 0) != sizeof(existing) or
+                           existing.magic != uring::index_magic;
+
+        slot_size_    = fresh? uring::align(block_size) : existing.slot_size;
+        slot_count_   = fresh? slot_count : existing.slot_count;
+        // a block key takes a slot and a bucket, its inline committed version one more
+        // bucket; room for both at half load. existing indexes grow in reserve_buckets
+        bucket_count_ = fresh? std::max<std::uint64_t>(slot_count * 4, 1024) : existing.bucket_count;
+        if (not fresh and (slot_count != slot_count_ or uring::align(block_size) != slot_size_))
+            BOOST_LOG_TRIVIAL(warning) << "uring engine keeps existing layout: " << slot_count_ << " slots of " << slot_size_ << " bytes";
+
+        index_size_ = uring::page + (uring::journal_slots + bucket_count_) * sizeof(uring::index_entry);
+        if (::posix_fallocate(index_fd_, 0, index_size_) != 0 or
+            ::posix_fallocate(data_fd_, 0, slot_count_ * slot_size_) != 0)
+            throw std::runtime_error(fmt::format("cannot preallocate uring engine files in {}", dir_.string()));
+
+        void* addr = ::mmap(nullptr, index_size_, PROT_READ | PROT_WRITE, MAP_SHARED, index_fd_, 0);
+        if (addr == MAP_FAILED)
+            throw std::runtime_error(fmt::format("cannot mmap {}", index_path.string()));
+        index_map_ = static_cast<char*>(addr);
+
+        if (fresh)
+        {
+            std::memset(index_map_, 0, index_size_);
+            *header() = uring::index_header {
+                .magic            = uring::index_magic,
+                .slot_size        = slot_size_,
+                .bucket_count     = bucket_count_,
+                .slot_count       = slot_count_,
+                .journal_count    = 0,
+                .journal_checksum = 0,
+            };
+            ::msync(index_map_, index_size_, MS_SYNC);
+        }
+    }
+
+    // replay an interrupted batch, then rebuild the key set and the free slot list
+    void recover()
+    {
+        std::unique_lock lock {index_mutex_};
+        std::uint32_t const count = header()->journal_count;
+        if (count > 0 and count <= uring::journal_slots and journal_checksum(count) == header()->journal_checksum)
+        {
+            BOOST_LOG_TRIVIAL(info) << "uring engine replays " << count << " journaled records";
+            for (std::uint32_t i = 0; i < count; i++)
+                apply(journal()[i]);
+        }
+        header()->journal_count = 0;
+
+        used_buckets_ = 0;
+        tombstones_ = 0;
+        std::vector<bool> used(slot_count_, false);
+        for (std::uint64_t i = 0; i < bucket_count_; i++)
+        {
+            uring::index_entry const& e = buckets()[i];
+            if (e.state == uring::entry_state::tombstone)
+                tombstones_++;
+            if (e.state != uring::entry_state::used)
+                continue;
+            used_buckets_++;
+            keys_.emplace(e.key_view());
+            if (not e.inlined and e.slot < slot_count_)
+                used[e.slot] = true;
+        }
+
+        for (std::uint64_t s = slot_count_; s > 0; s--)
+            if (not used[s - 1])
+                free_slots_.push_back(s - 1);
+
+        // tombstones left by an older build, or a table sized before the keys grew
+        reserve_buckets(0);
+
+        BOOST_LOG_TRIVIAL(info) << "uring engine opened " << dir_ << ": " << keys_.size() << " keys, "
+                                << free_slots_.size() << "/" << slot_count_ << " free slots";
+    }
+
+    class live_iterator : public iterator
+    {
+        uring_engine& engine_;
+        bool valid_ = false;
+        std::string key_, value_;
+
+        template<typename Bound>
+        void position (Bound bound)
+        {
+            std::shared_lock lock {engine_.index_mutex_};
+            auto it = bound(engine_.keys_);
+            valid_ = (it != engine_.keys_.end());
+            if (not valid_)
+                return;
+
+            key_ = *it;
+            uring::index_entry const* e = engine_.find(key_, uring::hash(key_));
+            engine_.read_value(*e, value_);
+        }
+
+    public:
+        live_iterator(uring_engine& engine): engine_{engine} {}
+
+        void seek (std::string const& key) override {
+            position([&key] (auto const& keys) { return keys.lower_bound(key); });
+        }
+
+        void next () override {
+            position([this] (auto const& keys) { return keys.upper_bound(key_); });
+        }
+
+        bool valid () const override { return valid_; }
+        auto key () const -> std::string_view override { return key_; }
+        auto value () const -> std::string_view override { return value_; }
+    };
+
+    // a copy of the index; slots it points to are kept until it closes
+    class uring_snapshot : public snapshot
+    {
+        struct state
+        {
+            uring_engine& engine;
+            std::map<std::string, uring::index_entry, std::less<>> entries;
+
+            ~state()
+            {
+                std::scoped_lock lock {engine.slot_mutex_};
+                if (--engine.open_snapshots_ == 0)
+                {
+                    engine.free_slots_.insert(engine.free_slots_.end(),
+                                              engine.deferred_free_.begin(), engine.deferred_free_.end());
+                    engine.deferred_free_.clear();
+                }
+            }
+        };
+        std::shared_ptr<state> state_;
+
+        class snapshot_iterator : public iterator
+        {
+            std::shared_ptr<state> state_;
+            decltype(state::entries)::const_iterator it_;
+            std::string value_;
+
+            void load()
+            {
+                if (it_ != state_->entries.end())
+                {
+                    std::shared_lock lock {state_->engine.index_mutex_};
+                    state_->engine.read_value(it_->second, value_);
+                }
+            }
+
+        public:
+            snapshot_iterator(std::shared_ptr<state> s): state_{std::move(s)}, it_{state_->entries.end()} {}
+
+            void seek (std::string const& key) override { it_ = state_->entries.lower_bound(key); load(); }
+            void next () override { ++it_; load(); }
+            bool valid () const override { return it_ != state_->entries.end(); }
+            auto key () const -> std::string_view override { return it_->first; }
+            auto value () const -> std::string_view override { return value_; }
+        };
+
+    public:
+        uring_snapshot(uring_engine& engine)
+        {
+            state_ = std::make_shared<state>(engine);
+            std::shared_lock lock {engine.index_mutex_};
+            {
+                std::scoped_lock slot_lock {engine.slot_mutex_};
+                engine.open_snapshots_++;
+            }
+            for (std::uint64_t i = 0; i < engine.bucket_count_; i++)
+            {
+                uring::index_entry const& e = engine.buckets()[i];
+                if (e.state == uring::entry_state::used)
+                    state_->entries.emplace(e.key_view(), e);
+            }
+        }
+
+        bool get (std::string const& key, std::string& value) override
+        {
+            auto it = state_->entries.find(key);
+            if (it == state_->entries.end())
+                return false;
+            std::shared_lock lock {state_->engine.index_mutex_};
+            state_->engine.read_value(it->second, value);
+            return true;
+        }
+
+        auto new_iterator () -> std::unique_ptr<iterator> override {
+            return std::make_unique<snapshot_iterator>(state_);
+        }
+    };
+
+public:
+    uring_engine (std::string const& dirname, std::uint64_t const slot_count, std::uint32_t const block_size,
+                  bool const sync, int const rings = std::thread::hardware_concurrency(), unsigned const depth = 64):
+        dir_{dirname}, sync_{sync}
+    {
+        open_files(slot_count, block_size);
+        for (int i = 0; i < std::max(rings, 1); i++)
+        {
+            rings_.push_back(std::make_unique<uring::ring>(depth));
+            ring_mutexes_.push_back(std::make_unique<std::mutex>());
+        }
+        recover();
+    }
+
+    ~uring_engine()
+    {
+        if (index_map_)
+        {
+            ::msync(index_map_, index_size_, MS_SYNC);
+            ::munmap(index_map_, index_size_);
+        }
+        if (index_fd_ >= 0)
+            ::close(index_fd_);
+        if (data_fd_ >= 0)
+            ::close(data_fd_);
+    }
+
+    bool get (std::string const& key, std::string& value) override
+    {
+        std::shared_lock lock {index_mutex_};
+        uring::index_entry const* e = find(key, uring::hash(key));
+        if (e == nullptr)
+            return false;
+        read_value(*e, value);
+        return true;
+    }
+
+    void put (std::string const& key, std::string const& value) override
+    {
+        write_batch batch;
+        batch.put(key, value);
+        write(batch);
+    }
+
+    void remove (std::string const& key) override
+    {
+        write_batch batch;
+        batch.remove(key);
+        write(batch);
+    }
+
+    void write (write_batch const& batch) override
+    {
+        std::vector<uring::index_entry> records;
+        std::vector<uring::aligned_buffer> buffers;
+        std::vector<uring::ring::io> ios;
+        std::vector<std::uint32_t> allocated;
+        records.reserve(batch.ops().size());
+
+        try
+        {
+            for (write_batch::op const& op : batch.ops())
+            {
+                if (op.key.size() > uring::max_key)
+                    throw std::runtime_error(fmt::format("uring engine key of {} bytes too long", op.key.size()));
+                if (op.value.size() > slot_size_)
+                    throw std::runtime_error(fmt::format("uring engine value of {} bytes larger than a slot", op.value.size()));
+
+                uring::index_entry record {};
+                record.hash    = uring::hash(op.key);
+                record.keysize = static_cast<std::uint8_t>(op.key.size());
+                std::memcpy(record.key.data(), op.key.data(), op.key.size());
+
+                if (op.type == write_batch::op::type_t::remove)
+                    record.state = uring::entry_state::tombstone;
+                else
+                {
+                    record.state = uring::entry_state::used;
+                    record.size  = static_cast<std::uint32_t>(op.value.size());
+                    if (op.value.size() <= uring::max_inline)
+                    {
+                        record.inlined = 1;
+                        std::memcpy(record.inline_value.data(), op.value.data(), op.value.size());
+                    }
+                    else
+                    {
+                        record.slot = allocate_slot();
+                        allocated.push_back(record.slot);
+                        uring::aligned_buffer buf = uring::make_aligned(slot_size_);
+                        std::memcpy(buf.get(), op.value.data(), op.value.size());
+                        std::memset(buf.get() + op.value.size(), 0, slot_size_ - op.value.size());
+                        ios.push_back({.write = true, .buf = buf.get(), .length = slot_size_,
+                                       .offset = std::uint64_t{record.slot} * slot_size_});
+                        buffers.push_back(std::move(buf));
+                    }
+                }
+                records.push_back(record);
+            }
+
+            if (not ios.empty())
+                with_ring([&] (uring::ring& r) { r.run(data_fd_, ios, sync_); });
+        }
+        catch (std::exception const& e)
+        {
+            BOOST_LOG_TRIVIAL(error) << "uring engine write failed: " << e.what();
+            release_slots(allocated);
+            throw;
+        }
+
+        commit_records(records);
+    }
+
+    // starts unpositioned; not isolated from concurrent writes
+    auto new_iterator () -> std::unique_ptr<iterator> override {
+        return std::make_unique<live_iterator>(*this);
+    }
+
+    auto new_snapshot () -> std::unique_ptr<snapshot> override {
+        return std::make_unique<uring_snapshot>(*this);
+    }
+};
+
+} // namespace ssbd::engine
+
+#endif // BLOCK_ENGINE_URING_HPP__
@@ -0,0 +1,87 @@
+#pragma once
+
+#ifndef BLOCK_ENGINE_HPP__
+#define BLOCK_ENGINE_HPP__
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace ssbd::engine
+{
+
+// a group of writes applied all or nothing by block_engine::write()
+class write_batch
+{
+public:
+    struct op
+    {
+        enum class type_t { put, remove } type;
+        std::string key;
+        std::string value;
+    };
+
+    void put (std::string const& key, std::string const& value) {
+        ops_.push_back(op{op::type_t::put, key, value});
+    }
+
+    void remove (std::string const& key) {
+        ops_.push_back(op{op::type_t::remove, key, {}});
+    }
+
+    auto ops()   const -> std::vector<op> const& { return ops_; }
+    bool empty() const { return ops_.empty(); }
+    void clear() { ops_.clear(); }
+
+private:
+    std::vector<op> ops_;
+};
+
+// ordered iteration over a snapshot of the engine
+class iterator
+{
+public:
+    virtual ~iterator() {}
+
+    virtual void seek (std::string const& key) = 0;
+    virtual void next () = 0;
+    virtual bool valid () const = 0;
+    virtual auto key () const -> std::string_view = 0;
+    virtual auto value () const -> std::string_view = 0;
+    virtual bool ok () const { return true; }
+};
+
+// a consistent read view; reads through it do not see later writes
+class snapshot
+{
+public:
+    virtual ~snapshot() {}
+
+    virtual bool get (std::string const& key, std::string& value) = 0;
+
+    // the iterator may outlive the snapshot
+    virtual auto new_iterator () -> std::unique_ptr<iterator> = 0;
+};
+
+// The key-value store under the SSBD blocks and their committed versions.
+class block_engine
+{
+public:
+    virtual ~block_engine() {}
+
+    // false when the key does not exist
+    virtual bool get (std::string const& key, std::string& value) = 0;
+    virtual void put (std::string const& key, std::string const& value) = 0;
+    virtual void remove (std::string const& key) = 0;
+    virtual void write (write_batch const& batch) = 0;
+
+    // starts unpositioned; call seek() first. whether it is isolated from
+    // concurrent writes depends on the engine; use a snapshot when that matters
+    virtual auto new_iterator () -> std::unique_ptr<iterator> = 0;
+    virtual auto new_snapshot () -> std::unique_ptr<snapshot> = 0;
+};
+
+} // namespace ssbd::engine
+
+#endif // BLOCK_ENGINE_HPP__
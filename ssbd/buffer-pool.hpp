@@ -0,0 +1,85 @@
+#pragma once
+
+#ifndef BUFFER_POOL_HPP__
+#define BUFFER_POOL_HPP__
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <vector>
+
+namespace ssbd
+{
+
+// a byte buffer that is not zero filled on reuse
+class pooled_buffer
+{
+    std::unique_ptr<char[]> bytes_;
+    std::size_t capacity_ = 0;
+    std::size_t size_ = 0;
+
+public:
+    pooled_buffer(std::size_t const capacity):
+        bytes_{std::make_unique_for_overwrite<char[]>(capacity)}, capacity_{capacity} {}
+
+    auto data() -> char* { return bytes_.get(); }
+    auto data() const -> char const* { return bytes_.get(); }
+    auto size() const -> std::size_t { return size_; }
+    auto capacity() const -> std::size_t { return capacity_; }
+    auto view() const -> std::string_view { return {bytes_.get(), size_}; }
+
+    void resize(std::size_t const size) { size_ = size; } // size <= capacity
+};
+
+// Per-connection pool of block-sized buffers for packet bodies. Buffers go back to
+// the pool when the last user (often a storage thread) drops them; bigger ones are freed.
+class buffer_pool : public std::enable_shared_from_this<buffer_pool>
+{
+    std::size_t const buffer_size_;
+    std::size_t const max_pooled_;
+
+    std::mutex mutex_;
+    std::vector<std::unique_ptr<pooled_buffer>> free_;
+
+    void release(pooled_buffer* b)
+    {
+        std::unique_ptr<pooled_buffer> owned {b};
+        if (owned->capacity() != buffer_size_)
+            return;
+
+        std::scoped_lock lock {mutex_};
+        if (free_.size() < max_pooled_)
+            free_.push_back(std::move(owned));
+    }
+
+public:
+    buffer_pool(std::size_t const buffer_size, std::size_t const max_pooled):
+        buffer_size_{buffer_size}, max_pooled_{max_pooled} {}
+
+    auto acquire(std::size_t const size) -> std::shared_ptr<pooled_buffer>
+    {
+        std::unique_ptr<pooled_buffer> b;
+        if (size <= buffer_size_)
+        {
+            std::scoped_lock lock {mutex_};
+            if (not free_.empty())
+            {
+                b = std::move(free_.back());
+                free_.pop_back();
+            }
+        }
+
+        if (b == nullptr)
+            b = std::make_unique<pooled_buffer>(std::max(size, buffer_size_));
+
+        b->resize(size);
+        return std::shared_ptr<pooled_buffer>(
+            b.release(),
+            [pool=shared_from_this()] (pooled_buffer* p) { pool->release(p); });
+    }
+};
+
+} // namespace ssbd
+
+#endif // BUFFER_POOL_HPP__
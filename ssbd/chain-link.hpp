@@ -0,0 +1,308 @@
+#pragma once
+
+#ifndef CHAIN_LINK_HPP__
+#define CHAIN_LINK_HPP__
+
+#include "basic.hpp"
+#include "leveldb-serializer.hpp"
+#include "socket-writer.hpp"
+#include "framing-reader.hpp"
+
+#include <boost/log/trivial.hpp>
+#include <boost/asio.hpp>
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <cstring>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace ssbd
+{
+
+// Client side of the replica chain: the connection from this SSBD to the next one.
+// forward() sends a request down the chain and calls next with the reply. A broken
+// connection answers everything in flight with err; the next forward() reconnects.
+// Connecting never blocks the caller: forwards queue up until the connect finishes
+// or its deadline passes. A forward the next ssbd does not answer within the forward
+// timeout is answered with err; a late reply is then dropped.
+class chain_link
+{
+public:
+    using callback = std::function<void(slsfs::leveldb_pack::packet_pointer)>;
+
+    static
+    auto error_reply (slsfs::leveldb_pack::packet_header const& header) -> slsfs::leveldb_pack::packet_pointer
+    {
+        slsfs::leveldb_pack::packet_pointer resp = std::make_shared<slsfs::leveldb_pack::packet>();
+        resp->header = header;
+        resp->header.type = slsfs::leveldb_pack::msg_t::err;
+        return resp;
+    }
+
+private:
+    class session : public std::enable_shared_from_this<session>
+    {
+        struct pending
+        {
+            slsfs::leveldb_pack::packet_header header;
+            callback next;
+            std::shared_ptr<net::steady_timer> deadline;
+        };
+
+        // keyed on a per-session counter carried in the salt, which the ssbd echoes back
+        using jobmap = std::unordered_map<std::uint32_t, pending>;
+
+        static
+        void set_id(slsfs::leveldb_pack::packet_header& header, std::uint32_t const id)
+        {
+            static_assert(sizeof(header.salt) == sizeof(id));
+            std::memcpy(header.salt.data(), &id, sizeof(id));
+        }
+
+        static
+        auto id_of(slsfs::leveldb_pack::packet_header const& header) -> std::uint32_t
+        {
+            std::uint32_t id;
+            std::memcpy(&id, header.salt.data(), sizeof(id));
+            return id;
+        }
+
+        tcp::socket socket_;
+        net::steady_timer connect_timer_;
+        std::chrono::milliseconds const forward_timeout_;
+        slsfs::socket_writer::socket_writer<slsfs::leveldb_pack::packet, std::vector<slsfs::leveldb_pack::unit_t>> writer_;
+        slsfs::framing_reader::framing_reader<slsfs::leveldb_pack::packet_header, slsfs::leveldb_pack::buffer_t> reader_;
+        std::mutex mutex_;
+        jobmap outstanding_;
+        std::uint32_t next_id_ = 0;
+        std::vector<std::pair<slsfs::leveldb_pack::packet_pointer, callback>> connecting_;
+        bool connected_ = false;
+        bool broken_ = false;
+
+        void on_reply(slsfs::leveldb_pack::packet_header const& header, std::shared_ptr<slsfs::leveldb_pack::buffer_t> body)
+        {
+            slsfs::leveldb_pack::packet_pointer resp = std::make_shared<slsfs::leveldb_pack::packet>();
+            resp->header = header;
+            resp->data.buf = std::move(*body);
+
+            if (std::optional<pending> p = take(id_of(header)))
+                p->next(resp);
+            else
+                BOOST_LOG_TRIVIAL(error) << "chain link: reply without request (or past its deadline) " << header;
+        }
+
+        auto take(std::uint32_t const id) -> std::optional<pending>
+        {
+            std::optional<pending> p;
+            {
+                std::scoped_lock lock {mutex_};
+                if (auto it = outstanding_.find(id); it != outstanding_.end())
+                {
+                    p = std::move(it->second);
+                    outstanding_.erase(it);
+                }
+            }
+
+            if (p)
+                cancel(p->deadline);
+            return p;
+        }
+
+        // timers are not thread safe; every wait and cancel goes through the socket strand
+        static
+        void cancel(std::shared_ptr<net::steady_timer> deadline) {
+            net::post(deadline->get_executor(), [deadline] { deadline->cancel(); });
+        }
+
+        // answers every request still waiting with err
+        void fail_all()
+        {
+            jobmap failed;
+            std::vector<std::pair<slsfs::leveldb_pack::packet_pointer, callback>> unsent;
+            {
+                std::scoped_lock lock {mutex_};
+                broken_ = true;
+                failed.swap(outstanding_);
+                unsent.swap(connecting_);
+            }
+
+            for (auto& [id, p] : failed)
+            {
+                cancel(p.deadline);
+                p.next(error_reply(p.header));
+            }
+            for (auto& [request, next] : unsent)
+                next(error_reply(request->header));
+        }
+
+        void on_connect(boost::system::error_code ec, tcp::endpoint const& endpoint)
+        {
+            connect_timer_.cancel();
+            if (ec)
+            {
+                BOOST_LOG_TRIVIAL(error) << "chain link cannot connect to " << endpoint << ": " << ec.message();
+                fail_all();
+                return;
+            }
+
+            boost::system::error_code ignored;
+            socket_.set_option(tcp::no_delay(true), ignored);
+            BOOST_LOG_TRIVIAL(info) << "chain link connected to " << endpoint;
+            reader_.start_read(shared_from_this());
+
+            std::vector<std::pair<slsfs::leveldb_pack::packet_pointer, callback>> queued;
+            {
+                std::scoped_lock lock {mutex_};
+                connected_ = true;
+                queued.swap(connecting_);
+            }
+
+            for (auto& [request, next] : queued)
+                send(request, std::move(next));
+        }
+
+    public:
+        session(net::io_context& io, std::chrono::milliseconds const forward_timeout):
+            socket_{net::make_strand(io)},
+            connect_timer_{socket_.get_executor()},
+            forward_timeout_{forward_timeout},
+            writer_{io, socket_},
+            reader_{socket_,
+                    [] (slsfs::leveldb_pack::packet_header const& header) -> std::size_t { return header.datasize; },
+                    [] (slsfs::leveldb_pack::packet_header const&, std::size_t const size) {
+                        return std::make_shared<slsfs::leveldb_pack::buffer_t>(size);
+                    },
+                    [this] (slsfs::leveldb_pack::packet_header const& header, std::shared_ptr<slsfs::leveldb_pack::buffer_t> body) {
+                        on_reply(header, std::move(body));
+                    },
+                    [this] (boost::system::error_code ec) {
+                        BOOST_LOG_TRIVIAL(error) << "chain link read error: " << ec.message();
+                        fail_all();
+                    }} {}
+
+        // returns at once; send() queues until the connect completes. The timer and the
+        // connect both run on the socket's strand, so closing on timeout cannot race it
+        void start_connect(tcp::endpoint const& endpoint, std::chrono::milliseconds const timeout)
+        {
+            connect_timer_.expires_after(timeout);
+            connect_timer_.async_wait(
+                [self=shared_from_this()] (boost::system::error_code ec) {
+                    if (ec == net::error::operation_aborted)
+                        return;
+                    boost::system::error_code ignored;
+                    self->socket_.close(ignored);
+                });
+
+            socket_.async_connect(
+                endpoint,
+                [self=shared_from_this(), endpoint] (boost::system::error_code ec) {
+                    self->on_connect(ec, endpoint);
+                });
+        }
+
+        bool broken()
+        {
+            std::scoped_lock lock {mutex_};
+            return broken_;
+        }
+
+        void send(slsfs::leveldb_pack::packet_pointer request, callback next)
+        {
+            bool queued = false;
+            std::shared_ptr<net::steady_timer> deadline;
+            {
+                std::scoped_lock lock {mutex_};
+                if (not broken_ and not connected_)
+                {
+                    connecting_.emplace_back(request, std::move(next));
+                    return;
+                }
+
+                if (not broken_)
+                {
+                    deadline = std::make_shared<net::steady_timer>(socket_.get_executor(), forward_timeout_);
+                    std::uint32_t const id = next_id_++;
+                    set_id(request->header, id);
+                    outstanding_.emplace(id, pending{request->header, next, deadline});
+                    queued = true;
+                }
+            }
+
+            if (not queued) // the session broke in between
+            {
+                next(error_reply(request->header));
+                return;
+            }
+
+            // posted before the write, so it reaches the strand ahead of any cancel from the reply
+            net::post(
+                deadline->get_executor(),
+                [self=shared_from_this(), deadline, id=id_of(request->header)] {
+                    deadline->async_wait(
+                        [self, id] (boost::system::error_code ec) {
+                            if (ec == net::error::operation_aborted)
+                                return;
+                            if (std::optional<pending> p = self->take(id))
+                            {
+                                BOOST_LOG_TRIVIAL(error) << "chain link: no reply within " << self->forward_timeout_.count()
+                                                         << "ms for " << p->header;
+                                p->next(error_reply(p->header));
+                            }
+                        });
+                });
+
+            auto on_sent = std::make_shared<slsfs::socket_writer::boost_callback>(
+                [self=shared_from_this()] (boost::system::error_code ec, std::size_t /*length*/) {
+                    if (ec)
+                    {
+                        BOOST_LOG_TRIVIAL(error) << "chain link write error: " << ec.message();
+                        boost::system::error_code ignored;
+                        self->socket_.close(ignored);
+                        self->fail_all();
+                    }
+                });
+
+            writer_.start_write_socket(request, on_sent);
+        }
+    };
+
+    net::io_context& io_context_;
+    tcp::endpoint const endpoint_;
+    std::chrono::milliseconds const connect_timeout_;
+    std::chrono::milliseconds const forward_timeout_;
+    std::mutex mutex_;
+    std::shared_ptr<session> session_;
+
+    auto current_session() -> std::shared_ptr<session>
+    {
+        std::scoped_lock lock {mutex_};
+        if (session_ == nullptr or session_->broken())
+        {
+            session_ = std::make_shared<session>(io_context_, forward_timeout_);
+            session_->start_connect(endpoint_, connect_timeout_);
+        }
+        return session_;
+    }
+
+public:
+    chain_link(net::io_context& io, tcp::endpoint const& endpoint,
+               std::chrono::milliseconds const connect_timeout = std::chrono::milliseconds{1000},
+               std::chrono::milliseconds const forward_timeout = std::chrono::milliseconds{10000}):
+        io_context_{io}, endpoint_{endpoint}, connect_timeout_{connect_timeout}, forward_timeout_{forward_timeout} {}
+
+    auto endpoint() const -> tcp::endpoint const& { return endpoint_; }
+
+    void forward(slsfs::leveldb_pack::packet_pointer request, callback next)
+    {
+        current_session()->send(request, std::move(next));
+    }
+};
+
+} // namespace ssbd
+
+#endif // CHAIN_LINK_HPP__
@@ -0,0 +1,185 @@
+#pragma once
+
+#ifndef FRAMING_READER_HPP__
+#define FRAMING_READER_HPP__
+
+#include <boost/asio.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace slsfs::framing_reader
+{
+
+// Reads back-to-back |header|body| frames off a socket. async_read_some fills one
+// buffer and every complete frame in it is handed out before the next read, so a
+// burst of small packets costs one completion instead of two per packet. Bodies that
+// arrived whole with the burst are copied out of the buffer; a body still incomplete
+// once its header is parsed gets its allocate()d buffer and the rest is read
+// straight into it, so a lone block body crosses memory once.
+//
+// Body is any buffer with data() and size(). The frame body lands in its last
+// body_size(header) bytes, so allocate() may leave headroom in front of it.
+template<typename Header, typename Body>
+class framing_reader
+{
+public:
+    using unit_t = unsigned char;
+    using body_size_type = std::function<std::size_t(Header const&)>;
+    using allocate_type  = std::function<std::shared_ptr<Body>(Header const&, std::size_t)>;
+    using frame_type     = std::function<void(Header const&, std::shared_ptr<Body>)>;
+    using error_type     = std::function<void(boost::system::error_code)>;
+
+private:
+    boost::asio::ip::tcp::socket& socket_;
+    std::vector<unit_t> buf_;
+    std::size_t begin_ = 0, end_ = 0; // unparsed bytes are buf_[begin_, end_)
+
+    body_size_type body_size_;
+    allocate_type  allocate_;
+    frame_type     on_frame_;
+    error_type     on_error_;
+
+    std::mutex pause_mutex_;
+    bool paused_ = false;
+    bool parked_ = false; // the read loop stopped for the pause
+    std::shared_ptr<void> parked_keepalive_ = nullptr;
+
+    // true when the loop stopped for pause(); resume() restarts it
+    bool park(std::shared_ptr<void> const& keepalive)
+    {
+        std::scoped_lock lock {pause_mutex_};
+        if (not paused_)
+            return false;
+        parked_ = true;
+        parked_keepalive_ = keepalive;
+        return true;
+    }
+
+    static
+    auto body_of(Body& body, std::size_t const size) -> unit_t* {
+        return reinterpret_cast<unit_t*>(body.data()) + body.size() - size;
+    }
+
+    void start_read_some(std::shared_ptr<void> keepalive)
+    {
+        // move the partial frame to the front so a whole frame always fits
+        if (begin_ != 0)
+        {
+            std::memmove(buf_.data(), buf_.data() + begin_, end_ - begin_);
+            end_ -= begin_;
+            begin_ = 0;
+        }
+
+        socket_.async_read_some(
+            boost::asio::buffer(buf_.data() + end_, buf_.size() - end_),
+            [this, keepalive] (boost::system::error_code ec, std::size_t length) {
+                if (ec)
+                {
+                    on_error_(ec);
+                    return;
+                }
+
+                end_ += length;
+                parse_frames(keepalive);
+            });
+    }
+
+    void parse_frames(std::shared_ptr<void> keepalive)
+    {
+        while (end_ - begin_ >= Header::bytesize)
+        {
+            Header header;
+            header.parse(buf_.data() + begin_);
+            std::size_t const body_size = body_size_(header);
+            std::size_t const buffered  = end_ - begin_ - Header::bytesize;
+
+            if (body_size > buffered)
+            {
+                start_read_body(header, body_size, buffered, keepalive);
+                return;
+            }
+
+            std::shared_ptr<Body> body = allocate_(header, body_size);
+            std::memcpy(body_of(*body, body_size), buf_.data() + begin_ + Header::bytesize, body_size);
+            begin_ += Header::bytesize + body_size;
+            on_frame_(header, std::move(body));
+
+            if (park(keepalive))
+                return;
+        }
+
+        start_read_some(keepalive);
+    }
+
+    // incomplete body: take the part already buffered, then read the rest straight into place
+    void start_read_body(Header const& header, std::size_t const body_size, std::size_t const buffered,
+                          std::shared_ptr<void> keepalive)
+    {
+        std::shared_ptr<Body> body = allocate_(header, body_size);
+        unit_t* const dest = body_of(*body, body_size);
+        std::memcpy(dest, buf_.data() + begin_ + Header::bytesize, buffered);
+        begin_ = end_ = 0;
+
+        boost::asio::async_read(
+            socket_,
+            boost::asio::buffer(dest + buffered, body_size - buffered),
+            [this, header, body, keepalive] (boost::system::error_code ec, std::size_t /*length*/) {
+                if (ec)
+                {
+                    on_error_(ec);
+                    return;
+                }
+
+                on_frame_(header, body);
+                if (not park(keepalive))
+                    start_read_some(keepalive);
+            });
+    }
+
+public:
+    framing_reader(boost::asio::ip::tcp::socket& s,
+                   body_size_type body_size, allocate_type allocate, frame_type on_frame, error_type on_error,
+                   std::size_t const capacity = 256 * 1024):
+        socket_{s}, buf_(std::max<std::size_t>(capacity, Header::bytesize)),
+        body_size_{std::move(body_size)}, allocate_{std::move(allocate)},
+        on_frame_{std::move(on_frame)}, on_error_{std::move(on_error)} {}
+
+    // keepalive holds the owner of this reader until reading stops on an error.
+    // call once; on_frame runs for every frame, in order, until then
+    void start_read(std::shared_ptr<void> keepalive) {
+        start_read_some(std::move(keepalive));
+    }
+
+    // stops handing out frames after the current one; frames already buffered wait for resume().
+    // both may be called from any thread, e.g. by flow control from inside on_frame
+    void pause()
+    {
+        std::scoped_lock lock {pause_mutex_};
+        paused_ = true;
+    }
+
+    void resume()
+    {
+        std::shared_ptr<void> keepalive;
+        bool restart = false;
+        {
+            std::scoped_lock lock {pause_mutex_};
+            paused_ = false;
+            std::swap(restart, parked_);
+            keepalive.swap(parked_keepalive_);
+        }
+
+        if (restart)
+            boost::asio::post(socket_.get_executor(),
+                              [this, keepalive] { parse_frames(keepalive); });
+    }
+};
+
+} // namespace slsfs::framing_reader
+
+#endif // FRAMING_READER_HPP__
@@ -0,0 +1,148 @@
+#pragma once
+
+#ifndef HDR_HISTOGRAM_HPP__
+#define HDR_HISTOGRAM_HPP__
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace ssbd
+{
+
+// High dynamic range histogram, the layout of HdrHistogram: values in
+// [1, highest] are kept to significant_figures decimal digits with fixed
+// memory and O(1) record. Not thread safe; keep one per thread and merge.
+class hdr_histogram
+{
+    std::int64_t const highest_;
+    int const sub_bucket_half_count_magnitude_;
+    std::int64_t const sub_bucket_count_;
+    std::int64_t const sub_bucket_half_count_;
+    std::int64_t const sub_bucket_mask_;
+    std::vector<std::uint64_t> counts_;
+
+    std::uint64_t total_ = 0;
+    std::int64_t min_ = std::numeric_limits<std::int64_t>::max();
+    std::int64_t max_ = 0;
+    double sum_ = 0;
+
+    static
+    auto half_count_magnitude(int const significant_figures) -> int
+    {
+        std::int64_t const largest_single_unit = 2 * static_cast<std::int64_t>(std::pow(10, significant_figures));
+        return static_cast<int>(std::ceil(std::log2(largest_single_unit))) - 1;
+    }
+
+    static
+    auto bucket_count(std::int64_t const highest, std::int64_t const sub_bucket_count) -> int
+    {
+        std::int64_t smallest_untrackable = sub_bucket_count;
+        int buckets = 1;
+        while (smallest_untrackable <= highest)
+        {
+            if (smallest_untrackable > std::numeric_limits<std::int64_t>::max() / 2)
+                return buckets + 1;
+            smallest_untrackable <<= 1;
+            buckets++;
+        }
+        return buckets;
+    }
+
+    auto bucket_index(std::int64_t const value) const -> int
+    {
+        int const pow2ceiling = 64 - std::countl_zero(static_cast<std::uint64_t>(value | sub_bucket_mask_));
+        return pow2ceiling - (sub_bucket_half_count_magnitude_ + 1);
+    }
+
+    auto sub_bucket_index(std::int64_t const value, int const bucket) const -> std::int64_t {
+        return value >> bucket;
+    }
+
+    auto counts_index(int const bucket, std::int64_t const sub_bucket) const -> std::size_t {
+        return ((static_cast<std::int64_t>(bucket) + 1) << sub_bucket_half_count_magnitude_) + (sub_bucket - sub_bucket_half_count_);
+    }
+
+    auto value_at_index(std::size_t const index) const -> std::int64_t
+    {
+        int bucket = static_cast<int>(index >> sub_bucket_half_count_magnitude_) - 1;
+        std::int64_t sub_bucket = (index & (sub_bucket_half_count_ - 1)) + sub_bucket_half_count_;
+        if (bucket < 0)
+        {
+            sub_bucket -= sub_bucket_half_count_;
+            bucket = 0;
+        }
+        return sub_bucket << bucket;
+    }
+
+    // every value in [lowest_equivalent(v), highest_equivalent(v)] lands in the same count
+    auto highest_equivalent(std::int64_t const value) const -> std::int64_t
+    {
+        int const bucket = bucket_index(value);
+        std::int64_t const sub_bucket = sub_bucket_index(value, bucket);
+        std::int64_t const lowest = sub_bucket << bucket;
+        int const adjusted_bucket = (sub_bucket >= sub_bucket_count_) ? bucket + 1 : bucket;
+        return lowest + (std::int64_t{1} << adjusted_bucket) - 1;
+    }
+
+public:
+    hdr_histogram(std::int64_t const highest = 3'600'000'000'000, int const significant_figures = 3):
+        highest_{highest},
+        sub_bucket_half_count_magnitude_{half_count_magnitude(significant_figures)},
+        sub_bucket_count_{std::int64_t{1} << (sub_bucket_half_count_magnitude_ + 1)},
+        sub_bucket_half_count_{sub_bucket_count_ / 2},
+        sub_bucket_mask_{sub_bucket_count_ - 1},
+        counts_((bucket_count(highest, sub_bucket_count_) + 1) * sub_bucket_half_count_, 0) {}
+
+    // values past the trackable range are clamped to it
+    void record(std::int64_t value, std::uint64_t const count = 1)
+    {
+        value = std::clamp<std::int64_t>(value, 0, highest_);
+        counts_.at(counts_index(bucket_index(value), sub_bucket_index(value, bucket_index(value)))) += count;
+        total_ += count;
+        min_ = std::min(min_, value);
+        max_ = std::max(max_, value);
+        sum_ += static_cast<double>(value) * count;
+    }
+
+    // other must have the same highest value and significant figures
+    void merge(hdr_histogram const& other)
+    {
+        for (std::size_t i = 0; i < counts_.size(); i++)
+            counts_[i] += other.counts_.at(i);
+        total_ += other.total_;
+        min_ = std::min(min_, other.min_);
+        max_ = std::max(max_, other.max_);
+        sum_ += other.sum_;
+    }
+
+    auto value_at_percentile(double const percentile) const -> std::int64_t
+    {
+        if (total_ == 0)
+            return 0;
+
+        double const p = std::clamp(percentile, 0.0, 100.0);
+        std::uint64_t const count_at = std::max<std::uint64_t>(1, static_cast<std::uint64_t>(p / 100.0 * total_ + 0.5));
+
+        std::uint64_t seen = 0;
+        for (std::size_t i = 0; i < counts_.size(); i++)
+        {
+            seen += counts_[i];
+            if (seen >= count_at)
+                return std::min(max_, highest_equivalent(value_at_index(i)));
+        }
+        return max_;
+    }
+
+    auto count() const -> std::uint64_t { return total_; }
+    auto min()   const -> std::int64_t  { return total_ == 0 ? 0 : min_; }
+    auto max()   const -> std::int64_t  { return max_; }
+    auto mean()  const -> double        { return total_ == 0 ? 0 : sum_ / total_; }
+};
+
+} // namespace ssbd
+
+#endif // HDR_HISTOGRAM_HPP__
@@ -0,0 +1,162 @@
+#pragma once
+
+#ifndef KEY_SPACE_HPP__
+#define KEY_SPACE_HPP__
+
+#include "leveldb-serializer.hpp"
+#include "block-engine.hpp"
+
+#include <boost/log/trivial.hpp>
+
+#include <string>
+#include <string_view>
+
+namespace ssbd::keyspace
+{
+
+// Every db key is |space (1 byte)|uuid (32 bytes)|blockid (4 bytes, big endian)|.
+// The space byte keeps blocks, replica copies and 2pc records apart, so the
+// blocks of a file form one contiguous range ordered by blockid.
+enum class space_t : char
+{
+    data              = 'D', // committed blocks
+    replica           = 'R', // copies written by the replica chain
+    committed_version = 'C',
+    pending_version   = 'V', // leveldb_log only
+    pending_data      = 'L', // leveldb_log only
+    meta              = 'M', // not block keys. see format_key()
+};
+
+constexpr std::size_t block_key_size = slsfs::leveldb_pack::packet_header::key_size;
+constexpr std::size_t key_size = 1 + block_key_size;
+
+inline
+auto make (space_t const space, slsfs::leveldb_pack::packet_header const& header) -> std::string
+{
+    std::string key(key_size, static_cast<char>(space));
+    std::uint32_t const blockid = slsfs::leveldb_pack::hton(header.blockid);
+    std::memcpy(key.data() + 1, header.uuid.data(), header.uuid.size());
+    std::memcpy(key.data() + 1 + header.uuid.size(), &blockid, sizeof(blockid));
+    return key;
+}
+
+inline
+auto data_key (slsfs::leveldb_pack::packet_header const& header) -> std::string {
+    return make(space_t::data, header);
+}
+
+inline
+auto replica_key (slsfs::leveldb_pack::packet_header const& header) -> std::string {
+    return make(space_t::replica, header);
+}
+
+// every key of space starts with this
+inline
+auto space_prefix (space_t const space) -> std::string { return std::string(1, static_cast<char>(space)); }
+
+// the storage shard key of the file a key belongs to
+inline
+auto file_of (std::string_view const key) -> std::string {
+    return std::string{key.substr(1, std::tuple_size<slsfs::leveldb_pack::key_t>::value)};
+}
+
+// the same block in another space
+inline
+auto rebase (std::string key, space_t const space) -> std::string
+{
+    if (not key.empty())
+        key.front() = static_cast<char>(space);
+    return key;
+}
+
+inline
+bool in_space (std::string_view const key, space_t const space) {
+    return key.size() == key_size and key.front() == static_cast<char>(space);
+}
+
+// [begin, end) of all blocks of the file in space; seek to begin and stop once a key is >= end
+inline
+auto file_begin (space_t const space, slsfs::leveldb_pack::key_t const& uuid) -> std::string
+{
+    slsfs::leveldb_pack::packet_header header;
+    header.uuid = uuid;
+    header.blockid = 0;
+    return make(space, header);
+}
+
+inline
+auto file_end (space_t const space, slsfs::leveldb_pack::key_t const& uuid) -> std::string
+{
+    // |space|uuid| and one byte more 0xff than a blockid: after every block of the file, before the next uuid
+    std::string end = file_begin(space, uuid).substr(0, 1 + uuid.size());
+    end.append(sizeof(slsfs::leveldb_pack::packet_header::blockid) + 1, '\xff');
+    return end;
+}
+
+// end of the range [.., last]: sorts right after the key of block last
+inline
+auto block_end (space_t const space, slsfs::leveldb_pack::packet_header header, std::uint32_t const last) -> std::string
+{
+    header.blockid = last;
+    std::string end = make(space, header);
+    end.push_back('\0');
+    return end;
+}
+
+inline
+auto blockid_of (std::string_view const key) -> std::uint32_t
+{
+    std::uint32_t blockid = 0;
+    std::memcpy(&blockid, key.data() + key_size - sizeof(blockid), sizeof(blockid));
+    return slsfs::leveldb_pack::ntoh(blockid);
+}
+
+// marks a db as using this key format. written by the migrate tool and by fresh servers
+inline
+auto format_key () -> std::string { return std::string(1, static_cast<char>(space_t::meta)) + "key-format"; }
+constexpr std::string_view format_version = "2";
+
+// refuses to serve a db still holding |uuid|decimal blockid| keys; marks an empty one
+inline
+void check_format (engine::block_engine& db)
+{
+    std::string version;
+    if (db.get(format_key(), version))
+    {
+        if (version != format_version)
+            throw std::runtime_error("unknown key format " + version);
+        return;
+    }
+
+    std::unique_ptr<engine::iterator> it = db.new_iterator();
+    it->seek("");
+    if (it->valid())
+    {
+        BOOST_LOG_TRIVIAL(error) << "db has keys in the old format. run migrate on it first";
+        throw std::runtime_error("db needs key migration");
+    }
+
+    db.put(format_key(), std::string{format_version});
+}
+
+// a per-core db only holds the keys hashed to its shard; opening it as
+// another shard, or with another shard count, would lose them
+inline
+void check_shard (engine::block_engine& db, std::size_t const index, std::size_t const count)
+{
+    std::string const key = std::string(1, static_cast<char>(space_t::meta)) + "core-shard";
+    std::string const expected = std::to_string(index) + "/" + std::to_string(count);
+
+    std::string shard;
+    if (db.get(key, shard))
+    {
+        if (shard != expected)
+            throw std::runtime_error("db is core shard " + shard + ", opened as " + expected);
+        return;
+    }
+    db.put(key, expected);
+}
+
+} // namespace ssbd::keyspace
+
+#endif // KEY_SPACE_HPP__
@@ -0,0 +1,124 @@
+#pragma once
+
+#ifndef LOG_GC_HPP__
+#define LOG_GC_HPP__
+
+#include "basic.hpp"
+#include "persistent-log.hpp"
+#include "storage-executor.hpp"
+#include "key-space.hpp"
+
+#include <boost/log/trivial.hpp>
+#include <boost/asio.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace ssbd
+{
+
+// Drops the payloads of committed and rolled back prepares from the 2pc log in the
+// background, so prepare-path lookups on the log stay in memory.
+// Every tick scans at most keys_per_tick log records; the keys found are collected on
+// their storage shard, ordered with the prepares and commits of the same file.
+class log_gc : public std::enable_shared_from_this<log_gc>
+{
+    net::steady_timer timer_;
+    persistent_log& log_;
+    storage_executor& storage_;
+    std::size_t const keys_per_tick_;
+    std::chrono::milliseconds const interval_;
+
+    std::string cursor_; // only used by the running scan
+    std::atomic<int> pending_ = 0; // scans and collections still queued on the storage shards
+
+    std::atomic<std::uint64_t> scanned_ = 0, collected_ = 0, rounds_ = 0;
+
+    void start_tick()
+    {
+        timer_.expires_after(interval_);
+        timer_.async_wait(
+            [self=shared_from_this()] (boost::system::error_code const& ec) {
+                if (ec)
+                    return;
+
+                // the last tick is still running; keep the rate instead of queueing up
+                if (self->pending_ == 0)
+                    self->start_scan();
+                self->start_tick();
+            });
+    }
+
+    void start_scan()
+    {
+        pending_++;
+        storage_.post(
+            "log-gc",
+            [self=shared_from_this()] {
+                persistent_log::garbage g;
+                try
+                {
+                    g = self->log_.find_garbage(self->cursor_, self->keys_per_tick_);
+                }
+                catch (std::exception const& e)
+                {
+                    BOOST_LOG_TRIVIAL(error) << "log gc scan error: " << e.what();
+                }
+                self->scanned_ += g.scanned;
+                if (self->cursor_.empty())
+                    self->rounds_++;
+
+                std::map<std::string, std::vector<std::string>> by_file;
+                for (std::string& key : g.keys)
+                    by_file[keyspace::file_of(key)].push_back(std::move(key));
+
+                for (auto& [file, keys] : by_file)
+                {
+                    self->pending_++;
+                    self->storage_.post(
+                        file,
+                        [self, keys=std::move(keys)] {
+                            try
+                            {
+                                self->collected_ += self->log_.collect_garbage(keys);
+                            }
+                            catch (std::exception const& e)
+                            {
+                                BOOST_LOG_TRIVIAL(error) << "log gc collect error: " << e.what();
+                            }
+                            self->pending_--;
+                        });
+                }
+
+                if (g.scanned > 0)
+                    BOOST_LOG_TRIVIAL(debug) << "log gc: scanned " << g.scanned << ", found " << g.keys.size()
+                                             << ". total scanned=" << self->scanned_ << " collected=" << self->collected_
+                                             << " rounds=" << self->rounds_;
+                self->pending_--;
+            });
+    }
+
+public:
+    // keys_per_second is the most log records scanned per second
+    log_gc(net::io_context& io, persistent_log& log, storage_executor& storage, std::size_t const keys_per_second,
+           std::chrono::milliseconds const interval = std::chrono::milliseconds{100}):
+        timer_{io}, log_{log}, storage_{storage},
+        keys_per_tick_{std::max<std::size_t>(1, keys_per_second * interval.count() / 1000)},
+        interval_{interval} {}
+
+    void start() { start_tick(); }
+    void stop()  { timer_.cancel(); }
+
+    auto scanned()   const -> std::uint64_t { return scanned_.load(); }
+    auto collected() const -> std::uint64_t { return collected_.load(); }
+    auto rounds()    const -> std::uint64_t { return rounds_.load(); } // full passes over the log
+};
+
+} // namespace ssbd
+
+#endif // LOG_GC_HPP__
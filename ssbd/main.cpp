@@ -3,6 +3,20 @@
 #include "rawblocks.hpp"
 #include "socket-writer.hpp"
 #include "persistent-log.hpp"
+#include "persistent-log-leveldb.hpp"
+#include "persistent-log-segment.hpp"
+#include "storage-executor.hpp"
+#include "block-engine.hpp"
+#include "block-engine-leveldb.hpp"
+#include "block-engine-memory.hpp"
+#include "block-engine-uring.hpp"
+#include "block-engine-sharded.hpp"
+#include "block-cache.hpp"
+#include "buffer-pool.hpp"
+#include "framing-reader.hpp"
+#include "chain-link.hpp"
+#include "key-space.hpp"
+#include "log-gc.hpp"
 
 #include <boost/program_options.hpp>
 #include <boost/log/trivial.hpp>
@@ -12,12 +26,11 @@
 #include <oneapi/tbb/concurrent_unordered_map.h>
 #include <oneapi/tbb/concurrent_queue.h>
 
-#include <leveldb/db.h>
-#include <leveldb/cache.h>
-
 #include <algorithm>
+#include <atomic>
 #include <iostream>
 #include <memory>
+#include <optional>
 #include <array>
 #include <list>
 #include <thread>
@@ -32,118 +45,240 @@ class tcp_connection : public std::enable_shared_from_this<tcp_connection>
     tcp::socket      socket_;
 
     slsfs::socket_writer::socket_writer<slsfs::leveldb_pack::packet, std::vector<slsfs::leveldb_pack::unit_t>> writer_;
-    leveldb::DB&    db_;
-    persistent_log& db_log_;
-    std::chrono::steady_clock::time_point start_read_header_timestamp_ = std::chrono::steady_clock::now();
+    engine::block_engine& db_;
+    persistent_log&       db_log_;
+    storage_executor&     storage_;
+    chain_link*           chain_; // next ssbd of the replica chain. nullptr at the tail
+    std::shared_ptr<buffer_pool> pool_;
+    slsfs::framing_reader::framing_reader<slsfs::leveldb_pack::packet_header, pooled_buffer> reader_;
+
+    // window granted to the client. past credits_.ops requests or credits_.bytes of
+    // request bodies in flight the connection stops reading until responses go out
+    // and the bodies are released. 0 is no limit
+    slsfs::leveldb_pack::credit_grant const credits_;
+    std::atomic<std::uint32_t> inflight_ = 0;
+    std::atomic<std::size_t>   inflight_bytes_ = 0;
+
+    bool over_window() const
+    {
+        return (credits_.ops   > 0 and inflight_       >= credits_.ops) or
+               (credits_.bytes > 0 and inflight_bytes_ >= credits_.bytes);
+    }
+
+    void resume_under_window()
+    {
+        if (not over_window())
+            reader_.resume();
+    }
 
 public:
     using pointer = std::shared_ptr<tcp_connection>;
 
-    tcp_connection(net::io_context& io, tcp::socket socket, leveldb::DB& db, persistent_log& db_log):
+    tcp_connection(net::io_context& io, tcp::socket socket, engine::block_engine& db, persistent_log& db_log,
+                   storage_executor& storage, chain_link* chain, slsfs::leveldb_pack::credit_grant const credits):
         io_context_{io},
         socket_{std::move(socket)},
         writer_{io, socket_},
         db_{db},
-        db_log_{db_log} {}
+        db_log_{db_log},
+        storage_{storage},
+        chain_{chain},
+        pool_{std::make_shared<buffer_pool>(slsfs::leveldb_pack::rawblocks::delta_header_size +
+                                            slsfs::leveldb_pack::rawblocks{}.fullsize(), 64)},
+        reader_{socket_,
+                body_size,
+                [this] (slsfs::leveldb_pack::packet_header const& header, std::size_t const size) {
+                    return pool_->acquire(body_headroom(header) + size);
+                },
+                [this] (slsfs::leveldb_pack::packet_header const& header, std::shared_ptr<pooled_buffer> body) {
+                    dispatch(header, std::move(body));
+                },
+                [] (boost::system::error_code ec) {
+                    if (ec != net::error::eof)
+                        BOOST_LOG_TRIVIAL(error) << "start_read err: " << ec.message();
+                }},
+        credits_{credits} {}
+
+    // every block of a file maps to one storage shard, so batch requests
+    // are ordered with the single-block requests on the same file
+    static
+    auto shard_key (slsfs::leveldb_pack::packet_header const& header) -> std::string {
+        return std::string(header.uuid.begin(), header.uuid.end());
+    }
 
-    void start_read_header()
+    // get and rollback carry the read size / nothing in datasize; no body follows them
+    static
+    auto body_size (slsfs::leveldb_pack::packet_header const& header) -> std::size_t
     {
-//        BOOST_LOG_TRIVIAL(trace) << "start_read_header. delta=" << std::chrono::steady_clock::now() - start_read_header_timestamp_;
-        start_read_header_timestamp_ = std::chrono::steady_clock::now();
-        auto read_buf = std::make_shared<std::array<slsfs::leveldb_pack::unit_t, slsfs::leveldb_pack::packet_header::bytesize>>();
-        net::async_read(
-            socket_,
-            net::buffer(read_buf->data(), read_buf->size()),
-            [self=shared_from_this(), read_buf] (boost::system::error_code ec, std::size_t /*length*/) {
-                if (ec)
-                    BOOST_LOG_TRIVIAL(error) << "start_read_header err: " << ec.message();
-                else
-                {
-                    slsfs::leveldb_pack::packet_pointer pack = std::make_shared<slsfs::leveldb_pack::packet>();
-                    pack->header.parse(read_buf->data());
-                    //BOOST_LOG_TRIVIAL(trace) << "start_read_header start with header: " << pack->header;
+        switch (header.type)
+        {
+        case slsfs::leveldb_pack::msg_t::get:
+        case slsfs::leveldb_pack::msg_t::get_replica:
+        case slsfs::leveldb_pack::msg_t::two_pc_commit_rollback:
+        case slsfs::leveldb_pack::msg_t::err:
+        case slsfs::leveldb_pack::msg_t::ack:
+        case slsfs::leveldb_pack::msg_t::two_pc_commit_ack:
+        case slsfs::leveldb_pack::msg_t::two_pc_prepare_agree:
+        case slsfs::leveldb_pack::msg_t::two_pc_prepare_abort:
+            return 0;
+        default:
+            return header.datasize;
+        }
+    }
 
-                    slsfs::leveldb_pack::packet_pointer resp2 = std::make_shared<slsfs::leveldb_pack::packet>();
-                    switch (pack->header.type)
-                    {
-                    case slsfs::leveldb_pack::msg_t::two_pc_prepare:
-                        self->start_two_pc_prepare(pack);
-                        break;
-
-                    case slsfs::leveldb_pack::msg_t::two_pc_prepare_quick:
-                        self->start_two_pc_prepare_quick(pack);
-                        break;
-
-                    case slsfs::leveldb_pack::msg_t::two_pc_commit_execute:
-                        self->start_two_pc_commit_execute(pack);
-                        break;
-
-                    case slsfs::leveldb_pack::msg_t::two_pc_commit_rollback:
-                        self->start_two_pc_commit_rollback(pack);
-                        break;
-
-                    case slsfs::leveldb_pack::msg_t::replication:
-                        self->start_replication(pack);
-                        break;
-
-                    case slsfs::leveldb_pack::msg_t::get:
-                        self->start_db_read(pack);
-                        break;
-
-                    case slsfs::leveldb_pack::msg_t::err:
-                    case slsfs::leveldb_pack::msg_t::ack:
-                    case slsfs::leveldb_pack::msg_t::two_pc_commit_ack:
-                    case slsfs::leveldb_pack::msg_t::two_pc_prepare_agree:
-                    case slsfs::leveldb_pack::msg_t::two_pc_prepare_abort:
-                    {
-                        BOOST_LOG_TRIVIAL(error) << "server should not get (" << pack->header.type << "). " << pack->header;
-                        slsfs::leveldb_pack::packet_pointer resp = std::make_shared<slsfs::leveldb_pack::packet>();
-                        resp->header = pack->header;
-                        resp->header.type = slsfs::leveldb_pack::msg_t::err;
-                        self->start_write_socket(resp);
-                        self->start_read_header();
-                        break;
-                    }
-                    }
-                }
-            });
+    // single-block prepares get room for the delta header in front of the body
+    static
+    auto body_headroom (slsfs::leveldb_pack::packet_header const& header) -> std::size_t
+    {
+        switch (header.type)
+        {
+        case slsfs::leveldb_pack::msg_t::two_pc_prepare:
+        case slsfs::leveldb_pack::msg_t::two_pc_prepare_quick:
+            return slsfs::leveldb_pack::rawblocks::delta_header_size;
+        default:
+            return 0;
+        }
     }
 
-    void start_two_pc_prepare(slsfs::leveldb_pack::packet_pointer pack)
+    void start_read() {
+        reader_.start_read(shared_from_this());
+    }
+
+    // runs on the reading thread for every packet, in order; handlers only post work
+    void dispatch(slsfs::leveldb_pack::packet_header const& header, std::shared_ptr<pooled_buffer> body)
     {
-        BOOST_LOG_TRIVIAL(trace) << "start_two_pc_prepare " << pack->header;
-        auto read_buf = std::make_shared<std::string>(pack->header.datasize, 0);
-        net::async_read(
-            socket_,
-            net::buffer(read_buf->data(), read_buf->size()),
-            [self=shared_from_this(), read_buf, pack] (boost::system::error_code ec, std::size_t length) {
-                if (ec)
-                {
-                    BOOST_LOG_TRIVIAL(error) << "start_two_pc_prepare: " << ec.message();
-                    return;
-                }
+        slsfs::leveldb_pack::packet_pointer pack = std::make_shared<slsfs::leveldb_pack::packet>();
+        pack->header = header;
+        //BOOST_LOG_TRIVIAL(trace) << "dispatch header: " << pack->header;
+
+        // every request gets exactly one response through start_write_socket, which gives the op back.
+        // the body bytes come back when the last holder of the body lets go of it
+        inflight_++;
+        if (std::size_t const bytes = body_size(header); credits_.bytes > 0 and bytes > 0)
+        {
+            inflight_bytes_ += bytes;
+            body = std::shared_ptr<pooled_buffer>(
+                body.get(),
+                [self=shared_from_this(), body, bytes] (pooled_buffer*) {
+                    self->inflight_bytes_ -= bytes;
+                    self->resume_under_window();
+                });
+        }
 
-                BOOST_LOG_TRIVIAL(trace) << "start_two_pc_prepare process packet: " << pack->header;
+        if (over_window())
+        {
+            reader_.pause();
+            // the responses may all have gone out before the pause
+            resume_under_window();
+        }
 
-                pack->data.parse(length, read_buf->data());
+        switch (pack->header.type)
+        {
+        case slsfs::leveldb_pack::msg_t::two_pc_prepare:
+            start_two_pc_prepare(pack, std::move(body));
+            break;
+
+        case slsfs::leveldb_pack::msg_t::two_pc_prepare_quick:
+            start_two_pc_prepare_quick(pack, std::move(body));
+            break;
+
+        case slsfs::leveldb_pack::msg_t::two_pc_commit_execute:
+            start_two_pc_commit_execute(pack, std::move(body));
+            break;
+
+        case slsfs::leveldb_pack::msg_t::two_pc_commit_rollback:
+            start_two_pc_commit_rollback(pack);
+            break;
+
+        case slsfs::leveldb_pack::msg_t::replication:
+            start_replication(pack, std::move(body));
+            break;
+
+        case slsfs::leveldb_pack::msg_t::two_pc_prepare_batch:
+        case slsfs::leveldb_pack::msg_t::two_pc_prepare_quick_batch:
+            start_two_pc_prepare_batch(pack, std::move(body));
+            break;
+
+        case slsfs::leveldb_pack::msg_t::two_pc_commit_execute_batch:
+        case slsfs::leveldb_pack::msg_t::two_pc_commit_rollback_batch:
+            start_two_pc_commit_batch(pack, std::move(body));
+            break;
+
+        case slsfs::leveldb_pack::msg_t::replication_batch:
+            start_replication_batch(pack, std::move(body));
+            break;
+
+        case slsfs::leveldb_pack::msg_t::get:
+            start_db_read(pack, keyspace::space_t::data);
+            break;
+
+        case slsfs::leveldb_pack::msg_t::get_range:
+            start_db_read_range(pack, std::move(body), keyspace::space_t::data);
+            break;
+
+        // the copies this ssbd holds as a member of another ssbd's replica chain
+        case slsfs::leveldb_pack::msg_t::get_replica:
+            start_db_read(pack, keyspace::space_t::replica);
+            break;
+
+        case slsfs::leveldb_pack::msg_t::get_range_replica:
+            start_db_read_range(pack, std::move(body), keyspace::space_t::replica);
+            break;
+
+        case slsfs::leveldb_pack::msg_t::file_stat:
+            start_file_stat(pack, std::move(body));
+            break;
+
+        case slsfs::leveldb_pack::msg_t::file_truncate:
+        case slsfs::leveldb_pack::msg_t::file_delete:
+            start_file_remove(pack, std::move(body));
+            break;
+
+        case slsfs::leveldb_pack::msg_t::credit:
+            start_credit(pack);
+            break;
+
+        case slsfs::leveldb_pack::msg_t::err:
+        case slsfs::leveldb_pack::msg_t::ack:
+        case slsfs::leveldb_pack::msg_t::two_pc_commit_ack:
+        case slsfs::leveldb_pack::msg_t::two_pc_prepare_agree:
+        case slsfs::leveldb_pack::msg_t::two_pc_prepare_abort:
+        {
+            BOOST_LOG_TRIVIAL(error) << "server should not get (" << pack->header.type << "). " << pack->header;
+            slsfs::leveldb_pack::packet_pointer resp = std::make_shared<slsfs::leveldb_pack::packet>();
+            resp->header = pack->header;
+            resp->header.type = slsfs::leveldb_pack::msg_t::err;
+            start_write_socket(resp);
+            break;
+        }
+        }
+    }
 
-                slsfs::leveldb_pack::packet_pointer resp = std::make_shared<slsfs::leveldb_pack::packet>();
-                resp->header = pack->header;
+    void start_credit(slsfs::leveldb_pack::packet_pointer pack)
+    {
+        slsfs::leveldb_pack::packet_pointer resp = std::make_shared<slsfs::leveldb_pack::packet>();
+        resp->header = pack->header;
+        resp->data.buf.resize(slsfs::leveldb_pack::credit_grant::bytesize);
+        slsfs::leveldb_pack::credit_grant grant = credits_;
+        grant.dump(resp->data.buf.data());
+
+        BOOST_LOG_TRIVIAL(debug) << "grant " << credits_.ops << " ops, " << credits_.bytes << " bytes";
+        start_write_socket(resp);
+    }
 
-                std::string const key = pack->header.as_string();
-                slsfs::leveldb_pack::rawblocks rb;
+    void start_two_pc_prepare(slsfs::leveldb_pack::packet_pointer pack, std::shared_ptr<pooled_buffer> body)
+    {
+        BOOST_LOG_TRIVIAL(trace) << "start_two_pc_prepare " << pack->header;
 
+        std::string const key = keyspace::data_key(pack->header);
+        storage_.post(
+            shard_key(pack->header),
+            [self=shared_from_this(), body, pack, key] {
+                slsfs::leveldb_pack::packet_pointer resp = std::make_shared<slsfs::leveldb_pack::packet>();
+                resp->header = pack->header;
                 resp->header.type = slsfs::leveldb_pack::msg_t::two_pc_prepare_agree;
 
-                if (not rb.bind(self->db_, key).ok())
-                {
-                    std::string empty;
-                    self->db_.Put(leveldb::WriteOptions(), key, empty);
-                    self->db_log_.put_committed_version(key, 0);
-                    self->db_log_.put_pending_prepare(key, "", 0);
-                }
-
-                if (rb.bind(self->db_, key).ok())
+                try
                 {
                     BOOST_LOG_TRIVIAL(debug) << "start_two_pc_prepare committed version: " << self->db_log_.get_committed_version(key);
                     BOOST_LOG_TRIVIAL(debug) << "start_two_pc_prepare pending version:   " << self->db_log_.get_pending_prepare_version(key);
@@ -156,195 +291,631 @@ public:
                     }
                     else
                     {
-                        // OK
-                        //BOOST_LOG_TRIVIAL(debug) << "request buf: " << *read_buf;
-                        std::string old_block (std::move(rb.buf_)); // move the unused data in .buf_ to here
-                        old_block.resize(
-                            std::max<std::uint32_t>(pack->header.position + pack->header.datasize,
-                                                    old_block.size())); // make sure all buffer can write to old_block
-
-                        std::copy(read_buf->begin(), read_buf->end(),
-                                  std::next(old_block.begin(), pack->header.position));
-
-                        //BOOST_LOG_TRIVIAL(trace) << "final block: " << old_block;
-
-                        self->db_log_.put_pending_prepare(key, old_block, pack->header.version);
+                        // OK. only log the written range; commit merges it into the block.
+                        // the delta header goes into the headroom in front of the body
+                        slsfs::leveldb_pack::rawblocks::write_delta_header(body->data(), pack->header.position);
+                        self->db_log_.put_pending_prepare(key, body->view(), pack->header.version);
                     }
-                    pack->header.version = self->db_log_.get_committed_version(key);
+                }
+                catch (std::exception const& e)
+                {
+                    BOOST_LOG_TRIVIAL(error) << "start_two_pc_prepare error: " << e.what();
+                    resp->header.type = slsfs::leveldb_pack::msg_t::err;
                 }
 
                 BOOST_LOG_TRIVIAL(trace) << "start_two_pc_prepare return packet: " << pack->header;
                 self->start_write_socket(resp);
-                self->start_read_header();
             });
     }
 
-    void start_two_pc_prepare_quick(slsfs::leveldb_pack::packet_pointer pack)
+    void start_two_pc_prepare_quick(slsfs::leveldb_pack::packet_pointer pack, std::shared_ptr<pooled_buffer> body)
     {
         BOOST_LOG_TRIVIAL(trace) << "start_two_pc_prepare_quick " << pack->header;
-        auto read_buf = std::make_shared<std::string>(pack->header.datasize, 0);
-        net::async_read(
-            socket_,
-            net::buffer(read_buf->data(), read_buf->size()),
-            [self=shared_from_this(), read_buf, pack] (boost::system::error_code ec, std::size_t length) {
-                if (ec)
+
+        std::string const key = keyspace::data_key(pack->header);
+        storage_.post(
+            shard_key(pack->header),
+            [self=shared_from_this(), body, pack, key] {
+                slsfs::leveldb_pack::packet_pointer resp = std::make_shared<slsfs::leveldb_pack::packet>();
+                resp->header = pack->header;
+                resp->header.type = slsfs::leveldb_pack::msg_t::two_pc_prepare_agree;
+
+                try
                 {
-                    BOOST_LOG_TRIVIAL(error) << "start_two_pc_prepare_quick: " << ec.message();
-                    return;
+                    slsfs::leveldb_pack::rawblocks::write_delta_header(body->data(), pack->header.position);
+                    self->db_log_.put_pending_prepare(key, body->view(), pack->header.version);
                 }
-                self->start_read_header();
-                BOOST_LOG_TRIVIAL(trace) << "start_two_pc_prepare_quick process packet: " << pack->header;
+                catch (std::exception const& e)
+                {
+                    BOOST_LOG_TRIVIAL(error) << "start_two_pc_prepare_quick error: " << e.what();
+                    resp->header.type = slsfs::leveldb_pack::msg_t::err;
+                }
+
+                BOOST_LOG_TRIVIAL(trace) << "start_two_pc_prepare_quick return packet: " << pack->header;
+                self->start_write_socket(resp);
+            });
+    }
 
-                pack->data.parse(length, read_buf->data());
+    void start_two_pc_commit_execute(slsfs::leveldb_pack::packet_pointer pack, std::shared_ptr<pooled_buffer> /*body*/)
+    {
+        BOOST_LOG_TRIVIAL(trace) << "start_two_pc_commit_execute " << pack->header;
+        std::string const key = keyspace::data_key(pack->header);
 
+        storage_.post(
+            shard_key(pack->header),
+            [self=shared_from_this(), pack, key] {
                 slsfs::leveldb_pack::packet_pointer resp = std::make_shared<slsfs::leveldb_pack::packet>();
                 resp->header = pack->header;
+                resp->header.type = slsfs::leveldb_pack::msg_t::two_pc_commit_ack;
+
+                try
+                {
+                    self->db_log_.commit_pending_prepare(key, self->db_);
+                }
+                catch (std::exception const& e)
+                {
+                    BOOST_LOG_TRIVIAL(error) << "start_two_pc_commit_execute error: " << e.what();
+                    resp->header.type = slsfs::leveldb_pack::msg_t::err;
+                }
 
-                std::string const key = pack->header.as_string();
-                slsfs::leveldb_pack::rawblocks rb;
+                self->start_write_socket(resp);
+            });
+    }
 
-                resp->header.type = slsfs::leveldb_pack::msg_t::two_pc_prepare_agree;
+    void start_two_pc_commit_rollback(slsfs::leveldb_pack::packet_pointer pack)
+    {
+        BOOST_LOG_TRIVIAL(trace) << "start_two_pc_commit_rollback " << pack->header;
+        std::string const key = keyspace::data_key(pack->header);
 
-                if (not rb.bind(self->db_, key).ok())
+        storage_.post(
+            shard_key(pack->header),
+            [self=shared_from_this(), pack, key] {
+                slsfs::leveldb_pack::packet_pointer resp = std::make_shared<slsfs::leveldb_pack::packet>();
+                resp->header = pack->header;
+                resp->header.type = slsfs::leveldb_pack::msg_t::two_pc_commit_ack;
+
+                try
                 {
-                    std::string empty;
-                    self->db_.Put(leveldb::WriteOptions(), key, empty);
-                    self->db_log_.put_committed_version(key, 0);
                     self->db_log_.put_pending_prepare(key, "", 0);
                 }
-
-                if (rb.bind(self->db_, key).ok())
+                catch (std::exception const& e)
                 {
-                    std::string old_block (std::move(rb.buf_)); // move the unused data in .buf_ to here
-                    old_block.resize(
-                        std::max<std::uint32_t>(pack->header.position + pack->header.datasize,
-                                                old_block.size())); // make sure all buffer can write to old_block
-
-                    std::copy(read_buf->begin(), read_buf->end(),
-                              std::next(old_block.begin(), pack->header.position));
-
-                    self->db_log_.put_pending_prepare(key, old_block, pack->header.version);
-                    pack->header.version = self->db_log_.get_committed_version(key);
+                    BOOST_LOG_TRIVIAL(error) << "start_two_pc_commit_rollback error: " << e.what();
+                    resp->header.type = slsfs::leveldb_pack::msg_t::err;
                 }
 
-                BOOST_LOG_TRIVIAL(trace) << "start_two_pc_prepare_quick return packet: " << pack->header;
                 self->start_write_socket(resp);
             });
     }
 
-    void start_two_pc_commit_execute(slsfs::leveldb_pack::packet_pointer pack)
+    // body of a *_batch request. each delta is built in place: the position is written
+    // over the already parsed size field right in front of the data, so the entries
+    // point into body and are only valid while it is alive.
+    // nullopt when an entry is cut short or bytes trail the last one: the batch is all or nothing
+    static
+    auto parse_batch (slsfs::leveldb_pack::packet_header const& header, pooled_buffer& body)
+        -> std::optional<std::vector<persistent_log::prepare_entry>>
     {
-        BOOST_LOG_TRIVIAL(trace) << "start_two_pc_commit_execute " << pack->header;
-        auto read_buf = std::make_shared<std::string>(pack->header.datasize, 0);
-        net::async_read(
-            socket_,
-            net::buffer(read_buf->data(), read_buf->size()),
-            [self=shared_from_this(), read_buf, pack] (boost::system::error_code ec, std::size_t length) {
-                if (ec)
+        static_assert(sizeof(slsfs::leveldb_pack::batch_entry::size) == slsfs::leveldb_pack::rawblocks::delta_header_size);
+
+        std::vector<persistent_log::prepare_entry> entries;
+        slsfs::leveldb_pack::packet_header blockheader = header;
+        std::size_t pos = 0;
+        while (pos < body.size())
+        {
+            if (pos + slsfs::leveldb_pack::batch_entry::bytesize > body.size())
+                return std::nullopt;
+
+            slsfs::leveldb_pack::batch_entry e;
+            e.parse(reinterpret_cast<slsfs::leveldb_pack::unit_t const*>(body.data() + pos));
+            pos += slsfs::leveldb_pack::batch_entry::bytesize;
+            if (e.size > body.size() - pos)
+                return std::nullopt;
+
+            blockheader.blockid = e.blockid;
+            char* const delta = body.data() + pos - slsfs::leveldb_pack::rawblocks::delta_header_size;
+            slsfs::leveldb_pack::rawblocks::write_delta_header(delta, e.position);
+            entries.push_back({keyspace::data_key(blockheader),
+                               std::string_view{delta, slsfs::leveldb_pack::rawblocks::delta_header_size + e.size}});
+            pos += e.size;
+        }
+        return entries;
+    }
+
+    // all blocks of one request for this ssbd. votes once for the whole batch
+    void start_two_pc_prepare_batch(slsfs::leveldb_pack::packet_pointer pack, std::shared_ptr<pooled_buffer> body)
+    {
+        BOOST_LOG_TRIVIAL(trace) << "start_two_pc_prepare_batch " << pack->header;
+        storage_.post(
+            shard_key(pack->header),
+            [self=shared_from_this(), body, pack] {
+                slsfs::leveldb_pack::packet_pointer resp = std::make_shared<slsfs::leveldb_pack::packet>();
+                resp->header = pack->header;
+                resp->header.type = slsfs::leveldb_pack::msg_t::two_pc_prepare_agree;
+
+                std::optional<std::vector<persistent_log::prepare_entry>> const parsed = parse_batch(pack->header, *body);
+                if (not parsed)
                 {
-                    BOOST_LOG_TRIVIAL(error) << "error start_two_pc_commit_execute: " << ec.message();
+                    BOOST_LOG_TRIVIAL(error) << "start_two_pc_prepare_batch: malformed batch body. vote abort " << pack->header;
+                    resp->header.type = slsfs::leveldb_pack::msg_t::two_pc_prepare_abort;
+                    self->start_write_socket(resp);
                     return;
                 }
-                self->start_read_header();
+                std::vector<persistent_log::prepare_entry> const& entries = *parsed;
 
-                pack->data.parse(length, read_buf->data());
-                std::string const key = pack->header.as_string();
+                try
+                {
+                    bool const check = (pack->header.type == slsfs::leveldb_pack::msg_t::two_pc_prepare_batch);
+                    bool const conflict = check and
+                        std::any_of(entries.begin(), entries.end(),
+                                    [&self] (persistent_log::prepare_entry const& e) {
+                                        return self->db_log_.have_pending_log(e.key);
+                                    });
+
+                    if (conflict)
+                        resp->header.type = slsfs::leveldb_pack::msg_t::two_pc_prepare_abort;
+                    else
+                        self->db_log_.put_pending_prepare_batch(entries, pack->header.version);
+                }
+                catch (std::exception const& e)
+                {
+                    BOOST_LOG_TRIVIAL(error) << "start_two_pc_prepare_batch error: " << e.what();
+                    resp->header.type = slsfs::leveldb_pack::msg_t::err;
+                }
 
-                self->db_log_.commit_pending_prepare(key, self->db_);
+                BOOST_LOG_TRIVIAL(trace) << "start_two_pc_prepare_batch " << entries.size() << " blocks. return packet: " << resp->header;
+                self->start_write_socket(resp);
+            });
+    }
 
+    void start_two_pc_commit_batch(slsfs::leveldb_pack::packet_pointer pack, std::shared_ptr<pooled_buffer> body)
+    {
+        BOOST_LOG_TRIVIAL(trace) << "start_two_pc_commit_batch " << pack->header;
+        storage_.post(
+            shard_key(pack->header),
+            [self=shared_from_this(), body, pack] {
                 slsfs::leveldb_pack::packet_pointer resp = std::make_shared<slsfs::leveldb_pack::packet>();
                 resp->header = pack->header;
                 resp->header.type = slsfs::leveldb_pack::msg_t::two_pc_commit_ack;
 
-                self->start_write_socket(resp);
+                slsfs::leveldb_pack::packet_pointer forward = nullptr;
+                try
+                {
+                    // the deltas leave the log on commit; pick them up for the chain first.
+                    // make_replication_batch reads the body untouched, so it goes before parse_batch
+                    if (pack->header.type == slsfs::leveldb_pack::msg_t::two_pc_commit_execute_batch and
+                        pack->header.position > 0)
+                        forward = self->make_replication_batch(pack->header, *body);
+
+                    std::optional<std::vector<persistent_log::prepare_entry>> parsed = parse_batch(pack->header, *body);
+                    if (not parsed)
+                        throw std::runtime_error("malformed batch body");
+
+                    std::vector<std::string> keys;
+                    for (persistent_log::prepare_entry& e : *parsed)
+                        keys.push_back(std::move(e.key));
+
+                    if (pack->header.type == slsfs::leveldb_pack::msg_t::two_pc_commit_execute_batch)
+                        self->db_log_.commit_pending_prepare_batch(keys, self->db_);
+                    else
+                        for (std::string const& key : keys)
+                            self->db_log_.put_pending_prepare(key, "", 0);
+                }
+                catch (std::exception const& e)
+                {
+                    BOOST_LOG_TRIVIAL(error) << "start_two_pc_commit_batch error: " << e.what() << " " << pack->header;
+                    resp->header.type = slsfs::leveldb_pack::msg_t::err;
+                    forward = nullptr;
+                }
+
+                if (forward)
+                    self->start_chain_forward(forward, resp);
+                else
+                    self->start_write_socket(resp);
             });
     }
 
-    void start_two_pc_commit_rollback(slsfs::leveldb_pack::packet_pointer pack)
+    // replication_batch with the pending deltas of the blocks in a commit body, for the next ssbd in the chain
+    auto make_replication_batch(slsfs::leveldb_pack::packet_header const& header, pooled_buffer const& body)
+        -> slsfs::leveldb_pack::packet_pointer
     {
-        BOOST_LOG_TRIVIAL(trace) << "start_two_pc_commit_rollback " << pack->header;
-        std::string const key = pack->header.as_string();
-
-        db_log_.put_pending_prepare(key, "", 0);
+        slsfs::leveldb_pack::packet_pointer forward = std::make_shared<slsfs::leveldb_pack::packet>();
+        forward->header = header;
+        forward->header.type = slsfs::leveldb_pack::msg_t::replication_batch;
+        forward->header.position = header.position - 1;
+
+        slsfs::leveldb_pack::buffer_t& out = forward->data.buf;
+        slsfs::leveldb_pack::packet_header blockheader = header;
+        for (std::size_t pos = 0; pos + slsfs::leveldb_pack::batch_entry::bytesize <= body.size();
+             pos += slsfs::leveldb_pack::batch_entry::bytesize)
+        {
+            slsfs::leveldb_pack::batch_entry e;
+            e.parse(reinterpret_cast<slsfs::leveldb_pack::unit_t const*>(body.data() + pos));
+            pos += e.size;
+
+            blockheader.blockid = e.blockid;
+            std::string const delta = db_log_.get_pending_prepare_data(keyspace::data_key(blockheader));
+            if (delta.size() < slsfs::leveldb_pack::rawblocks::delta_header_size)
+                continue;
+
+            std::uint32_t position = 0;
+            std::memcpy(&position, delta.data(), sizeof(position));
+            std::string_view const data = std::string_view{delta}.substr(slsfs::leveldb_pack::rawblocks::delta_header_size);
+
+            slsfs::leveldb_pack::batch_entry entry {
+                .blockid  = e.blockid,
+                .position = static_cast<std::uint16_t>(position),
+                .size     = static_cast<std::uint32_t>(data.size()),
+            };
+
+            std::size_t const start = out.size();
+            out.resize(start + slsfs::leveldb_pack::batch_entry::bytesize + data.size());
+            slsfs::leveldb_pack::unit_t* dest = entry.dump(out.data() + start);
+            std::memcpy(dest, data.data(), data.size());
+        }
+        return forward;
+    }
 
-        slsfs::leveldb_pack::packet_pointer resp = std::make_shared<slsfs::leveldb_pack::packet>();
-        resp->header = pack->header;
-        resp->header.type = slsfs::leveldb_pack::msg_t::two_pc_commit_ack;
+    // sends forward down the chain and replies resp upstream once the tail acked it
+    void start_chain_forward(slsfs::leveldb_pack::packet_pointer forward, slsfs::leveldb_pack::packet_pointer resp)
+    {
+        if (chain_ == nullptr)
+        {
+            BOOST_LOG_TRIVIAL(error) << "no next ssbd configured for chain replication of " << forward->header;
+            resp->header.type = slsfs::leveldb_pack::msg_t::err;
+            start_write_socket(resp);
+            return;
+        }
 
-        start_write_socket(resp);
-        start_read_header();
+        chain_->forward(
+            forward,
+            [self=shared_from_this(), resp] (slsfs::leveldb_pack::packet_pointer reply) {
+                if (reply->header.type != slsfs::leveldb_pack::msg_t::ack)
+                {
+                    BOOST_LOG_TRIVIAL(error) << "chain replication failed downstream: " << reply->header;
+                    resp->header.type = slsfs::leveldb_pack::msg_t::err;
+                }
+                self->start_write_socket(resp);
+            });
     }
 
-    // note: assumes the every replication are stored in different SSBD
-    void start_replication(slsfs::leveldb_pack::packet_pointer pack)
+    // applies a committed write forwarded along the replica chain, then passes it on
+    void start_replication_batch(slsfs::leveldb_pack::packet_pointer pack, std::shared_ptr<pooled_buffer> body)
     {
-        //BOOST_LOG_TRIVIAL(trace) << "start_replication " << pack->header;
-        auto read_buf = std::make_shared<std::string>(pack->header.datasize, 0);
-        net::async_read(
-            socket_,
-            net::buffer(read_buf->data(), read_buf->size()),
-            [self=shared_from_this(), read_buf, pack] (boost::system::error_code ec, std::size_t length) {
-                if (ec)
+        BOOST_LOG_TRIVIAL(trace) << "start_replication_batch " << pack->header;
+        storage_.post(
+            shard_key(pack->header),
+            [self=shared_from_this(), body, pack] {
+                slsfs::leveldb_pack::packet_pointer resp = std::make_shared<slsfs::leveldb_pack::packet>();
+                resp->header = pack->header;
+                resp->header.type = slsfs::leveldb_pack::msg_t::ack;
+
+                // parse_batch rewrites the body in place; copy it out for the next hop first
+                slsfs::leveldb_pack::packet_pointer forward = nullptr;
+                if (pack->header.position > 0)
                 {
-                    BOOST_LOG_TRIVIAL(error) << "start_replication: " << ec.message();
+                    forward = std::make_shared<slsfs::leveldb_pack::packet>();
+                    forward->header = pack->header;
+                    forward->header.position = pack->header.position - 1;
+                    std::string_view const data = body->view();
+                    forward->data.buf.assign(data.begin(), data.end());
+                }
+
+                try
+                {
+                    std::optional<std::vector<persistent_log::prepare_entry>> const parsed = parse_batch(pack->header, *body);
+                    if (not parsed)
+                        throw std::runtime_error("malformed batch body");
+
+                    engine::write_batch batch;
+                    for (persistent_log::prepare_entry const& e : *parsed)
+                    {
+                        std::string const key = keyspace::rebase(e.key, keyspace::space_t::replica);
+                        batch.put(key, slsfs::leveldb_pack::rawblocks{}.merge(self->db_, key, e.value));
+                    }
+                    self->db_.write(batch);
+                }
+                catch (std::exception const& e)
+                {
+                    BOOST_LOG_TRIVIAL(error) << "start_replication_batch error: " << e.what();
+                    resp->header.type = slsfs::leveldb_pack::msg_t::err;
+                    self->start_write_socket(resp);
                     return;
                 }
 
-                self->start_read_header();
-                pack->data.parse(length, read_buf->data());
+                if (forward)
+                    self->start_chain_forward(forward, resp);
+                else
+                    self->start_write_socket(resp);
+            });
+    }
 
+    // note: assumes the every replication are stored in different SSBD
+    void start_replication(slsfs::leveldb_pack::packet_pointer pack, std::shared_ptr<pooled_buffer> body)
+    {
+        //BOOST_LOG_TRIVIAL(trace) << "start_replication " << pack->header;
+        std::string const key = keyspace::replica_key(pack->header);
+        storage_.post(
+            shard_key(pack->header),
+            [self=shared_from_this(), body, pack, key] {
                 slsfs::leveldb_pack::packet_pointer resp = std::make_shared<slsfs::leveldb_pack::packet>();
                 resp->header = pack->header;
                 resp->header.type = slsfs::leveldb_pack::msg_t::ack;
 
-                std::string const key = pack->header.as_string() + "repl";
-                std::string old_block;
-                self->db_.Get(leveldb::ReadOptions(), key, &old_block);
+                try
+                {
+                    std::string old_block;
+                    self->db_.get(key, old_block);
 
-                old_block.resize(
-                    std::max<std::uint32_t>(pack->header.position + pack->header.datasize,
-                                            old_block.size())); // make sure all buffer can write to old_block
+                    old_block.resize(
+                        std::max<std::uint32_t>(pack->header.position + pack->header.datasize,
+                                                old_block.size())); // make sure all buffer can write to old_block
 
-                std::copy(read_buf->begin(), read_buf->end(),
-                          std::next(old_block.begin(), pack->header.position));
+                    std::string_view const data = body->view();
+                    std::copy(data.begin(), data.end(),
+                              std::next(old_block.begin(), pack->header.position));
 
-                self->db_.Put(leveldb::WriteOptions(), key, old_block);
+                    self->db_.put(key, old_block);
+                }
+                catch (std::exception const& e)
+                {
+                    BOOST_LOG_TRIVIAL(error) << "start_replication error: " << e.what();
+                    resp->header.type = slsfs::leveldb_pack::msg_t::err;
+                }
                 self->start_write_socket(resp);
             });
     }
 
-    void start_db_read (slsfs::leveldb_pack::packet_pointer pack)
+    void start_db_read (slsfs::leveldb_pack::packet_pointer pack, keyspace::space_t const space)
     {
         BOOST_LOG_TRIVIAL(trace) << "start_db_read";
-        net::post(
-            io_context_,
-            [self=shared_from_this(), pack] {
-                slsfs::leveldb_pack::rawblocks rb;
-                leveldb::Status status = rb.bind(self->db_, pack->header.as_string());
+        std::string const key = keyspace::make(space, pack->header);
 
+        storage_.post(
+            shard_key(pack->header),
+            [self=shared_from_this(), pack, key] {
                 slsfs::leveldb_pack::packet_pointer resp = std::make_shared<slsfs::leveldb_pack::packet>();
                 resp->header = pack->header;
-                if (status.ok())
+                resp->header.type = slsfs::leveldb_pack::msg_t::err;
+
+                try
+                {
+                    slsfs::leveldb_pack::rawblocks rb;
+                    if (rb.bind(self->db_, key))
+                    {
+                        std::vector<slsfs::leveldb_pack::unit_t> buf(resp->header.datasize);
+
+                        rb.read(pack->header.position, buf.begin(), resp->header.datasize);
+                        BOOST_LOG_TRIVIAL(trace) << "start_db_read return : " << rb.buf_;
+
+                        resp->data.buf.swap(buf);
+                        resp->header.type = slsfs::leveldb_pack::msg_t::ack;
+                    }
+                }
+                catch (std::exception const& e)
                 {
+                    BOOST_LOG_TRIVIAL(error) << "start_db_read error: " << e.what();
+                    resp->header.type = slsfs::leveldb_pack::msg_t::err;
+                    resp->data.buf.clear();
+                }
+
+                self->start_write_socket(resp);
+            });
+    }
+
+    // serves [offset, offset + length) of a file starting at header.blockid in one response
+    void start_db_read_range (slsfs::leveldb_pack::packet_pointer pack, std::shared_ptr<pooled_buffer> body,
+                              keyspace::space_t const space)
+    {
+        BOOST_LOG_TRIVIAL(trace) << "start_db_read_range " << pack->header;
+        slsfs::leveldb_pack::packet_pointer resp = std::make_shared<slsfs::leveldb_pack::packet>();
+        resp->header = pack->header;
+
+        if (body->size() < slsfs::leveldb_pack::range_request::bytesize)
+        {
+            resp->header.type = slsfs::leveldb_pack::msg_t::err;
+            start_write_socket(resp);
+            return;
+        }
+
+        slsfs::leveldb_pack::range_request range;
+        range.parse(reinterpret_cast<slsfs::leveldb_pack::unit_t const*>(body->data()));
+
+        storage_.post(
+            shard_key(pack->header),
+            [self=shared_from_this(), pack, resp, range, space] {
+                resp->header.type = slsfs::leveldb_pack::msg_t::ack;
+
+                slsfs::leveldb_pack::buffer_t& body = resp->data.buf;
+                body.reserve(range.length + (range.length / std::max<std::uint32_t>(range.blocksize, 1) + 2) *
+                             slsfs::leveldb_pack::range_frame::bytesize);
+
+                // requests on one file run in order on its storage shard, so plain
+                // per-block gets see one consistent state and can hit the block cache
+                slsfs::leveldb_pack::packet_header blockheader = pack->header;
+                std::uint32_t offset = pack->header.position;
+                try
+                {
+                    for (std::uint32_t remain = range.length; remain > 0 and offset < range.blocksize;)
+                    {
+                        std::uint32_t const blockreadsize = std::min(remain, range.blocksize - offset);
+
+                        slsfs::leveldb_pack::rawblocks rb;
+                        if (rb.bind(self->db_, keyspace::make(space, blockheader)))
+                        {
+                            slsfs::leveldb_pack::range_frame frame {
+                                .blockid = blockheader.blockid,
+                                .size    = blockreadsize,
+                            };
+
+                            std::size_t const start = body.size();
+                            body.resize(start + slsfs::leveldb_pack::range_frame::bytesize + blockreadsize, 0);
+                            slsfs::leveldb_pack::unit_t* pos = frame.dump(body.data() + start);
+                            if (offset < rb.buf_.size())
+                                rb.read(offset, pos, blockreadsize);
+                        }
+
+                        remain -= blockreadsize;
+                        offset = 0;
+                        blockheader.blockid++;
+                    }
+                }
+                catch (std::exception const& e)
+                {
+                    BOOST_LOG_TRIVIAL(error) << "start_db_read_range error: " << e.what();
+                    resp->header.type = slsfs::leveldb_pack::msg_t::err;
+                    body.clear();
+                }
+
+                self->start_write_socket(resp);
+            });
+    }
+
+    // header.blockid and the last block of a file request, or nullopt without a valid body
+    static
+    auto parse_block_range (slsfs::leveldb_pack::packet_header const& header, pooled_buffer const& body)
+        -> std::optional<slsfs::leveldb_pack::block_range>
+    {
+        if (body.size() < slsfs::leveldb_pack::block_range::bytesize)
+            return std::nullopt;
+
+        slsfs::leveldb_pack::block_range range;
+        range.parse(reinterpret_cast<slsfs::leveldb_pack::unit_t const*>(body.data()));
+        if (range.last < header.blockid)
+            return std::nullopt;
+        return range;
+    }
+
+    // block count, last block and newest version of the blocks in range, by one scan over the file
+    void start_file_stat (slsfs::leveldb_pack::packet_pointer pack, std::shared_ptr<pooled_buffer> body)
+    {
+        BOOST_LOG_TRIVIAL(trace) << "start_file_stat " << pack->header;
+        slsfs::leveldb_pack::packet_pointer resp = std::make_shared<slsfs::leveldb_pack::packet>();
+        resp->header = pack->header;
+
+        std::optional<slsfs::leveldb_pack::block_range> const range = parse_block_range(pack->header, *body);
+        if (not range)
+        {
+            resp->header.type = slsfs::leveldb_pack::msg_t::err;
+            start_write_socket(resp);
+            return;
+        }
+
+        storage_.post(
+            shard_key(pack->header),
+            [self=shared_from_this(), pack, resp, last=range->last] {
+                slsfs::leveldb_pack::file_stat stat {
+                    .block_count  = 0,
+                    .last_blockid = 0,
+                    .last_size    = 0,
+                    .version      = 0,
+                };
+
+                try
+                {
+                    std::string const begin = keyspace::data_key(pack->header);
+                    std::string const end = keyspace::block_end(keyspace::space_t::data, pack->header, last);
+                    std::unique_ptr<engine::iterator> it = self->db_.new_iterator();
+                    for (it->seek(begin); it->valid() and it->key() < end; it->next())
+                    {
+                        stat.block_count++;
+                        stat.last_blockid = keyspace::blockid_of(it->key());
+                        stat.last_size = it->value().size();
+                    }
+
+                    // the versions sit in their own key space; one ordered pass over the same range
+                    if (stat.block_count > 0)
+                        stat.version = self->db_log_.max_committed_version(begin, end);
+
                     resp->header.type = slsfs::leveldb_pack::msg_t::ack;
+                    resp->data.buf.resize(slsfs::leveldb_pack::file_stat::bytesize);
+                    stat.dump(resp->data.buf.data());
+                }
+                catch (std::exception const& e)
+                {
+                    BOOST_LOG_TRIVIAL(error) << "start_file_stat error: " << e.what();
+                    resp->header.type = slsfs::leveldb_pack::msg_t::err;
+                }
+
+                self->start_write_socket(resp);
+            });
+    }
+
+    // file_truncate and file_delete: blocks, replica copies and their 2pc records leave in one batch
+    void start_file_remove (slsfs::leveldb_pack::packet_pointer pack, std::shared_ptr<pooled_buffer> body)
+    {
+        BOOST_LOG_TRIVIAL(trace) << "start_file_remove " << pack->header;
+        slsfs::leveldb_pack::packet_pointer resp = std::make_shared<slsfs::leveldb_pack::packet>();
+        resp->header = pack->header;
 
-                    std::vector<slsfs::leveldb_pack::unit_t> buf(resp->header.datasize);
+        std::optional<slsfs::leveldb_pack::block_range> const range = parse_block_range(pack->header, *body);
+        if (not range)
+        {
+            resp->header.type = slsfs::leveldb_pack::msg_t::err;
+            start_write_socket(resp);
+            return;
+        }
+
+        storage_.post(
+            shard_key(pack->header),
+            [self=shared_from_this(), pack, resp, last=range->last] {
+                // truncate keeps the first header.position bytes of header.blockid
+                bool const cut = (pack->header.type == slsfs::leveldb_pack::msg_t::file_truncate and
+                                  pack->header.position > 0);
 
-                    rb.read(pack->header.position, buf.begin(), resp->header.datasize);
-                    BOOST_LOG_TRIVIAL(trace) << "start_db_read return : " << rb.buf_;
+                engine::write_batch batch;
+                try
+                {
+                    for (keyspace::space_t const space : {keyspace::space_t::data, keyspace::space_t::replica})
+                    {
+                        if (cut)
+                        {
+                            std::string const key = keyspace::make(space, pack->header);
+                            std::string block;
+                            if (self->db_.get(key, block) and block.size() > pack->header.position)
+                            {
+                                block.resize(pack->header.position);
+                                batch.put(key, block);
+                            }
+                        }
+
+                        std::string const end = keyspace::block_end(space, pack->header, last);
+                        std::unique_ptr<engine::iterator> it = self->db_.new_iterator();
+                        for (it->seek(keyspace::make(space, pack->header)); it->valid() and it->key() < end; it->next())
+                            if (not (cut and keyspace::blockid_of(it->key()) == pack->header.blockid))
+                                batch.remove(std::string{it->key()});
+                    }
+
+                    // the cut block keeps its versions
+                    if (not cut or pack->header.blockid < last)
+                    {
+                        slsfs::leveldb_pack::packet_header first = pack->header;
+                        if (cut)
+                            first.blockid++;
+                        self->db_log_.remove_range(keyspace::data_key(first),
+                                                   keyspace::block_end(keyspace::space_t::data, pack->header, last),
+                                                   batch);
+                    }
 
-                    resp->data.buf.swap(buf);
+                    self->db_.write(batch);
+                    resp->header.type = slsfs::leveldb_pack::msg_t::ack;
                 }
-                else
+                catch (std::exception const& e)
+                {
+                    BOOST_LOG_TRIVIAL(error) << "start_file_remove error: " << e.what();
                     resp->header.type = slsfs::leveldb_pack::msg_t::err;
+                }
 
+                BOOST_LOG_TRIVIAL(debug) << "start_file_remove " << batch.ops().size() << " keys. return packet: " << resp->header;
                 self->start_write_socket(resp);
-                self->start_read_header();
             });
     }
 
     void start_write_socket(slsfs::leveldb_pack::packet_pointer pack)
     {
+        inflight_--;
+        resume_under_window();
+
         auto next = std::make_shared<slsfs::socket_writer::boost_callback>(
             [self=shared_from_this(), pack] (boost::system::error_code ec, std::size_t transferred_size) {
                 if (ec)
@@ -365,54 +936,146 @@ class tcp_server
 {
     net::io_context& io_context_;
     tcp::acceptor acceptor_;
-    std::unique_ptr<leveldb::Cache> cache_ = nullptr;
-    std::unique_ptr<leveldb::DB> db_ = nullptr;
+    std::unique_ptr<engine::block_engine> db_ = nullptr;
+    std::unique_ptr<persistent_log> db_log_ = nullptr;
+    storage_executor storage_;
+    std::vector<tcp::acceptor> core_acceptors_; // per-core mode. closed before the shards they run on
+    std::unique_ptr<chain_link> chain_ = nullptr;
+    std::shared_ptr<log_gc> gc_ = nullptr;
+    slsfs::leveldb_pack::credit_grant const credits_;
+
+    static
+    auto open_engine(std::string const& engine_type, std::string const& dbname, std::size_t const cache_size, bool const sync,
+                     std::uint64_t const uring_slots) -> std::unique_ptr<engine::block_engine>
+    {
+        if (engine_type == "leveldb")
+            return std::make_unique<engine::leveldb_engine>(dbname, cache_size, sync);
+        else if (engine_type == "memory")
+            return std::make_unique<engine::memory_engine>();
+        else if (engine_type == "uring")
+            return std::make_unique<engine::uring_engine>(
+                dbname + "_blocks", uring_slots, slsfs::leveldb_pack::rawblocks{}.fullsize(), sync);
+        else
+            throw std::runtime_error("unknown engine type " + engine_type);
+    }
 
-    persistent_log db_log_;
+    // the per-core acceptors share the port; the kernel spreads new connections over them
+    static
+    void open_acceptor(tcp::acceptor& acceptor, net::ip::port_type const port, bool const reuse_port)
+    {
+        using reuse_port_option = net::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>;
+
+        tcp::endpoint const endpoint{tcp::v4(), port};
+        acceptor.open(endpoint.protocol());
+        acceptor.set_option(tcp::acceptor::reuse_address(true));
+        if (reuse_port)
+            acceptor.set_option(reuse_port_option(true));
+        acceptor.bind(endpoint);
+        acceptor.listen();
+    }
 
 public:
-    tcp_server(net::io_context& io_context, net::ip::port_type const port, std::string const dbname, std::size_t const cache_size)
+    tcp_server(net::io_context& io_context, net::ip::port_type const port,
+               std::string const dbname, std::size_t const cache_size, bool const sync,
+               std::string const engine_type, std::uint64_t const uring_slots, std::size_t const block_cache_size,
+               std::string const log_type, std::size_t const wal_segment_size,
+               int const storage_threads, std::string const replica_next, std::size_t const log_gc_rate,
+               slsfs::leveldb_pack::credit_grant const credits, bool const shard_per_core, bool const db_per_core)
         : io_context_(io_context),
-          acceptor_(io_context, tcp::endpoint(tcp::v4(), port)),
-          db_log_{dbname + "_log", cache_size}
+          acceptor_(io_context),
+          storage_{storage_threads, shard_per_core},
+          credits_{credits}
     {
-        leveldb::DB* db = nullptr;
-        leveldb::Options options;
+        if (db_per_core)
+        {
+            // shard i only ever opens the keys routed to core i
+            std::vector<std::unique_ptr<engine::block_engine>> shards;
+            for (std::size_t i = 0; i < storage_.shard_count(); i++)
+            {
+                shards.push_back(open_engine(engine_type, dbname + "_core" + std::to_string(i),
+                                             cache_size / storage_.shard_count(), sync, uring_slots));
+                keyspace::check_format(*shards.back());
+                keyspace::check_shard(*shards.back(), i, storage_.shard_count());
+            }
+
+            db_ = std::make_unique<engine::sharded_engine>(
+                std::move(shards),
+                [this] (std::string_view const key) { return storage_.shard_of(keyspace::file_of(key)); });
+        }
+        else
+        {
+            db_ = open_engine(engine_type, dbname, cache_size, sync, uring_slots);
+            keyspace::check_format(*db_);
+        }
 
-        cache_.reset(leveldb::NewLRUCache(cache_size));
+        // the memory engine is its own cache
+        if (block_cache_size > 0 && engine_type != "memory")
+            db_ = std::make_unique<engine::cached_engine>(std::move(db_), block_cache_size);
 
-        options.create_if_missing = true;
-        options.write_buffer_size = 32 * 1024 * 1024;
-        options.block_cache = cache_.get();
+        if (log_type == "leveldb")
+            db_log_ = std::make_unique<leveldb_log>(dbname + "_log", cache_size, sync);
+        else if (log_type == "segment")
+            db_log_ = std::make_unique<segment_log>(dbname + "_wal", *db_, wal_segment_size, sync);
+        else
+            throw std::runtime_error("unknown log type " + log_type);
 
-        leveldb::Status status = leveldb::DB::Open(options, dbname, &db);
-        if (not status.ok())
+        // only the leveldb log keeps payloads past commit; the segment log recycles on its own
+        if (log_gc_rate > 0 and log_type == "leveldb")
         {
-            BOOST_LOG_TRIVIAL(error) << status.ToString() << "\n";
-            throw std::runtime_error("cannot open db");
+            gc_ = std::make_shared<log_gc>(io_context_, *db_log_, storage_, log_gc_rate);
+            gc_->start();
         }
 
-        BOOST_LOG_TRIVIAL(debug) << "open db ptr: " << db << "\n";
-        db_.reset(db);
-        start_accept();
+        // host:port of the next ssbd in the replica chain
+        if (not replica_next.empty())
+        {
+            std::size_t const colon = replica_next.rfind(':');
+            if (colon == std::string::npos)
+                throw std::runtime_error("replica-next needs host:port, got " + replica_next);
+
+            tcp::resolver resolver(io_context_);
+            tcp::endpoint const next = *resolver.resolve(replica_next.substr(0, colon), replica_next.substr(colon + 1)).begin();
+            chain_ = std::make_unique<chain_link>(io_context_, next);
+            BOOST_LOG_TRIVIAL(info) << "replica chain forwards to " << next;
+        }
+
+        if (shard_per_core)
+        {
+            core_acceptors_.reserve(storage_.shard_count());
+            for (std::size_t i = 0; i < storage_.shard_count(); i++)
+            {
+                tcp::acceptor& acceptor = core_acceptors_.emplace_back(storage_.context(i));
+                open_acceptor(acceptor, port, true);
+                start_accept(acceptor, storage_.context(i));
+            }
+        }
+        else
+        {
+            open_acceptor(acceptor_, port, false);
+            start_accept(acceptor_, io_context_);
+        }
     }
 
-    void start_accept()
+    // connections live on the io_context of their acceptor
+    void start_accept(tcp::acceptor& acceptor, net::io_context& io)
     {
-        acceptor_.async_accept(
-            [this] (boost::system::error_code const& error, tcp::socket socket) {
+        acceptor.async_accept(
+            [this, &acceptor, &io] (boost::system::error_code const& error, tcp::socket socket) {
                 if (error)
                     BOOST_LOG_TRIVIAL(error) << "accept error: " << error.message() << "\n";
                 else
                 {
                     socket.set_option(tcp::no_delay(true));
                     auto accepted = std::make_shared<tcp_connection>(
-                        io_context_,
+                        io,
                         std::move(socket),
                         *db_,
-                        db_log_);
-                    accepted->start_read_header();
-                    start_accept();
+                        *db_log_,
+                        storage_,
+                        chain_.get(),
+                        credits_);
+                    accepted->start_read();
+                    start_accept(acceptor, io);
                 }
             });
     }
@@ -431,7 +1094,20 @@ int main(int argc, char* argv[])
         ("listen,l", po::value<unsigned short>()->default_value(12000),             "listen on this port")
         ("db,d",     po::value<std::string>()->default_value("/tmp/haressbd/db"),   "leveldb save path")
         ("blocksize,b", po::value<std::size_t>()->default_value(4 * 1024),          "set block size (in bytes)")
-        ("cachesize,c", po::value<std::size_t>()->default_value(100 * 1024 * 1024), "set leveldb cachesize (in bytes)" );
+        ("cachesize,c", po::value<std::size_t>()->default_value(100 * 1024 * 1024), "set leveldb cachesize (in bytes)" )
+        ("sync",        po::bool_switch()->default_value(false),                    "fsync every 2pc log write (concurrent writes share one fsync)")
+        ("engine",      po::value<std::string>()->default_value("leveldb"),         "block engine: leveldb | memory (volatile) | uring")
+        ("block-cache", po::value<std::size_t>()->default_value(256 * 1024 * 1024), "budget of the decoded block cache in front of the engine (in bytes, 0 = off)")
+        ("uring-slots", po::value<std::uint64_t>()->default_value(256 * 1024),      "number of block slots preallocated by the uring engine")
+        ("log",         po::value<std::string>()->default_value("segment"),         "2pc log type: segment | leveldb")
+        ("wal-segment-size", po::value<std::size_t>()->default_value(64 * 1024 * 1024), "size of one wal segment file (in bytes)")
+        ("storage-threads", po::value<int>()->default_value(std::max(1u, std::thread::hardware_concurrency())), "threads running leveldb operations (sharded by key, at least 1)")
+        ("replica-next", po::value<std::string>()->default_value(""),               "host:port of the next ssbd in the replica chain (empty = chain tail)")
+        ("log-gc-rate",  po::value<std::size_t>()->default_value(20000),            "2pc log records scanned per second to drop committed payloads (0 = off, leveldb log only)")
+        ("credit-ops",   po::value<std::uint32_t>()->default_value(256),            "requests in flight granted to each connection (0 = no limit)")
+        ("credit-bytes", po::value<std::uint32_t>()->default_value(32 * 1024 * 1024), "request bytes in flight granted to each connection (0 = no limit)")
+        ("shard-per-core", po::bool_switch()->default_value(false),                 "pin each storage thread to a core and accept connections on it (SO_REUSEPORT)")
+        ("db-per-core",    po::bool_switch()->default_value(false),                 "one engine per storage thread (<db>_core<i>); needs --shard-per-core");
     po::positional_options_description pos_po;
     po::variables_map vm;
     po::store(po::command_line_parser(argc, argv)
@@ -445,7 +1121,23 @@ int main(int argc, char* argv[])
         return EXIT_SUCCESS;
     }
 
-    int const worker = std::thread::hardware_concurrency();
+    bool const shard_per_core = vm["shard-per-core"].as<bool>();
+    bool const db_per_core    = vm["db-per-core"].as<bool>();
+    if (db_per_core and not shard_per_core)
+    {
+        BOOST_LOG_TRIVIAL(error) << "--db-per-core needs --shard-per-core";
+        return EXIT_FAILURE;
+    }
+
+    // keys are hashed modulo the shard count
+    if (vm["storage-threads"].as<int>() < 1)
+    {
+        BOOST_LOG_TRIVIAL(error) << "--storage-threads needs at least 1";
+        return EXIT_FAILURE;
+    }
+
+    // per-core shards run the connections themselves; the main context only keeps timers and the chain link
+    int const worker = shard_per_core ? 1 : std::thread::hardware_concurrency();
     ssbd::net::io_context ioc {worker};
     ssbd::net::signal_set listener(ioc, SIGINT, SIGTERM);
     listener.async_wait(
@@ -458,11 +1150,27 @@ int main(int argc, char* argv[])
     std::size_t    const size = vm["blocksize"].as<std::size_t>();
     std::string    const path = vm["db"].as<std::string>();
     std::size_t    const cachesize = vm["cachesize"].as<std::size_t>();
+    bool           const sync = vm["sync"].as<bool>();
+    std::string    const engine_type = vm["engine"].as<std::string>();
+    std::uint64_t  const uring_slots = vm["uring-slots"].as<std::uint64_t>();
+    std::size_t    const block_cache_size = vm["block-cache"].as<std::size_t>();
+    std::string    const log_type = vm["log"].as<std::string>();
+    std::size_t    const wal_segment_size = vm["wal-segment-size"].as<std::size_t>();
+    int            const storage_threads = vm["storage-threads"].as<int>();
+    std::string    const replica_next = vm["replica-next"].as<std::string>();
+    std::size_t    const log_gc_rate = vm["log-gc-rate"].as<std::size_t>();
+    if (not vm["log-gc-rate"].defaulted() and log_gc_rate > 0 and log_type != "leveldb")
+        BOOST_LOG_TRIVIAL(warning) << "--log-gc-rate only applies to --log leveldb; ignored for " << log_type;
+    slsfs::leveldb_pack::credit_grant const credits {
+        .ops   = vm["credit-ops"].as<std::uint32_t>(),
+        .bytes = vm["credit-bytes"].as<std::uint32_t>()};
 
     slsfs::leveldb_pack::rawblocks {}.fullsize() = size;
 
-    ssbd::tcp_server server{ioc, port, path, cachesize};
-    BOOST_LOG_TRIVIAL(info) << "listen :" << port << " blocksize=" << size << " thread=" << worker;
+    ssbd::tcp_server server{ioc, port, path, cachesize, sync, engine_type, uring_slots, block_cache_size, log_type, wal_segment_size, storage_threads, replica_next, log_gc_rate, credits, shard_per_core, db_per_core};
+    BOOST_LOG_TRIVIAL(info) << "listen :" << port << " blocksize=" << size << " thread=" << worker
+                            << " storage thread=" << storage_threads << " sync=" << sync << " engine=" << engine_type << " log=" << log_type
+                            << " shard-per-core=" << shard_per_core << " db-per-core=" << db_per_core;
     BOOST_LOG_TRIVIAL(trace) << "trace enabled";
 
     std::vector<std::thread> v;
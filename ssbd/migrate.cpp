@@ -0,0 +1,164 @@
+#include "basic.hpp"
+#include "leveldb-serializer.hpp"
+#include "key-space.hpp"
+#include "block-engine.hpp"
+#include "block-engine-leveldb.hpp"
+#include "block-engine-uring.hpp"
+
+#include <boost/program_options.hpp>
+#include <boost/log/trivial.hpp>
+
+#include <charconv>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+// Rewrites the keys of a stopped ssbd from |uuid|decimal blockid|suffix| into
+// the |space|uuid|blockid| format of key-space.hpp, in place.
+// Run it on the data db and on the leveldb log db (<db>_log). The segment wal
+// (<db>_wal) keeps the old keys of prepares that were still pending; let every
+// 2pc finish before stopping the server.
+
+namespace
+{
+
+// old suffix -> space of the new key
+struct suffix_space
+{
+    std::string_view suffix;
+    ssbd::keyspace::space_t space;
+};
+
+constexpr suffix_space suffixes[] = {
+    {"-committed-version", ssbd::keyspace::space_t::committed_version},
+    {"-version",           ssbd::keyspace::space_t::pending_version},
+    {"-data",              ssbd::keyspace::space_t::pending_data},
+    {"repl",               ssbd::keyspace::space_t::replica},
+    {"",                   ssbd::keyspace::space_t::data},
+};
+
+// a new key would need a blockid >= 0x30303030 to read as decimal digits
+auto convert (std::string_view const key) -> std::optional<std::string>
+{
+    constexpr std::size_t uuid_size = std::tuple_size<slsfs::leveldb_pack::key_t>::value;
+    if (key.size() <= uuid_size)
+        return std::nullopt;
+
+    std::string_view const rest = key.substr(uuid_size);
+    std::uint32_t blockid = 0;
+    std::from_chars_result const result = std::from_chars(rest.data(), rest.data() + rest.size(), blockid);
+    if (result.ec != std::errc{} || result.ptr == rest.data())
+        return std::nullopt;
+
+    std::string_view const suffix = rest.substr(result.ptr - rest.data());
+    for (suffix_space const& s : suffixes)
+        if (suffix == s.suffix)
+        {
+            slsfs::leveldb_pack::packet_header header;
+            std::copy_n(key.begin(), uuid_size, header.uuid.begin());
+            header.blockid = blockid;
+            return ssbd::keyspace::make(s.space, header);
+        }
+    return std::nullopt;
+}
+
+void migrate (ssbd::engine::block_engine& db, std::size_t const batch_size, bool const dry_run)
+{
+    std::string version;
+    if (db.get(ssbd::keyspace::format_key(), version))
+    {
+        BOOST_LOG_TRIVIAL(info) << "already in key format " << version << ". skip";
+        return;
+    }
+
+    std::uint64_t moved = 0, skipped = 0;
+    ssbd::engine::write_batch batch;
+    auto flush = [&] {
+        if (not dry_run)
+            db.write(batch);
+        batch.clear();
+    };
+
+    // a snapshot keeps the rewritten keys out of the scan
+    std::unique_ptr<ssbd::engine::snapshot> snapshot = db.new_snapshot();
+    std::unique_ptr<ssbd::engine::iterator> it = snapshot->new_iterator();
+    for (it->seek(""); it->valid(); it->next())
+    {
+        std::optional<std::string> const newkey = convert(it->key());
+        if (not newkey)
+        {
+            BOOST_LOG_TRIVIAL(warning) << "leave unknown key of " << it->key().size() << " bytes";
+            skipped++;
+            continue;
+        }
+
+        batch.put(*newkey, std::string{it->value()});
+        batch.remove(std::string{it->key()});
+        moved++;
+
+        if (batch.ops().size() >= batch_size * 2)
+            flush();
+    }
+
+    if (not it->ok())
+        throw std::runtime_error("iterator error while migrating");
+
+    batch.put(ssbd::keyspace::format_key(), std::string{ssbd::keyspace::format_version});
+    flush();
+
+    BOOST_LOG_TRIVIAL(info) << (dry_run ? "would move " : "moved ") << moved << " keys, left " << skipped;
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    ssbd::basic::init_log();
+
+    namespace po = boost::program_options;
+    po::options_description desc{"Options"};
+    desc.add_options()
+        ("help,h", "Print this help messages")
+        ("db,d",        po::value<std::vector<std::string>>()->multitoken(),         "db paths to migrate, e.g. /tmp/haressbd/db /tmp/haressbd/db_log")
+        ("engine",      po::value<std::string>()->default_value("leveldb"),         "engine of the dbs: leveldb | uring")
+        ("blocksize,b", po::value<std::size_t>()->default_value(4 * 1024),          "block size of the uring engine (in bytes)")
+        ("uring-slots", po::value<std::uint64_t>()->default_value(256 * 1024),      "number of block slots of the uring engine")
+        ("batch",       po::value<std::size_t>()->default_value(1024),              "keys rewritten per write batch")
+        ("dry-run",     po::bool_switch()->default_value(false),                    "only count the keys to move");
+    po::variables_map vm;
+    po::store(po::command_line_parser(argc, argv).options(desc).run(), vm);
+    po::notify(vm);
+
+    if (vm.count("help") || not vm.count("db"))
+    {
+        BOOST_LOG_TRIVIAL(info) << desc;
+        return vm.count("help") ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    std::string   const engine_type = vm["engine"].as<std::string>();
+    std::size_t   const blocksize   = vm["blocksize"].as<std::size_t>();
+    std::uint64_t const uring_slots = vm["uring-slots"].as<std::uint64_t>();
+    std::size_t   const batch_size  = vm["batch"].as<std::size_t>();
+    bool          const dry_run     = vm["dry-run"].as<bool>();
+
+    for (std::string const& path : vm["db"].as<std::vector<std::string>>())
+    {
+        BOOST_LOG_TRIVIAL(info) << "migrate " << path;
+        std::unique_ptr<ssbd::engine::block_engine> db;
+        if (engine_type == "leveldb")
+            db = std::make_unique<ssbd::engine::leveldb_engine>(path, 8 * 1024 * 1024, true);
+        else if (engine_type == "uring")
+            db = std::make_unique<ssbd::engine::uring_engine>(path, uring_slots, blocksize, true);
+        else
+        {
+            BOOST_LOG_TRIVIAL(error) << "unknown engine type " << engine_type;
+            return EXIT_FAILURE;
+        }
+
+        migrate(*db, batch_size, dry_run);
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,260 @@
+#pragma once
+
+#ifndef PERSISTENT_LOG_LEVELDB_HPP__
+#define PERSISTENT_LOG_LEVELDB_HPP__
+
+#include "persistent-log.hpp"
+#include "leveldb-serializer.hpp"
+#include "rawblocks.hpp"
+#include "key-space.hpp"
+
+#include <leveldb/cache.h>
+#include <leveldb/db.h>
+#include <leveldb/write_batch.h>
+
+#include <fmt/core.h>
+
+namespace ssbd
+{
+
+// Every prepare / commit is turned into a single leveldb::WriteBatch.
+// Concurrent tcp_connections calling DB::Write() are merged by leveldb's
+// writer queue into one log record (and one fsync when sync is enabled),
+// so the log group-commits without an extra queue on our side.
+class leveldb_log : public persistent_log
+{
+    std::unique_ptr<leveldb::Cache> cache_ = nullptr;
+    std::unique_ptr<leveldb::DB> db_log_ = nullptr;
+    leveldb::WriteOptions write_options_;
+
+    static
+    auto version_key (std::string const& key) -> std::string { return keyspace::rebase(key, keyspace::space_t::pending_version); }
+
+    static
+    auto committed_version_key (std::string const& key) -> std::string { return keyspace::rebase(key, keyspace::space_t::committed_version); }
+
+    static
+    auto data_key (std::string const& key) -> std::string { return keyspace::rebase(key, keyspace::space_t::pending_data); }
+
+    auto parse_version (std::string const& version_key, std::string& version_value) -> slsfs::leveldb_pack::versionint_t
+    {
+        if (version_value.empty())
+            return 0;
+
+        try
+        {
+            return std::stoll(version_value);
+        } catch (std::exception&) {
+            BOOST_LOG_TRIVIAL(error) << "error on converting '" << version_value << "' to number. key=" << version_key;
+            version_value = "0";
+            db_log_->Put(write_options_, version_key, version_value);
+            return 0;
+        }
+    }
+
+public:
+    leveldb_log (std::string const &dbname, std::size_t const cache_size, bool const sync = false):
+        persistent_log{sync}
+    {
+        leveldb::DB* db = nullptr;
+        leveldb::Options options;
+
+        cache_.reset(leveldb::NewLRUCache(cache_size));
+
+        options.create_if_missing = true;
+        options.write_buffer_size = 32 * 1024 * 1024;
+        options.block_cache = cache_.get();
+
+        leveldb::Status status = leveldb::DB::Open(options, std::string(dbname), &db);
+        if (not status.ok())
+        {
+            BOOST_LOG_TRIVIAL(error) << status.ToString() << "\n";
+            throw std::runtime_error("cannot open db");
+        }
+
+        BOOST_LOG_TRIVIAL(debug) << "open db log ptr: " << db << "\n";
+        db_log_.reset(db);
+        write_options_.sync = sync_;
+    }
+
+    auto get_committed_version (std::string const& key) -> slsfs::leveldb_pack::versionint_t override
+    {
+        std::string const commit_version_key = committed_version_key(key);
+        std::string commit_version_buffer;
+        db_log_->Get(leveldb::ReadOptions(), commit_version_key, &commit_version_buffer);
+        return parse_version(commit_version_key, commit_version_buffer);
+    }
+
+    auto max_committed_version (std::string const& begin, std::string const& end) -> slsfs::leveldb_pack::versionint_t override
+    {
+        slsfs::leveldb_pack::versionint_t version = 0;
+        std::string const version_end = committed_version_key(end);
+        std::unique_ptr<leveldb::Iterator> it {db_log_->NewIterator(leveldb::ReadOptions())};
+        for (it->Seek(committed_version_key(begin)); it->Valid() and it->key().compare(version_end) < 0; it->Next())
+        {
+            std::string value = it->value().ToString();
+            version = std::max(version, parse_version(it->key().ToString(), value));
+        }
+        return version;
+    }
+
+    void put_committed_version (std::string const& key, slsfs::leveldb_pack::versionint_t version)
+    {
+        std::string commit_version_buffer = std::to_string(version);
+        BOOST_LOG_TRIVIAL(trace) << "put to log " << commit_version_buffer;
+        db_log_->Put(write_options_, committed_version_key(key), commit_version_buffer);
+    }
+
+    void put_pending_prepare (std::string const& key, std::string_view const value, slsfs::leveldb_pack::versionint_t version) override
+    {
+        leveldb::WriteBatch batch;
+        batch.Put(version_key(key), fmt::format("{}", version));
+        batch.Put(data_key(key), leveldb::Slice(value.data(), value.size()));
+        db_log_->Write(write_options_, &batch);
+    }
+
+    auto get_pending_prepare_data (std::string const& key) -> std::string override
+    {
+        std::string result;
+        db_log_->Get(leveldb::ReadOptions(), data_key(key), &result);
+        return result;
+    }
+
+    auto get_pending_prepare_version (std::string const& key) -> slsfs::leveldb_pack::versionint_t override
+    {
+        std::string const pending_version_key = version_key(key);
+        std::string version_value;
+        db_log_->Get(leveldb::ReadOptions(), pending_version_key, &version_value);
+        return parse_version(pending_version_key, version_value);
+    }
+
+    void commit_pending_prepare (std::string const& key, engine::block_engine& save_dest) override
+    {
+        std::string const delta = get_pending_prepare_data(key);
+        slsfs::leveldb_pack::versionint_t const version = get_pending_prepare_version(key);
+        BOOST_LOG_TRIVIAL(trace) << "commit pending prepare version: " << version;
+        if (version == 0) // empty log
+            return;
+
+        std::string const value = slsfs::leveldb_pack::rawblocks{}.merge(save_dest, key, delta);
+
+        // data first: a crash in between leaves a pending log that blocks new prepares,
+        // instead of a committed version without its data.
+        save_dest.put(key, value);
+        put_committed_version(key, version);
+    }
+
+    bool have_pending_log (std::string const& key) override
+    {
+        slsfs::leveldb_pack::versionint_t const pending_version = get_pending_prepare_version(key);
+        if (pending_version == 0) // 0 == empty log
+            return false;
+        return pending_version != get_committed_version(key);
+    }
+
+    void put_pending_prepare_batch (std::vector<prepare_entry> const& entries, slsfs::leveldb_pack::versionint_t version) override
+    {
+        leveldb::WriteBatch batch;
+        for (prepare_entry const& e : entries)
+        {
+            batch.Put(version_key(e.key), fmt::format("{}", version));
+            batch.Put(data_key(e.key), leveldb::Slice(e.value.data(), e.value.size()));
+        }
+        db_log_->Write(write_options_, &batch);
+    }
+
+    void commit_pending_prepare_batch (std::vector<std::string> const& keys, engine::block_engine& save_dest) override
+    {
+        engine::write_batch data_batch;
+        leveldb::WriteBatch version_batch;
+        for (std::string const& key : keys)
+        {
+            slsfs::leveldb_pack::versionint_t const version = get_pending_prepare_version(key);
+            if (version == 0) // empty log
+                continue;
+
+            std::string const value = slsfs::leveldb_pack::rawblocks{}.merge(save_dest, key, get_pending_prepare_data(key));
+            data_batch.put(key, value);
+            version_batch.Put(committed_version_key(key), fmt::format("{}", version));
+        }
+
+        // same order as commit_pending_prepare: data first
+        save_dest.write(data_batch);
+        db_log_->Write(write_options_, &version_batch);
+    }
+
+    // the pending version / data of a key are garbage once its prepare is rolled back (version 0)
+    // or committed; the committed version record stays
+    auto find_garbage (std::string& cursor, std::size_t const max_scan) -> garbage override
+    {
+        garbage g;
+        std::unique_ptr<leveldb::Iterator> it {db_log_->NewIterator(leveldb::ReadOptions())};
+        it->Seek(cursor.empty()? keyspace::space_prefix(keyspace::space_t::pending_version) : cursor);
+        cursor.clear();
+
+        for (; it->Valid() and keyspace::in_space(it->key().ToString(), keyspace::space_t::pending_version); it->Next())
+        {
+            if (g.scanned == max_scan)
+            {
+                cursor = it->key().ToString();
+                break;
+            }
+            g.scanned++;
+
+            std::string const pending_version_key = it->key().ToString();
+            std::string version_value = it->value().ToString();
+            slsfs::leveldb_pack::versionint_t const version = parse_version(pending_version_key, version_value);
+
+            std::string key = keyspace::rebase(pending_version_key, keyspace::space_t::data);
+            if (version == 0 or version == get_committed_version(key))
+                g.keys.push_back(std::move(key));
+        }
+        return g;
+    }
+
+    auto collect_garbage (std::vector<std::string> const& keys) -> std::size_t override
+    {
+        leveldb::WriteBatch batch;
+        std::size_t collected = 0;
+        for (std::string const& key : keys)
+        {
+            std::string const pending_version_key = version_key(key);
+            std::string version_value;
+            if (not db_log_->Get(leveldb::ReadOptions(), pending_version_key, &version_value).ok())
+                continue;
+
+            slsfs::leveldb_pack::versionint_t const version = parse_version(pending_version_key, version_value);
+            if (version != 0 and version != get_committed_version(key))
+                continue; // a new prepare came in since the scan
+
+            batch.Delete(pending_version_key);
+            batch.Delete(data_key(key));
+            collected++;
+        }
+
+        if (collected > 0)
+            db_log_->Write(write_options_, &batch);
+        return collected;
+    }
+
+    void remove_range (std::string const& begin, std::string const& end, engine::write_batch& /*data_batch*/) override
+    {
+        leveldb::WriteBatch batch;
+        std::unique_ptr<leveldb::Iterator> it {db_log_->NewIterator(leveldb::ReadOptions())};
+        for (keyspace::space_t const space : {keyspace::space_t::committed_version,
+                                              keyspace::space_t::pending_version,
+                                              keyspace::space_t::pending_data})
+        {
+            std::string const space_end = keyspace::rebase(end, space);
+            for (it->Seek(keyspace::rebase(begin, space));
+                 it->Valid() and it->key().compare(space_end) < 0;
+                 it->Next())
+                batch.Delete(it->key());
+        }
+        db_log_->Write(write_options_, &batch);
+    }
+};
+
+} // namespace ssbd
+
+#endif // PERSISTENT_LOG_LEVELDB_HPP__
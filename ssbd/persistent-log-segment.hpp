@@ -0,0 +1,643 @@
+#pragma once
+
+#ifndef PERSISTENT_LOG_SEGMENT_HPP__
+#define PERSISTENT_LOG_SEGMENT_HPP__
+
+#include "persistent-log.hpp"
+#include "leveldb-serializer.hpp"
+#include "rawblocks.hpp"
+#include "key-space.hpp"
+
+#include <boost/log/trivial.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/crc.hpp>
+
+#include <fmt/core.h>
+
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <unordered_map>
+#include <string_view>
+#include <memory>
+#include <deque>
+#include <mutex>
+
+namespace ssbd
+{
+
+namespace segment
+{
+
+enum class record_t : std::uint8_t
+{
+    prepare  = 1,
+    commit   = 2,
+    rollback = 3,
+};
+
+constexpr std::uint32_t segment_magic = 0x47534c53; // "SLSG"
+constexpr std::uint32_t record_magic  = 0x44434552; // "RECD"
+constexpr std::size_t   alignment     = 8;
+constexpr std::size_t   data_start    = 64;
+
+auto align (std::size_t size) -> std::size_t {
+    return (size + alignment - 1) / alignment * alignment;
+}
+
+// |magic|reserved|sequence|
+struct segment_header
+{
+    std::uint32_t magic;
+    std::uint32_t reserved;
+    std::uint64_t sequence;
+};
+
+// record_header::flags
+constexpr std::uint8_t flag_batch_continued = 0x1; // more records of the same batch follow
+
+// |magic|checksum|sequence|type|flags|keysize|version|payloadsize|reserved| key | payload |
+struct record_header
+{
+    std::uint32_t magic;
+    std::uint32_t checksum;
+    std::uint64_t sequence; // sequence of the owning segment; rejects records left over before the segment was recycled
+    record_t      type;
+    std::uint8_t  flags;
+    std::uint16_t keysize;
+    std::uint32_t version;
+    std::uint32_t payloadsize;
+    std::uint32_t reserved2;
+};
+
+static_assert(sizeof(segment_header) <= data_start);
+static_assert(sizeof(record_header) % alignment == 0);
+
+// one preallocated, mmap'ed segment file
+class file
+{
+    int fd_ = -1;
+    slsfs::leveldb_pack::unit_t* map_ = nullptr;
+    std::size_t size_ = 0;
+
+public:
+    boost::filesystem::path const path;
+    std::uint64_t sequence = 0;
+    std::size_t write_offset = data_start;
+    int live = 0; // pending prepares whose payload is in this segment
+
+    file(boost::filesystem::path const& p, std::size_t const size): path{p}
+    {
+        fd_ = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        if (fd_ < 0)
+            throw std::runtime_error(fmt::format("cannot open wal segment {}", path.string()));
+
+        off_t const filesize = ::lseek(fd_, 0, SEEK_END);
+        size_ = std::max<std::size_t>(size, filesize);
+        if (::posix_fallocate(fd_, 0, size_) != 0)
+            throw std::runtime_error(fmt::format("cannot preallocate wal segment {}", path.string()));
+
+        void* addr = ::mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+        if (addr == MAP_FAILED)
+            throw std::runtime_error(fmt::format("cannot mmap wal segment {}", path.string()));
+        map_ = static_cast<slsfs::leveldb_pack::unit_t*>(addr);
+
+        segment_header header;
+        std::memcpy(&header, map_, sizeof(header));
+        if (header.magic == segment_magic)
+            sequence = header.sequence;
+    }
+
+    ~file()
+    {
+        if (map_)
+            ::munmap(map_, size_);
+        if (fd_ >= 0)
+            ::close(fd_);
+    }
+
+    file(file const&) = delete;
+    file& operator= (file const&) = delete;
+
+    auto data() -> slsfs::leveldb_pack::unit_t* { return map_; }
+    auto size() const -> std::size_t { return size_; }
+    bool valid() const { return sequence != 0; }
+
+    void reset(std::uint64_t const seq)
+    {
+        segment_header const header {
+            .magic    = segment_magic,
+            .reserved = 0,
+            .sequence = seq,
+        };
+        std::memcpy(map_, &header, sizeof(header));
+        sequence = seq;
+        write_offset = data_start;
+        live = 0;
+    }
+
+    void sync(std::size_t const offset, std::size_t const length)
+    {
+        static long const pagesize = ::sysconf(_SC_PAGESIZE);
+        std::size_t const start = offset / pagesize * pagesize;
+        ::msync(map_ + start, offset + length - start, MS_SYNC);
+    }
+};
+
+auto checksum (record_header header, std::string_view key, std::string_view payload) -> std::uint32_t
+{
+    header.checksum = 0;
+    boost::crc_32_type crc;
+    crc.process_bytes(&header, sizeof(header));
+    crc.process_bytes(key.data(), key.size());
+    crc.process_bytes(payload.data(), payload.size());
+    return crc.checksum();
+}
+
+} // namespace segment
+
+// Append-only write-ahead log made of preallocated mmap'ed segment files.
+// Only pending prepares (as rawblocks deltas) live here; commit writes the block and its committed
+// version to the data db in one batch. Segments are recycled oldest first
+// once none of their prepares are pending anymore.
+class segment_log : public persistent_log
+{
+    struct entry
+    {
+        slsfs::leveldb_pack::versionint_t version;
+        segment::file* seg;
+        std::size_t payload_offset;
+        std::uint32_t payload_size;
+    };
+
+    engine::block_engine& data_db_;
+    boost::filesystem::path const dir_;
+    std::size_t const segment_size_;
+
+    std::mutex mutex_;
+    std::deque<std::unique_ptr<segment::file>> segments_; // ordered by sequence. back() is the active segment
+    std::vector<std::unique_ptr<segment::file>> free_;
+    std::unordered_map<std::string, entry> index_;
+    std::uint64_t next_sequence_ = 1;
+    int next_file_id_ = 0;
+
+    static
+    auto committed_version_key (std::string const& key) -> std::string { return keyspace::rebase(key, keyspace::space_t::committed_version); }
+
+    struct appended
+    {
+        segment::file* seg = nullptr;
+        std::size_t offset = 0, length = 0;
+    };
+
+    // must hold mutex_
+    void roll()
+    {
+        std::unique_ptr<segment::file> next;
+        if (not free_.empty())
+        {
+            next = std::move(free_.back());
+            free_.pop_back();
+        }
+        else
+            next = std::make_unique<segment::file>(
+                dir_ / fmt::format("segment-{:06}.log", next_file_id_++), segment_size_);
+
+        next->reset(next_sequence_++);
+        segments_.push_back(std::move(next));
+    }
+
+    static
+    auto record_length (std::string const& key, std::string_view const payload) -> std::size_t {
+        return segment::align(sizeof(segment::record_header) + key.size() + payload.size());
+    }
+
+    // must hold mutex_. makes sure the next length bytes land in one segment
+    void reserve (std::size_t const length)
+    {
+        if (segment::data_start + length > segment_size_)
+            throw std::runtime_error(fmt::format("wal record of {} bytes larger than segment", length));
+
+        if (segments_.empty() || segments_.back()->write_offset + length > segments_.back()->size())
+            roll();
+    }
+
+    // must hold mutex_
+    auto append (segment::record_t const type, std::string const& key,
+                 slsfs::leveldb_pack::versionint_t const version,
+                 std::string_view const payload,
+                 std::uint8_t const flags = 0) -> appended
+    {
+        std::size_t const length = record_length(key, payload);
+        reserve(length);
+
+        segment::file& seg = *segments_.back();
+        segment::record_header header {
+            .magic       = segment::record_magic,
+            .checksum    = 0,
+            .sequence    = seg.sequence,
+            .type        = type,
+            .flags       = flags,
+            .keysize     = static_cast<std::uint16_t>(key.size()),
+            .version     = version,
+            .payloadsize = static_cast<std::uint32_t>(payload.size()),
+            .reserved2   = 0,
+        };
+        header.checksum = segment::checksum(header, key, payload);
+
+        std::size_t const offset = seg.write_offset;
+        slsfs::leveldb_pack::unit_t* pos = seg.data() + offset;
+        std::memcpy(pos, &header, sizeof(header));
+        std::memcpy(pos + sizeof(header), key.data(), key.size());
+        std::memcpy(pos + sizeof(header) + key.size(), payload.data(), payload.size());
+        seg.write_offset += length;
+
+        return {&seg, offset, length};
+    }
+
+    // must hold mutex_
+    void set_entry (std::string const& key, entry const& e)
+    {
+        e.seg->live++;
+        if (auto it = index_.find(key); it != index_.end())
+        {
+            it->second.seg->live--;
+            it->second = e;
+        }
+        else
+            index_.emplace(key, e);
+    }
+
+    // must hold mutex_
+    void erase_entry (std::string const& key)
+    {
+        if (auto it = index_.find(key); it != index_.end())
+        {
+            it->second.seg->live--;
+            index_.erase(it);
+        }
+    }
+
+    // must hold mutex_
+    void recycle()
+    {
+        while (segments_.size() > 1 && segments_.front()->live == 0)
+        {
+            BOOST_LOG_TRIVIAL(debug) << "recycle wal segment " << segments_.front()->path;
+            free_.push_back(std::move(segments_.front()));
+            segments_.pop_front();
+        }
+    }
+
+    void sync (appended const& a)
+    {
+        if (sync_ && a.seg)
+            a.seg->sync(a.offset, a.length);
+    }
+
+    void scan (segment::file& seg)
+    {
+        // prepares of a batch only count once its last record is read
+        std::vector<std::pair<std::string, entry>> batch;
+
+        std::size_t offset = segment::data_start;
+        while (offset + sizeof(segment::record_header) <= seg.size())
+        {
+            segment::record_header header;
+            std::memcpy(&header, seg.data() + offset, sizeof(header));
+
+            std::size_t const length = segment::align(sizeof(header) + header.keysize + header.payloadsize);
+            if (header.magic != segment::record_magic ||
+                header.sequence != seg.sequence ||
+                offset + length > seg.size())
+                break;
+
+            char const* keypos = reinterpret_cast<char const*>(seg.data() + offset + sizeof(header));
+            std::string_view const key {keypos, header.keysize};
+            std::string_view const payload {keypos + header.keysize, header.payloadsize};
+            if (segment::checksum(header, key, payload) != header.checksum)
+            {
+                BOOST_LOG_TRIVIAL(error) << "wal checksum mismatch at " << seg.path << ":" << offset << ". stop scanning";
+                break;
+            }
+
+            switch (header.type)
+            {
+            case segment::record_t::prepare:
+                batch.emplace_back(std::string{key}, entry{
+                        .version        = header.version,
+                        .seg            = &seg,
+                        .payload_offset = offset + sizeof(header) + header.keysize,
+                        .payload_size   = header.payloadsize});
+
+                if (not (header.flags & segment::flag_batch_continued))
+                {
+                    for (auto const& [k, e] : batch)
+                        set_entry(k, e);
+                    batch.clear();
+                }
+                break;
+            case segment::record_t::commit:
+            case segment::record_t::rollback:
+                erase_entry(std::string{key});
+                break;
+            }
+            offset += length;
+        }
+        seg.write_offset = offset;
+    }
+
+    // rebuild the pending index from the segments at startup
+    void recover()
+    {
+        boost::filesystem::create_directories(dir_);
+
+        std::vector<std::unique_ptr<segment::file>> files;
+        for (boost::filesystem::directory_entry const& f : boost::filesystem::directory_iterator(dir_))
+        {
+            std::string const name = f.path().filename().string();
+            int id = 0;
+            if (std::sscanf(name.c_str(), "segment-%d.log", &id) != 1)
+                continue;
+
+            next_file_id_ = std::max(next_file_id_, id + 1);
+            files.push_back(std::make_unique<segment::file>(f.path(), segment_size_));
+        }
+
+        for (std::unique_ptr<segment::file>& f : files)
+            if (f->valid())
+                segments_.push_back(std::move(f));
+            else
+                free_.push_back(std::move(f));
+
+        std::sort(segments_.begin(), segments_.end(),
+                  [] (auto const& a, auto const& b) { return a->sequence < b->sequence; });
+
+        for (std::unique_ptr<segment::file>& seg : segments_)
+        {
+            scan(*seg);
+            next_sequence_ = std::max(next_sequence_, seg->sequence + 1);
+        }
+
+        // crashed after the data db write but before the commit record
+        for (auto it = index_.begin(); it != index_.end();)
+            if (it->second.version == get_committed_version(it->first))
+            {
+                it->second.seg->live--;
+                it = index_.erase(it);
+            }
+            else
+                ++it;
+
+        BOOST_LOG_TRIVIAL(info) << "wal recovered " << segments_.size() << " segments, "
+                                << index_.size() << " pending prepares";
+
+        // never append after a possibly torn tail
+        roll();
+        recycle();
+    }
+
+public:
+    segment_log (std::string const& dirname, engine::block_engine& data_db, std::size_t const segment_size, bool const sync = false):
+        persistent_log{sync}, data_db_{data_db}, dir_{dirname}, segment_size_{segment_size}
+    {
+        std::scoped_lock lock {mutex_};
+        recover();
+    }
+
+    static
+    auto parse_committed_version (std::string_view const version_value) -> slsfs::leveldb_pack::versionint_t
+    {
+        if (version_value.empty())
+            return 0;
+
+        try
+        {
+            return std::stoll(std::string{version_value});
+        } catch (std::exception&) {
+            BOOST_LOG_TRIVIAL(error) << "in get_committed_version, error on converting '" << version_value << "' to number";
+            return 0;
+        }
+    }
+
+    auto get_committed_version (std::string const& key) -> slsfs::leveldb_pack::versionint_t override
+    {
+        std::string version_value;
+        if (not data_db_.get(committed_version_key(key), version_value))
+            return 0;
+        return parse_committed_version(version_value);
+    }
+
+    auto max_committed_version (std::string const& begin, std::string const& end) -> slsfs::leveldb_pack::versionint_t override
+    {
+        slsfs::leveldb_pack::versionint_t version = 0;
+        std::string const version_end = committed_version_key(end);
+        std::unique_ptr<engine::iterator> it = data_db_.new_iterator();
+        for (it->seek(committed_version_key(begin)); it->valid() and it->key() < version_end; it->next())
+            version = std::max(version, parse_committed_version(it->value()));
+        return version;
+    }
+
+    void put_pending_prepare (std::string const& key, std::string_view const value, slsfs::leveldb_pack::versionint_t version) override
+    {
+        appended a;
+        {
+            std::scoped_lock lock {mutex_};
+            if (version == 0) // rollback
+            {
+                if (not index_.contains(key))
+                    return;
+                a = append(segment::record_t::rollback, key, 0, {});
+                erase_entry(key);
+                recycle();
+            }
+            else
+            {
+                a = append(segment::record_t::prepare, key, version, value);
+                set_entry(key, entry{
+                        .version        = version,
+                        .seg            = a.seg,
+                        .payload_offset = a.offset + sizeof(segment::record_header) + key.size(),
+                        .payload_size   = static_cast<std::uint32_t>(value.size())});
+            }
+        }
+        sync(a);
+    }
+
+    auto get_pending_prepare_data (std::string const& key) -> std::string override
+    {
+        std::scoped_lock lock {mutex_};
+        auto it = index_.find(key);
+        if (it == index_.end())
+            return {};
+
+        entry const& e = it->second;
+        return std::string(reinterpret_cast<char const*>(e.seg->data() + e.payload_offset), e.payload_size);
+    }
+
+    auto get_pending_prepare_version (std::string const& key) -> slsfs::leveldb_pack::versionint_t override
+    {
+        std::scoped_lock lock {mutex_};
+        auto it = index_.find(key);
+        if (it == index_.end())
+            return 0;
+        return it->second.version;
+    }
+
+    void commit_pending_prepare (std::string const& key, engine::block_engine& save_dest) override
+    {
+        std::string delta;
+        slsfs::leveldb_pack::versionint_t version = 0;
+        {
+            std::scoped_lock lock {mutex_};
+            auto it = index_.find(key);
+            if (it == index_.end())
+            {
+                BOOST_LOG_TRIVIAL(debug) << "commit without pending prepare";
+                return;
+            }
+
+            entry const& e = it->second;
+            version = e.version;
+            delta.assign(reinterpret_cast<char const*>(e.seg->data() + e.payload_offset), e.payload_size);
+        }
+        BOOST_LOG_TRIVIAL(trace) << "commit pending prepare version: " << version;
+
+        std::string const value = slsfs::leveldb_pack::rawblocks{}.merge(save_dest, key, delta);
+
+        engine::write_batch batch;
+        batch.put(key, value);
+        batch.put(committed_version_key(key), fmt::format("{}", version));
+        save_dest.write(batch);
+
+        appended a;
+        {
+            std::scoped_lock lock {mutex_};
+            a = append(segment::record_t::commit, key, version, {});
+            if (auto it = index_.find(key); it != index_.end() && it->second.version == version)
+                erase_entry(key);
+            recycle();
+        }
+        sync(a);
+    }
+
+    bool have_pending_log (std::string const& key) override
+    {
+        std::scoped_lock lock {mutex_};
+        return index_.contains(key);
+    }
+
+    void put_pending_prepare_batch (std::vector<prepare_entry> const& entries, slsfs::leveldb_pack::versionint_t version) override
+    {
+        if (entries.empty())
+            return;
+
+        appended first, last;
+        {
+            std::scoped_lock lock {mutex_};
+
+            // keep the whole batch in one segment so recovery sees it as a unit
+            std::size_t total = 0;
+            for (prepare_entry const& e : entries)
+                total += record_length(e.key, e.value);
+            reserve(total);
+
+            for (std::size_t i = 0; i < entries.size(); i++)
+            {
+                prepare_entry const& e = entries[i];
+                bool const continued = i + 1 < entries.size();
+                appended const a = append(segment::record_t::prepare, e.key, version, e.value,
+                                          continued? segment::flag_batch_continued : 0);
+                set_entry(e.key, entry{
+                        .version        = version,
+                        .seg            = a.seg,
+                        .payload_offset = a.offset + sizeof(segment::record_header) + e.key.size(),
+                        .payload_size   = static_cast<std::uint32_t>(e.value.size())});
+                if (i == 0)
+                    first = a;
+                last = a;
+            }
+        }
+
+        sync(appended{first.seg, first.offset, last.offset + last.length - first.offset});
+    }
+
+    void commit_pending_prepare_batch (std::vector<std::string> const& keys, engine::block_engine& save_dest) override
+    {
+        std::vector<std::pair<std::string const*, slsfs::leveldb_pack::versionint_t>> committed;
+        engine::write_batch batch;
+        for (std::string const& key : keys)
+        {
+            std::string delta;
+            slsfs::leveldb_pack::versionint_t version = 0;
+            {
+                std::scoped_lock lock {mutex_};
+                auto it = index_.find(key);
+                if (it == index_.end())
+                    continue;
+
+                entry const& e = it->second;
+                version = e.version;
+                delta.assign(reinterpret_cast<char const*>(e.seg->data() + e.payload_offset), e.payload_size);
+            }
+
+            batch.put(key, slsfs::leveldb_pack::rawblocks{}.merge(save_dest, key, delta));
+            batch.put(committed_version_key(key), fmt::format("{}", version));
+            committed.emplace_back(&key, version);
+        }
+
+        if (committed.empty())
+            return;
+
+        save_dest.write(batch);
+
+        std::vector<appended> records;
+        {
+            std::scoped_lock lock {mutex_};
+            for (auto const& [key, version] : committed)
+            {
+                records.push_back(append(segment::record_t::commit, *key, version, {}));
+                if (auto it = index_.find(*key); it != index_.end() && it->second.version == version)
+                    erase_entry(*key);
+            }
+            recycle();
+        }
+
+        for (appended const& a : records)
+            sync(a);
+    }
+
+    void remove_range (std::string const& begin, std::string const& end, engine::write_batch& data_batch) override
+    {
+        std::string const version_end = committed_version_key(end);
+        std::unique_ptr<engine::iterator> it = data_db_.new_iterator();
+        for (it->seek(committed_version_key(begin)); it->valid() and it->key() < version_end; it->next())
+            data_batch.remove(std::string{it->key()});
+
+        // rollback records, so recovery does not bring the prepares back
+        std::vector<appended> records;
+        {
+            std::scoped_lock lock {mutex_};
+            std::vector<std::string> pending;
+            for (auto const& [key, e] : index_)
+                if (begin <= key and key < end)
+                    pending.push_back(key);
+
+            for (std::string const& key : pending)
+            {
+                records.push_back(append(segment::record_t::rollback, key, 0, {}));
+                erase_entry(key);
+            }
+            recycle();
+        }
+
+        for (appended const& a : records)
+            sync(a);
+    }
+};
+
+} // namespace ssbd
+
+#endif // PERSISTENT_LOG_SEGMENT_HPP__
@@ -4,138 +4,63 @@
 #define PERSISTENT_LOG_HPP__
 
 #include "leveldb-serializer.hpp"
-#include <leveldb/cache.h>
-#include <leveldb/db.h>
+#include "block-engine.hpp"
 
-#include <fmt/core.h>
+#include <string>
+#include <string_view>
+#include <vector>
 
 namespace ssbd
 {
 
+// 2pc log interface. A key has at most one pending prepare (a rawblocks delta);
+// commit merges it into the block in the data db.
 class persistent_log
 {
-    std::unique_ptr<leveldb::Cache> cache_ = nullptr;
-    std::unique_ptr<leveldb::DB> db_log_ = nullptr;
+protected:
+    bool const sync_; // make every log write durable before returning
 
 public:
-    persistent_log (std::string const &dbname, std::size_t const cache_size)
-    {
-        leveldb::DB* db = nullptr;
-        leveldb::Options options;
-
-        cache_.reset(leveldb::NewLRUCache(cache_size));
-
-        options.create_if_missing = true;
-        options.write_buffer_size = 32 * 1024 * 1024;
-        options.block_cache = cache_.get();
+    persistent_log(bool const sync): sync_{sync} {}
+    virtual ~persistent_log() {}
 
-        leveldb::Status status = leveldb::DB::Open(options, std::string(dbname), &db);
-        if (not status.ok())
-        {
-            BOOST_LOG_TRIVIAL(error) << status.ToString() << "\n";
-            throw std::runtime_error("cannot open db");
-        }
+    virtual auto get_committed_version (std::string const& key) -> slsfs::leveldb_pack::versionint_t = 0;
+    virtual void put_pending_prepare (std::string const& key, std::string_view const value, slsfs::leveldb_pack::versionint_t version) = 0;
+    virtual auto get_pending_prepare_data (std::string const& key) -> std::string = 0;
+    virtual auto get_pending_prepare_version (std::string const& key) -> slsfs::leveldb_pack::versionint_t = 0;
+    virtual void commit_pending_prepare (std::string const& key, engine::block_engine& save_dest) = 0;
+    virtual bool have_pending_log (std::string const& key) = 0;
 
-        BOOST_LOG_TRIVIAL(debug) << "open db log ptr: " << db << "\n";
-        db_log_.reset(db);
-    }
+    // highest committed version of the blocks with keys in [begin, end), in one ordered
+    // scan of the committed version space instead of a lookup per block
+    virtual auto max_committed_version (std::string const& begin, std::string const& end) -> slsfs::leveldb_pack::versionint_t = 0;
 
-    auto get_committed_version (std::string const& key) -> slsfs::leveldb_pack::versionint_t
+    struct prepare_entry
     {
-        std::string const commit_version_key = key + "-committed-version";
-        std::string commit_version_buffer;// (sizeof(slsfs::leveldb_pack::versionint_t), '\0');
-        db_log_->Get(leveldb::ReadOptions(), commit_version_key, &commit_version_buffer);
-
-        if (commit_version_buffer.empty())
-            return 0;
-
-        try
-        {
-            return std::stoll(commit_version_buffer);
-        } catch (std::exception&) {
-            BOOST_LOG_TRIVIAL(error) << "in get_committed_version, error on converting '" << commit_version_buffer << "' to number";
-            commit_version_buffer = "0";
-            db_log_->Put(leveldb::WriteOptions(), commit_version_key, commit_version_buffer);
-            return 0;
-        }
-    }
-
-    void put_committed_version (std::string const& key, slsfs::leveldb_pack::versionint_t version)
-    {
-        std::string const commit_version_key = key + "-committed-version";
-        std::string commit_version_buffer = std::to_string(version);// (sizeof(slsfs::leveldb_pack::versionint_t), '\0');
-
-        // save as network format
-        //version = slsfs::leveldb_pack::hton(version);
-        //std::memcpy(commit_version_buffer.data(), &version, sizeof(slsfs::leveldb_pack::versionint_t));
-        BOOST_LOG_TRIVIAL(trace) << "put to log " << commit_version_buffer;
-        db_log_->Put(leveldb::WriteOptions(), commit_version_key, commit_version_buffer);
-    }
-
-    void put_pending_prepare (std::string const& key, std::string const& value, slsfs::leveldb_pack::versionint_t version)
-    {
-        { // save version
-            std::string version_value = fmt::format("{}", version);// (sizeof(slsfs::leveldb_pack::versionint_t), '\0');
-            std::string const version_key = key + "-version";
-
-            // save as network format
-            //version = slsfs::leveldb_pack::hton(version);
-            //std::memcpy(version_value.data(), &version, sizeof(slsfs::leveldb_pack::versionint_t));
+        std::string key;
+        std::string_view value; // points into the request body
+    };
 
-            db_log_->Put(leveldb::WriteOptions(), version_key, version_value);
-        }
-
-        {
-            std::string const log_key = key + "-data";
-            db_log_->Put(leveldb::WriteOptions(), log_key, value);
-        }
-    }
-
-    auto get_pending_prepare_data (std::string const& key) -> std::string
-    {
-        std::string const log_key = key + "-data";
-        std::string result;
-        db_log_->Get(leveldb::ReadOptions(), log_key, &result);
-        //BOOST_LOG_TRIVIAL(trace) << "read pending data " << result;
-        return result;
-    }
-
-    auto get_pending_prepare_version (std::string const& key) -> slsfs::leveldb_pack::versionint_t
-    {
-        std::string const version_key = key + "-version";
-        std::string version_value;
-
-        db_log_->Get(leveldb::ReadOptions(), version_key, &version_value);
-
-        if (version_value.empty())
-            return 0;
-
-        try
-        {
-            return std::stoll(version_value);
-        } catch (std::exception&) {
-            BOOST_LOG_TRIVIAL(error) << "in get_pending_prepare_version, error on converting '" << version_value << "' to number";
-            version_value = "0";
-            db_log_->Put(leveldb::WriteOptions(), version_key, version_value);
-            return 0;
-        }
-    }
-
-    void commit_pending_prepare (std::string const& key, leveldb::DB& save_dest)
-    {
-        std::string const value = get_pending_prepare_data(key);
-        slsfs::leveldb_pack::versionint_t const version = get_pending_prepare_version(key);
-        BOOST_LOG_TRIVIAL(trace) << "commit pending prepare version: " << version << " value=" << value;
+    // multi-block versions of the above. the prepares of one batch are logged all or nothing
+    virtual void put_pending_prepare_batch (std::vector<prepare_entry> const& entries, slsfs::leveldb_pack::versionint_t version) = 0;
+    virtual void commit_pending_prepare_batch (std::vector<std::string> const& keys, engine::block_engine& save_dest) = 0;
 
-        put_committed_version(key, version);
-        save_dest.Put(leveldb::WriteOptions(), key, value);
-    }
+    // drops every 2pc record of the blocks with keys in [begin, end). records that live in
+    // the data db are removed through data_batch, so they go away together with the blocks
+    virtual void remove_range (std::string const& begin, std::string const& end, engine::write_batch& data_batch) = 0;
 
-    bool have_pending_log (std::string const& key)
+    struct garbage
     {
-        return ! ((get_pending_prepare_version(key) == get_committed_version(key)) ||
-                  (get_pending_prepare_version(key) == 0)); // 0 == empty log
-    }
+        std::vector<std::string> keys;
+        std::size_t scanned = 0;
+    };
+
+    // gc of prepares that were committed or rolled back. find_garbage scans up to max_scan
+    // records from cursor (empty = the start; advanced past the scan) and returns the keys
+    // whose logged payload can go. collect_garbage rechecks and drops them; callers hold the
+    // storage shard of the keys. logs that drop payloads on commit keep these defaults
+    virtual auto find_garbage (std::string& /*cursor*/, std::size_t /*max_scan*/) -> garbage { return {}; }
+    virtual auto collect_garbage (std::vector<std::string> const& /*keys*/) -> std::size_t { return 0; }
 };
 
 } // namespace ssbd
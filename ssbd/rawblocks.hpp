@@ -4,8 +4,9 @@
 #define RAWBLOCKS_HPP__
 
 #include "basic.hpp"
+#include "block-engine.hpp"
 
-#include <leveldb/db.h>
+#include <string_view>
 
 namespace slsfs::leveldb_pack
 {
@@ -36,12 +37,56 @@ public:
         buf_ = std::move(newbuf);
     }
 
-    auto bind(leveldb::DB& db, std::string const& key) -> leveldb::Status {
-        return db.Get(leveldb::ReadOptions(), key, &buf_);
+    // false when the block does not exist
+    bool bind(ssbd::engine::block_engine& db, std::string const& key) {
+        return db.get(key, buf_);
     }
 
-    auto flush(leveldb::DB& db, std::string const& key) -> leveldb::Status {
-        return db.Put(leveldb::WriteOptions(), key, buf_);
+    void flush(ssbd::engine::block_engine& db, std::string const& key) {
+        db.put(key, buf_);
+    }
+
+    // a pending write in the 2pc log: |position (4 bytes)|data|
+    static constexpr std::size_t delta_header_size = sizeof(std::uint32_t);
+
+    // deltas are built in place: the data already sits right after dest[0, delta_header_size)
+    static
+    void write_delta_header(char* dest, std::uint32_t const position) {
+        std::memcpy(dest, &position, sizeof(position));
+    }
+
+    static
+    void apply_delta(std::string& block, std::string_view const delta)
+    {
+        std::uint32_t position = 0;
+        if (delta.size() < sizeof(position))
+            return;
+
+        std::memcpy(&position, delta.data(), sizeof(position));
+        std::string_view const data = delta.substr(sizeof(position));
+
+        // make sure all buffer can write to block
+        block.resize(std::max<std::size_t>(position + data.size(), block.size()));
+        std::copy(data.begin(), data.end(), std::next(block.begin(), position));
+    }
+
+    // merge a delta into the committed block. skips reading the block when the delta overwrites all of it
+    auto merge(ssbd::engine::block_engine& db, std::string const& key, std::string_view const delta) -> std::string
+    {
+        std::uint32_t position = 0;
+        std::size_t datasize = 0;
+        if (delta.size() >= sizeof(position))
+        {
+            std::memcpy(&position, delta.data(), sizeof(position));
+            datasize = delta.size() - sizeof(position);
+        }
+
+        buf_.clear();
+        if (position != 0 || datasize < fullsize())
+            bind(db, key);
+
+        apply_delta(buf_, delta);
+        return std::move(buf_);
     }
 };
 
@@ -0,0 +1,131 @@
+#pragma once
+
+#ifndef STORAGE_EXECUTOR_HPP__
+#define STORAGE_EXECUTOR_HPP__
+
+#include "basic.hpp"
+
+#include <boost/asio.hpp>
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace ssbd
+{
+
+// Runs storage (leveldb) work off the network threads.
+// Each shard is a single thread, and a key always maps to the same shard,
+// so operations on one key run in the order they were posted.
+// In per-core mode shard i is pinned to core i and also runs the connections
+// accepted on it; work for a key the current core owns runs inline, work for
+// other keys is handed off to the owning core.
+class storage_executor
+{
+    using work_guard = net::executor_work_guard<net::io_context::executor_type>;
+
+    std::vector<std::unique_ptr<net::io_context>> shards_;
+    std::vector<work_guard> guards_;
+    std::vector<std::thread> threads_;
+    bool const per_core_;
+
+    static
+    void pin_to_core(std::size_t const core)
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(core % std::thread::hardware_concurrency(), &set);
+        if (int const rc = pthread_setaffinity_np(pthread_self(), sizeof(set), &set); rc != 0)
+            BOOST_LOG_TRIVIAL(error) << "storage executor: cannot pin shard to core " << core << ": " << std::strerror(rc);
+    }
+
+public:
+    storage_executor(int const shard_count, bool const per_core = false): per_core_{per_core}
+    {
+        shards_.reserve(shard_count);
+        guards_.reserve(shard_count);
+        threads_.reserve(shard_count);
+        for (int i = 0; i < shard_count; i++)
+        {
+            shards_.push_back(std::make_unique<net::io_context>(1));
+            guards_.push_back(net::make_work_guard(*shards_.back()));
+        }
+
+        for (std::size_t i = 0; i < shards_.size(); i++)
+            threads_.emplace_back(
+                [this, i, &shard=shards_[i]] {
+                    if (per_core_)
+                        pin_to_core(i);
+
+                    // last resort: handlers catch engine errors themselves and reply err.
+                    // whatever still escapes is logged and the shard keeps running
+                    for (;;)
+                        try
+                        {
+                            shard->run();
+                            return;
+                        }
+                        catch (std::exception const& e)
+                        {
+                            BOOST_LOG_TRIVIAL(error) << "storage executor: " << e.what();
+                        }
+                });
+    }
+
+    ~storage_executor()
+    {
+        stop();
+        for (std::thread& th : threads_)
+            th.join();
+    }
+
+    void stop()
+    {
+        guards_.clear();
+        for (std::unique_ptr<net::io_context>& shard : shards_)
+            shard->stop();
+    }
+
+    // fnv-1a: stable across runs, since per-core dbs persist the mapping
+    static
+    auto hash_of(std::string_view const key) -> std::uint64_t
+    {
+        std::uint64_t h = 0xcbf29ce484222325ULL;
+        for (char const c : key)
+        {
+            h ^= static_cast<unsigned char>(c);
+            h *= 0x100000001b3ULL;
+        }
+        return h;
+    }
+
+    auto shard_of(std::string_view const key) const -> std::size_t {
+        return hash_of(key) % shards_.size();
+    }
+
+    auto shard_count() const -> std::size_t { return shards_.size(); }
+    bool per_core() const { return per_core_; }
+
+    auto context(std::size_t const shard) -> net::io_context& { return *shards_.at(shard); }
+
+    template<typename Function>
+    void post(std::string const& key, Function&& f)
+    {
+        net::io_context& shard = *shards_.at(shard_of(key));
+        // the owning core runs its own keys without a hop. one thread per shard keeps the order
+        if (per_core_)
+            net::dispatch(shard, std::forward<Function>(f));
+        else
+            net::post(shard, std::forward<Function>(f));
+    }
+};
+
+} // namespace ssbd
+
+#endif // STORAGE_EXECUTOR_HPP__